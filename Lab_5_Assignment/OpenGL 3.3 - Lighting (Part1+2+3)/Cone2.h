@@ -11,6 +11,12 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "shader.h"
+#include "glState.h"
+#include "materials.h"
+#include "meshRegistry.h"
+#include "instanceQueue.h"
+#include "proceduralPrimitives.h"
+#include "levelOfDetail.h"
 
 # define PI 3.1416
 
@@ -27,6 +33,10 @@ public:
     unsigned int specularMap;
     float shininess;
 
+    // row of the material table, shared with every primitive that has the
+    // same values; see materials.h
+    unsigned int materialID = DEFAULT_MATERIAL;
+
     Cone2(float radius, float height, int sectorCount, glm::vec3 amb, glm::vec3 diff, glm::vec3 spec, float shiny,
         unsigned int dMap, unsigned int sMap, float textureXmin, float textureYmin, float textureXmax, float textureYmax) {
         set(radius, height, sectorCount, amb, diff, spec, shiny, dMap, sMap, textureXmin, textureYmin, textureXmax, textureYmax);
@@ -49,37 +59,58 @@ public:
         this->TXmax = textureXmax;
         this->TYmin = textureYmin;
         this->TYmax = textureYmax;
-
-        buildCoordinatesAndIndices();
+        materialID = registerMaterial(amb, diff, spec, shiny, dMap, sMap);
     }
 
     void drawConeWithTexture(Shader& shader, glm::mat4 model = glm::mat4(1.0f)) {
         shader.use();
-        shader.setVec3("material.ambient", this->ambient);
-        shader.setVec3("material.diffuse", this->diffuse);
-        shader.setVec3("material.specular", this->specular);
-        shader.setFloat("material.shininess", this->shininess);
+        shader.setMaterial(materialID);
+
+        glState().bindTextureToUnit(0, GL_TEXTURE_2D, this->diffuseMap);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, this->diffuseMap);
+        glState().bindTextureToUnit(1, GL_TEXTURE_2D, this->specularMap);
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, this->specularMap);
+        shader.setModel(model);
 
-        shader.setMat4("model", model);
+        lods.select(model).draw();
+    }
+
+    // same, drawn later with every other copy of this cone; see instanceQueue.h
+    void drawConeWithTexture(InstanceQueue& queue, const glm::mat4& model) {
+        drawConeWithTexture(queue, model, glm::mat3(glm::transpose(glm::inverse(model))));
+    }
 
-        glBindVertexArray(coneVAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+    // same, with the normal matrix cached by the scene graph (see sceneGraph.h)
+    // for object id, which keeps its level of detail between frames
+    void drawConeWithTexture(InstanceQueue& queue, const glm::mat4& model, const glm::mat3& normalMatrix, unsigned int id = NO_DRAW_ID) {
+        queue.add(lods.select(model, id), -1, materialID, this->diffuseMap, this->specularMap, model, normalMatrix);
     }
 
+    // same, made in the vertex shader; see proceduralPrimitives.h. The
+    // texture rectangle applies here, and the side gets slanted normals
+    void drawConeWithTexture(ProceduralQueue& queue, const glm::mat4& model) {
+        drawConeWithTexture(queue, model, glm::mat3(glm::transpose(glm::inverse(model))));
+    }
+
+    void drawConeWithTexture(ProceduralQueue& queue, const glm::mat4& model, const glm::mat3& normalMatrix, unsigned int id = NO_DRAW_ID) {
+        int level = lods.selectLevel(model, id);
+        queue.add(ProceduralShape::frustum(radius, 0.0f, height, 0.0f, lodSectorCount(sectorCount, level, 3), 1)
+            .textureRect(TXmin, TYmin, TXmax, TYmax), materialID, this->diffuseMap, this->specularMap, model, normalMatrix);
+    }
+
+    const Mesh& getMesh(int level = 0) const { return lods.get(level); }
+
 private:
-    unsigned int coneVAO, coneVBO, coneEBO;
+    // shared with every cone of the same shape, one mesh per level of detail
+    LodChain lods;
     std::vector<float> vertices;
     std::vector<unsigned int> indices;
     float radius, height;
     int sectorCount;
 
     void buildCoordinatesAndIndices() {
+        vertices.clear();
+        indices.clear();
         float sectorStep = 2 * PI / sectorCount;
         float sectorAngle;
 
@@ -89,6 +120,7 @@ private:
         vertices.push_back(0.0f);
         vertices.push_back(0.0f);
         vertices.push_back(-1.0f);
+        vertices.push_back(0.0f);
         vertices.push_back(0.5f);
         vertices.push_back(0.5f);
 
@@ -103,6 +135,7 @@ private:
             vertices.push_back(z);
             vertices.push_back(0.0f);
             vertices.push_back(-1.0f);
+            vertices.push_back(0.0f);
             vertices.push_back((cosf(sectorAngle) + 1) * 0.5f);
             vertices.push_back((sinf(sectorAngle) + 1) * 0.5f);
         }
@@ -113,6 +146,7 @@ private:
         vertices.push_back(0.0f);
         vertices.push_back(0.0f);
         vertices.push_back(1.0f);
+        vertices.push_back(0.0f);
         vertices.push_back(0.5f);
         vertices.push_back(1.0f);
 
@@ -132,27 +166,26 @@ private:
         }
     }
 
+    // the full mesh and LOD_COUNT - 1 coarser ones with half the sectors each
     void setUpConeVertexDataAndConfigureVertexAttribute() {
-        glGenVertexArrays(1, &coneVAO);
-        glGenBuffers(1, &coneVBO);
-        glGenBuffers(1, &coneEBO);
-
-        glBindVertexArray(coneVAO);
-
-        glBindBuffer(GL_ARRAY_BUFFER, coneVBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, coneEBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
-
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 7 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
-
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 7 * sizeof(float), (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(1);
+        int fullSectorCount = sectorCount;
+        for (int level = 0; level < LOD_COUNT; ++level) {
+            sectorCount = lodSectorCount(fullSectorCount, level, 3);
+            lods.meshes[level] = meshRegistry().acquire(MeshKey("cone") << radius << height << sectorCount,
+                [this](Mesh& coneMesh) {
+                    buildCoordinatesAndIndices();
+                    buildConeMesh(coneMesh);
+                });
+        }
+        sectorCount = fullSectorCount;
+        // the base is at y = 0 and the apex at y = height
+        lods.boundingCentre = glm::vec3(0.0f, height / 2, 0.0f);
+        lods.boundingRadius = glm::length(glm::vec2(radius, height / 2));
+    }
 
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 7 * sizeof(float), (void*)(6 * sizeof(float)));
-        glEnableVertexAttribArray(2);
+    void buildConeMesh(Mesh& coneMesh) {
+        // position, normal, texture coordinates: 8 floats a vertex
+        coneMesh.setData(LAYOUT_POSITION_NORMAL_TEXCOORD, vertices.data(), (GLsizei)vertices.size() / 8, indices.data(), (GLsizei)indices.size());
     }
 };
 #pragma once
@@ -0,0 +1,72 @@
+//
+//  boundingBox.h
+//  test
+//
+//  Axis-aligned box around a mesh or an object, in whatever space its
+//  corners are in. Meshes keep the box of their positions (see
+//  meshRegistry.h); placing one by a world matrix gives the world box the
+//  culling works with (see frustumCulling.h).
+//
+
+#ifndef boundingBox_h
+#define boundingBox_h
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cfloat>
+#include <cstddef>
+
+struct BoundingBox {
+    // empty until something is added: low above high
+    glm::vec3 low = glm::vec3(FLT_MAX);
+    glm::vec3 high = glm::vec3(-FLT_MAX);
+
+    BoundingBox() = default;
+    BoundingBox(const glm::vec3& low, const glm::vec3& high) : low(low), high(high) {}
+
+    bool isEmpty() const { return low.x > high.x; }
+
+    void add(const glm::vec3& point)
+    {
+        low = glm::min(low, point);
+        high = glm::max(high, point);
+    }
+
+    void add(const BoundingBox& box)
+    {
+        low = glm::min(low, box.low);
+        high = glm::max(high, box.high);
+    }
+
+    glm::vec3 centre() const { return (low + high) * 0.5f; }
+    glm::vec3 extent() const { return (high - low) * 0.5f; }
+
+    // the box around the first three floats of count vertices, stride floats apart
+    static BoundingBox ofPositions(const float* vertices, size_t count, size_t stride)
+    {
+        BoundingBox box;
+        for (size_t i = 0; i < count; ++i)
+            box.add(glm::vec3(vertices[i * stride], vertices[i * stride + 1], vertices[i * stride + 2]));
+        return box;
+    }
+
+    // the box around this one placed by transform: the transformed centre,
+    // with the extent through the absolute values of the rotation and scale
+    BoundingBox transformed(const glm::mat4& transform) const
+    {
+        if (isEmpty())
+            return *this;
+        glm::vec3 c = glm::vec3(transform * glm::vec4(centre(), 1.0f));
+        glm::vec3 e = extent();
+        glm::vec3 worldExtent(0.0f);
+        for (int column = 0; column < 3; ++column)
+        {
+            glm::vec3 axis = glm::vec3(transform[column]);
+            worldExtent += glm::vec3(std::fabs(axis.x), std::fabs(axis.y), std::fabs(axis.z)) * e[column];
+        }
+        return BoundingBox(c - worldExtent, c + worldExtent);
+    }
+};
+
+#endif /* boundingBox_h */
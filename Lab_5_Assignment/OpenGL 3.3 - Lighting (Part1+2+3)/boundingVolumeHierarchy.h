@@ -0,0 +1,405 @@
+//
+//  boundingVolumeHierarchy.h
+//  test
+//
+//  A tree of boxes over the world boxes of the scene's objects, so asking
+//  what is in the view, under a ray or in a region only looks at the
+//  subtrees that can hold an answer instead of every object.
+//
+//  build() splits the objects top-down with the surface area heuristic:
+//  along each axis the object centres are sorted into BIN_COUNT bins and
+//  the split between two bins with the least expected cost (the area of
+//  each side times the objects on it) wins, or the node stays a leaf when
+//  no split beats testing its objects directly. When objects move,
+//  setBounds() and refit() grow and shrink the boxes bottom-up without
+//  changing the tree; degraded() tells when that has made the tree so much
+//  worse than a fresh build that build() is worth its time again.
+//
+//  Every query goes through query(volume, visit): volume classifies a box
+//  as outside, partly inside or wholly inside (FrustumQuery, BoxQuery and
+//  RayQuery below), and visit(object) is called for every object whose box
+//  isn't outside, returning false to stop early. raycast() finds the
+//  nearest hit on top of it.
+//
+
+#ifndef boundingVolumeHierarchy_h
+#define boundingVolumeHierarchy_h
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <chrono>
+#include <cfloat>
+#include <algorithm>
+
+#include "boundingBox.h"
+#include "frustumCulling.h"
+#include "renderStats.h"
+
+enum class BvhOverlap { OUTSIDE, INTERSECTS, INSIDE };
+
+// the boxes at least partly inside a view frustum
+struct FrustumQuery {
+    Frustum frustum;
+
+    BvhOverlap classify(const BoundingBox& box) const
+    {
+        if (frustum.excludes(box))
+            return BvhOverlap::OUTSIDE;
+        return frustum.contains(box) ? BvhOverlap::INSIDE : BvhOverlap::INTERSECTS;
+    }
+};
+
+// the boxes overlapping region
+struct BoxQuery {
+    BoundingBox region;
+
+    BvhOverlap classify(const BoundingBox& box) const
+    {
+        bool inside = true;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (box.high[axis] < region.low[axis] || box.low[axis] > region.high[axis])
+                return BvhOverlap::OUTSIDE;
+            inside = inside && box.low[axis] >= region.low[axis] && box.high[axis] <= region.high[axis];
+        }
+        return inside ? BvhOverlap::INSIDE : BvhOverlap::INTERSECTS;
+    }
+};
+
+// the boxes a ray enters before *maxDistance; maxDistance is read on every
+// test, so a caller looking for the nearest hit can shrink it as it goes
+struct RayQuery {
+    glm::vec3 origin;
+    // 1 / direction, infinite along an axis the ray doesn't move on
+    glm::vec3 inverseDirection;
+    const float* maxDistance;
+
+    RayQuery(const glm::vec3& origin, const glm::vec3& direction, const float* maxDistance)
+        : origin(origin), inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z), maxDistance(maxDistance) {}
+
+    // how far along the ray it enters box, or a negative number if it misses
+    float entry(const BoundingBox& box) const
+    {
+        float enter = 0.0f, leave = *maxDistance;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float t0 = (box.low[axis] - origin[axis]) * inverseDirection[axis];
+            float t1 = (box.high[axis] - origin[axis]) * inverseDirection[axis];
+            enter = std::max(enter, std::min(t0, t1));
+            leave = std::min(leave, std::max(t0, t1));
+        }
+        return enter <= leave ? enter : -1.0f;
+    }
+
+    BvhOverlap classify(const BoundingBox& box) const
+    {
+        return entry(box) >= 0.0f ? BvhOverlap::INTERSECTS : BvhOverlap::OUTSIDE;
+    }
+};
+
+class BoundingVolumeHierarchy {
+public:
+    static const int BIN_COUNT = 16;
+    // the most objects a leaf gets when splitting it would cost the same
+    static const unsigned int MAX_LEAF_SIZE = 4;
+    // how much worse than just after build() refits may make the tree
+    float rebuildThreshold = 1.5f;
+
+    BoundingVolumeHierarchy() = default;
+    BoundingVolumeHierarchy(const BoundingVolumeHierarchy&) = delete;
+    BoundingVolumeHierarchy& operator=(const BoundingVolumeHierarchy&) = delete;
+
+    // a new tree over boxes; object i of the queries is boxes[i]
+    void build(const std::vector<BoundingBox>& boxes)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        objectBounds = boxes;
+        objects.resize(boxes.size());
+        centres.resize(boxes.size());
+        for (size_t i = 0; i < boxes.size(); ++i)
+        {
+            objects[i] = (unsigned int)i;
+            centres[i] = boxes[i].centre();
+        }
+        nodes.clear();
+        nodes.reserve(boxes.size() * 2);
+        if (!boxes.empty())
+        {
+            nodes.push_back(Node{ BoundingBox(), 0, (unsigned int)boxes.size() });
+            split();
+        }
+        builtCost = cost();
+        buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // move object; the tree sees it after the next refit()
+    void setBounds(unsigned int object, const BoundingBox& box)
+    {
+        objectBounds[object] = box;
+    }
+
+    // fit every node's box to what is under it again, leaves first
+    void refit()
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        // children always come after their parent, so backwards is bottom-up
+        for (size_t i = nodes.size(); i-- > 0;)
+        {
+            Node& node = nodes[i];
+            node.bounds = BoundingBox();
+            if (node.count > 0)
+                for (unsigned int j = node.first; j < node.first + node.count; ++j)
+                    node.bounds.add(objectBounds[objects[j]]);
+            else
+            {
+                node.bounds.add(nodes[node.first].bounds);
+                node.bounds.add(nodes[node.first + 1].bounds);
+            }
+        }
+        refitSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        renderStats().hierarchyRefits++;
+        renderStats().hierarchyRefitSeconds += refitSeconds;
+    }
+
+    // whether refits have made queries noticeably slower than after a build
+    bool degraded() const { return cost() > builtCost * rebuildThreshold; }
+
+    // call visit(object) for every object volume doesn't classify as
+    // outside, until it returns false
+    template <class Volume, class Visit>
+    void query(const Volume& volume, Visit visit) const
+    {
+        if (nodes.empty())
+            return;
+        // a node to look at, and whether its box is already known to be inside
+        struct Pending {
+            unsigned int node;
+            bool inside;
+        };
+        Pending stack[MAX_DEPTH + 1];
+        int top = 0;
+        stack[top++] = Pending{ 0, false };
+        while (top > 0)
+        {
+            Pending pending = stack[--top];
+            const Node& node = nodes[pending.node];
+            bool inside = pending.inside;
+            if (!inside)
+            {
+                BvhOverlap overlap = volume.classify(node.bounds);
+                if (overlap == BvhOverlap::OUTSIDE)
+                    continue;
+                inside = overlap == BvhOverlap::INSIDE;
+            }
+            if (node.count == 0)
+            {
+                stack[top++] = Pending{ node.first + 1, inside };
+                stack[top++] = Pending{ node.first, inside };
+                continue;
+            }
+            for (unsigned int j = node.first; j < node.first + node.count; ++j)
+            {
+                unsigned int object = objects[j];
+                if (!inside && volume.classify(objectBounds[object]) == BvhOverlap::OUTSIDE)
+                    continue;
+                if (!visit(object))
+                    return;
+            }
+        }
+    }
+
+    // the frustum form FrustumCuller::cull(viewProjection, index) uses
+    template <class Visit>
+    void query(const Frustum& frustum, Visit visit) const
+    {
+        query(FrustumQuery{ frustum }, visit);
+    }
+
+    // the nearest object hit(object) says the ray hits, with the distance to
+    // it in distance; hit returns a negative number for a miss, and is only
+    // asked about objects whose box the ray enters within distance.
+    // Returns NO_OBJECT (and leaves distance) when nothing is hit
+    static const unsigned int NO_OBJECT = ~0u;
+    template <class Hit>
+    unsigned int raycast(const glm::vec3& origin, const glm::vec3& direction, float& distance, Hit hit) const
+    {
+        unsigned int nearest = NO_OBJECT;
+        query(RayQuery(origin, direction, &distance), [&](unsigned int object) {
+            float d = hit(object);
+            if (d >= 0.0f && d < distance)
+            {
+                distance = d;
+                nearest = object;
+            }
+            return true;
+        });
+        return nearest;
+    }
+
+    // the same against the objects' boxes themselves
+    unsigned int raycast(const glm::vec3& origin, const glm::vec3& direction, float& distance) const
+    {
+        RayQuery ray(origin, direction, &distance);
+        return raycast(origin, direction, distance, [&](unsigned int object) { return ray.entry(objectBounds[object]); });
+    }
+
+    const BoundingBox& bounds(unsigned int object) const { return objectBounds[object]; }
+
+    size_t size() const { return objectBounds.size(); }
+    size_t nodeCount() const { return nodes.size(); }
+    double lastBuildSeconds() const { return buildSeconds; }
+    double lastRefitSeconds() const { return refitSeconds; }
+
+private:
+    // deeper nodes are made leaves, which bounds the query stack
+    static const int MAX_DEPTH = 64;
+
+    // a leaf holds objects[first, first + count); an inner node has count 0
+    // and its children at first and first + 1
+    struct Node {
+        BoundingBox bounds;
+        unsigned int first;
+        unsigned int count;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<BoundingBox> objectBounds;
+    // object indices, grouped so each leaf's objects are next to each other
+    std::vector<unsigned int> objects;
+    std::vector<glm::vec3> centres;
+    float builtCost = 0.0f;
+    double buildSeconds = 0.0;
+    double refitSeconds = 0.0;
+
+    static float area(const BoundingBox& box)
+    {
+        if (box.isEmpty())
+            return 0.0f;
+        glm::vec3 size = box.high - box.low;
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    // expected boxes tested per query, relative to the root: every inner
+    // node's area plus every leaf's area times its objects
+    float cost() const
+    {
+        if (nodes.empty() || area(nodes[0].bounds) <= 0.0f)
+            return 0.0f;
+        float total = 0.0f;
+        for (const Node& node : nodes)
+            total += area(node.bounds) * (node.count > 0 ? (float)node.count : 1.0f);
+        return total / area(nodes[0].bounds);
+    }
+
+    // split the root and everything under it until splitting stops paying
+    void split()
+    {
+        struct Pending {
+            unsigned int node;
+            int depth;
+        };
+        std::vector<Pending> pending;
+        pending.push_back(Pending{ 0, 0 });
+        while (!pending.empty())
+        {
+            Pending current = pending.back();
+            pending.pop_back();
+            Node& node = nodes[current.node];
+            BoundingBox centreBounds;
+            node.bounds = BoundingBox();
+            for (unsigned int j = node.first; j < node.first + node.count; ++j)
+            {
+                node.bounds.add(objectBounds[objects[j]]);
+                centreBounds.add(centres[objects[j]]);
+            }
+            if (node.count <= 1 || current.depth >= MAX_DEPTH - 1)
+                continue;
+
+            int axis = -1, splitBin = 0;
+            // a leaf costs a test per object; a split costs one for each child box
+            // and then that child's objects as often as the child is hit
+            float bestCost = (float)node.count, parentArea = area(node.bounds);
+            for (int a = 0; a < 3; ++a)
+            {
+                float low = centreBounds.low[a], extent = centreBounds.high[a] - low;
+                if (extent <= 0.0f)
+                    continue;
+                BoundingBox binBounds[BIN_COUNT];
+                unsigned int binCounts[BIN_COUNT] = {};
+                float scale = BIN_COUNT / extent;
+                for (unsigned int j = node.first; j < node.first + node.count; ++j)
+                {
+                    int bin = std::min(BIN_COUNT - 1, (int)((centres[objects[j]][a] - low) * scale));
+                    binBounds[bin].add(objectBounds[objects[j]]);
+                    binCounts[bin]++;
+                }
+                // the areas and counts left of every boundary, then a sweep from the right
+                float leftAreas[BIN_COUNT - 1];
+                unsigned int leftCounts[BIN_COUNT - 1];
+                BoundingBox left;
+                unsigned int leftCount = 0;
+                for (int b = 0; b < BIN_COUNT - 1; ++b)
+                {
+                    left.add(binBounds[b]);
+                    leftCount += binCounts[b];
+                    leftAreas[b] = area(left);
+                    leftCounts[b] = leftCount;
+                }
+                BoundingBox right;
+                unsigned int rightCount = 0;
+                for (int b = BIN_COUNT - 1; b > 0; --b)
+                {
+                    right.add(binBounds[b]);
+                    rightCount += binCounts[b];
+                    if (leftCounts[b - 1] == 0 || rightCount == 0)
+                        continue;
+                    float splitCost = 1.0f + (leftAreas[b - 1] * leftCounts[b - 1] + area(right) * rightCount) / parentArea;
+                    if (splitCost < bestCost)
+                    {
+                        bestCost = splitCost;
+                        axis = a;
+                        splitBin = b;
+                    }
+                }
+            }
+            // a few objects with no split worth making stay together
+            if (axis < 0 && node.count <= MAX_LEAF_SIZE)
+                continue;
+
+            unsigned int* begin = objects.data() + node.first;
+            unsigned int* end = begin + node.count;
+            unsigned int* middle;
+            if (axis >= 0)
+            {
+                float low = centreBounds.low[axis], scale = BIN_COUNT / (centreBounds.high[axis] - low);
+                middle = std::partition(begin, end, [&](unsigned int object) {
+                    return std::min(BIN_COUNT - 1, (int)((centres[object][axis] - low) * scale)) < splitBin;
+                });
+            }
+            else
+            {
+                // too many objects to leave, and no good split: halve them along
+                // the longest axis of their centres (or by index when they all share one)
+                glm::vec3 extent = centreBounds.high - centreBounds.low;
+                int longest = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+                middle = begin + node.count / 2;
+                std::nth_element(begin, middle, end, [&](unsigned int a, unsigned int b) {
+                    return centres[a][longest] < centres[b][longest];
+                });
+            }
+
+            unsigned int first = node.first, leftCount = (unsigned int)(middle - begin), count = node.count;
+            unsigned int children = (unsigned int)nodes.size();
+            // node is a reference into nodes, which the push_backs may move
+            nodes[current.node].first = children;
+            nodes[current.node].count = 0;
+            nodes.push_back(Node{ BoundingBox(), first, leftCount });
+            nodes.push_back(Node{ BoundingBox(), first + leftCount, count - leftCount });
+            pending.push_back(Pending{ children + 1, current.depth + 1 });
+            pending.push_back(Pending{ children, current.depth + 1 });
+        }
+    }
+};
+
+#endif /* boundingVolumeHierarchy_h */
@@ -0,0 +1,44 @@
+//
+//  cameraUniformBuffer.h
+//  test
+//
+//  Per-frame camera data shared by every program through the PerFrame
+//  uniform block, so the matrices are uploaded once a frame no matter how
+//  many programs read them.
+//
+
+#ifndef cameraUniformBuffer_h
+#define cameraUniformBuffer_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "uniformBlocks.h"
+
+// std140 mirror of
+//     layout (std140) uniform PerFrame { mat4 projection; mat4 view; vec3 viewPos; };
+struct PerFrameUniforms {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 viewPos;
+};
+
+class CameraUniformBuffer {
+public:
+    CameraUniformBuffer() : buffer(PER_FRAME_BLOCK_BINDING, sizeof(PerFrameUniforms)) {}
+
+    void update(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& viewPos)
+    {
+        data.projection = projection;
+        data.view = view;
+        data.viewPos = glm::vec4(viewPos, 1.0f);
+        buffer.update(0, sizeof(PerFrameUniforms), &data);
+    }
+
+    const PerFrameUniforms& getData() const { return data; }
+
+private:
+    UniformBuffer buffer;
+    PerFrameUniforms data;
+};
+
+#endif /* cameraUniformBuffer_h */
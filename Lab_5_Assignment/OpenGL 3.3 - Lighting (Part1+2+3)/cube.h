@@ -14,6 +14,10 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "shader.h"
+#include "glState.h"
+#include "materials.h"
+#include "meshRegistry.h"
+#include "instanceQueue.h"
 
 using namespace std;
 
@@ -21,20 +25,24 @@ class Cube {
 public:
 
     // materialistic property
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
+    glm::vec3 ambient = glm::vec3(0.0f);
+    glm::vec3 diffuse = glm::vec3(0.0f);
+    glm::vec3 specular = glm::vec3(0.0f);
 
     // texture property
     float TXmin = 0.0f;
     float TXmax = 1.0f;
     float TYmin = 0.0f;
     float TYmax = 1.0f;
-    unsigned int diffuseMap;
-    unsigned int specularMap;
+    unsigned int diffuseMap = 0;
+    unsigned int specularMap = 0;
 
     // common property
-    float shininess;
+    float shininess = 0.0f;
+
+    // row of the material table, shared with every primitive that has the
+    // same values; see materials.h
+    unsigned int materialID = DEFAULT_MATERIAL;
 
     // constructors
     Cube()
@@ -48,6 +56,7 @@ public:
         this->diffuse = diff;
         this->specular = spec;
         this->shininess = shiny;
+        updateMaterialID();
 
         setUpCubeVertexDataAndConfigureVertexAttribute();
     }
@@ -61,55 +70,51 @@ public:
         this->TYmin = textureYmin;
         this->TXmax = textureXmax;
         this->TYmax = textureYmax;
+        updateMaterialID();
 
         setUpCubeVertexDataAndConfigureVertexAttribute();
     }
 
-    // destructor
-    ~Cube()
-    {
-        glDeleteVertexArrays(1, &cubeVAO);
-        glDeleteVertexArrays(1, &lightCubeVAO);
-        glDeleteVertexArrays(1, &lightTexCubeVAO);
-        glDeleteBuffers(1, &cubeVBO);
-        glDeleteBuffers(1, &cubeEBO);
-    }
-
     void drawCubeWithTexture(Shader& lightingShaderWithTexture, glm::mat4 model = glm::mat4(1.0f))
     {
         lightingShaderWithTexture.use();
 
+        lightingShaderWithTexture.setMaterial(materialID);
         lightingShaderWithTexture.setInt("material.diffuse", 0);
         lightingShaderWithTexture.setInt("material.specular", 1);
-        lightingShaderWithTexture.setFloat("material.shininess", this->shininess);
 
 
         // bind diffuse map
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, this->diffuseMap);
+        glState().bindTextureToUnit(0, GL_TEXTURE_2D, this->diffuseMap);
         // bind specular map
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, this->specularMap);
+        glState().bindTextureToUnit(1, GL_TEXTURE_2D, this->specularMap);
 
-        lightingShaderWithTexture.setMat4("model", model);
+        lightingShaderWithTexture.setModel(model);
 
-        glBindVertexArray(lightTexCubeVAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        mesh->draw(36);
+    }
+
+    // same, drawn later with every other copy of this cube; see instanceQueue.h
+    void drawCubeWithTexture(InstanceQueue& queue, const glm::mat4& model)
+    {
+        queue.add(*mesh, 36, materialID, this->diffuseMap, this->specularMap, model);
+    }
+
+    // same, with the normal matrix cached by the scene graph; see sceneGraph.h
+    void drawCubeWithTexture(InstanceQueue& queue, const glm::mat4& model, const glm::mat3& normalMatrix)
+    {
+        queue.add(*mesh, 36, materialID, this->diffuseMap, this->specularMap, model, normalMatrix);
     }
 
     void drawCubeWithMaterialisticProperty(Shader& lightingShader, glm::mat4 model = glm::mat4(1.0f))
     {
         lightingShader.use();
 
-        lightingShader.setVec3("material.ambient", this->ambient);
-        lightingShader.setVec3("material.diffuse", this->diffuse);
-        lightingShader.setVec3("material.specular", this->specular);
-        lightingShader.setFloat("material.shininess", this->shininess);
+        lightingShader.setMaterial(materialID);
 
-        lightingShader.setMat4("model", model);
+        lightingShader.setModel(model);
 
-        glBindVertexArray(lightCubeVAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        mesh->draw(36);
     }
 
     void drawCube(Shader& shader, glm::mat4 model = glm::mat4(1.0f), float r = 1.0f, float g = 1.0f, float b = 1.0f)
@@ -119,8 +124,7 @@ public:
         shader.setVec3("color", glm::vec3(r, g, b));
         shader.setMat4("model", model);
 
-        glBindVertexArray(cubeVAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        mesh->draw(36);
     }
 
     void setMaterialisticProperty(glm::vec3 amb, glm::vec3 diff, glm::vec3 spec, float shiny)
@@ -129,6 +133,7 @@ public:
         this->diffuse = diff;
         this->specular = spec;
         this->shininess = shiny;
+        updateMaterialID();
     }
 
     void setTextureProperty(unsigned int dMap, unsigned int sMap, float shiny)
@@ -136,16 +141,30 @@ public:
         this->diffuseMap = dMap;
         this->specularMap = sMap;
         this->shininess = shiny;
+        updateMaterialID();
+    }
+
+    // call after changing the material fields directly
+    void updateMaterialID()
+    {
+        materialID = registerMaterial(ambient, diffuse, specular, shininess, diffuseMap, specularMap);
     }
 
+    // a cube looks the same at every level of detail, see levelOfDetail.h
+    const Mesh& getMesh(int /*level*/ = 0) const { return *mesh; }
+
 private:
-    unsigned int cubeVAO;
-    unsigned int lightCubeVAO;
-    unsigned int lightTexCubeVAO;
-    unsigned int cubeVBO;
-    unsigned int cubeEBO;
+    // shared with every Cube that has the same texture coordinates
+    MeshHandle mesh;
 
     void setUpCubeVertexDataAndConfigureVertexAttribute()
+    {
+        // the texture coordinates are baked into the vertices, so they are part of the key
+        mesh = meshRegistry().acquire(MeshKey("cube") << TXmin << TYmin << TXmax << TYmax,
+            [this](Mesh& cubeMesh) { buildCubeMesh(cubeMesh); });
+    }
+
+    void buildCubeMesh(Mesh& cubeMesh)
     {
         // set up vertex data (and buffer(s)) and configure vertex attributes
         // ------------------------------------------------------------------
@@ -223,53 +242,7 @@ private:
         };
 
 
-        glGenVertexArrays(1, &cubeVAO);
-        glGenVertexArrays(1, &lightCubeVAO);
-        glGenVertexArrays(1, &lightTexCubeVAO);
-        glGenBuffers(1, &cubeVBO);
-        glGenBuffers(1, &cubeEBO);
-
-
-        glBindVertexArray(lightTexCubeVAO);
-
-        glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cube_indices), cube_indices, GL_STATIC_DRAW);
-
-        // position attribute
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
-
-        // vertex normal attribute
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)12);
-        glEnableVertexAttribArray(1);
-
-        // texture coordinate attribute
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)24);
-        glEnableVertexAttribArray(2);
-
-
-        glBindVertexArray(lightCubeVAO);
-
-        glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEBO);
-
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
-
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)12);
-        glEnableVertexAttribArray(1);
-
-
-        glBindVertexArray(cubeVAO);
-
-        glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEBO);
-
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
+        cubeMesh.setData(LAYOUT_POSITION_NORMAL_TEXCOORD, cube_vertices, 24, cube_indices, sizeof(cube_indices) / sizeof(unsigned int));
     }
 
 };
@@ -7,6 +7,12 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "shader.h"
+#include "glState.h"
+#include "materials.h"
+#include "meshRegistry.h"
+#include "instanceQueue.h"
+#include "proceduralPrimitives.h"
+#include "levelOfDetail.h"
 
 #define PI 3.1416
 
@@ -23,6 +29,10 @@ public:
     unsigned int diffuseMap;
     unsigned int specularMap;
 
+    // row of the material table, shared with every primitive that has the
+    // same values; see materials.h
+    unsigned int materialID = DEFAULT_MATERIAL;
+
     CylinderWithTexture(float baseRadius = 1.0f, float topRadius = 1.0f, float height = 2.0f,
         int sectorCount = 20, int stackCount = 1,
         glm::vec3 amb = glm::vec3(0.2f, 0.2f, 0.2f),
@@ -31,46 +41,54 @@ public:
         unsigned int diffuseTexture = 0, unsigned int specularTexture = 0)
         : verticesStride(32), diffuseMap(diffuseTexture), specularMap(specularTexture) {
         set(baseRadius, topRadius, height, sectorCount, stackCount, amb, diff, spec, shiny);
-        buildCoordinatesAndIndices();
-        buildVertices();
-        setupVAO();
-    }
-
-    ~CylinderWithTexture() {
-        glDeleteVertexArrays(1, &cylinderVAO);
+        materialID = registerMaterial(amb, diff, spec, shiny, diffuseMap, specularMap);
+        acquireLods();
     }
 
-    void drawCylinder(Shader& lightingShader, glm::mat4 model, glm::vec3 viewPos) const {
+    void drawCylinder(Shader& lightingShader, glm::mat4 model) const {
         lightingShader.use();
 
-        // Pass material properties
-        lightingShader.setVec3("material.ambient", ambient);
-        lightingShader.setVec3("material.diffuseColor", diffuse);
-        lightingShader.setVec3("material.specularColor", specular);
-        lightingShader.setFloat("material.shininess", shininess);
-
-        // Pass texture units
+        // Pass the material's row and the texture units
+        lightingShader.setMaterial(materialID);
         lightingShader.setInt("material.diffuse", 0);
         lightingShader.setInt("material.specular", 1);
 
         // Bind textures
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMap);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specularMap);
-
-        // Set transformation matrices
-        lightingShader.setMat4("model", model);
-        lightingShader.setVec3("viewPos", viewPos);
-
-        // Draw the cylinder
-        glBindVertexArray(cylinderVAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        glState().bindTextureToUnit(0, GL_TEXTURE_2D, diffuseMap);
+        glState().bindTextureToUnit(1, GL_TEXTURE_2D, specularMap);
+
+        // Set transformation matrix; view and projection come from the PerFrame block
+        lightingShader.setModel(model);
+
+        // Draw the cylinder at the level of detail its size on screen asks for
+        lods.select(model).draw();
+    }
+
+    // Queue the cylinder to be drawn with every other copy of it; see instanceQueue.h
+    void drawCylinder(InstanceQueue& queue, const glm::mat4& model) const {
+        queue.add(lods.select(model), -1, materialID, diffuseMap, specularMap, model);
+    }
+
+    // Same, with the normal matrix cached by the scene graph (see sceneGraph.h)
+    // for object id, which keeps its level of detail between frames
+    void drawCylinder(InstanceQueue& queue, const glm::mat4& model, const glm::mat3& normalMatrix, unsigned int id = NO_DRAW_ID) const {
+        queue.add(lods.select(model, id), -1, materialID, diffuseMap, specularMap, model, normalMatrix);
+    }
+
+    // Queue the cylinder to be made in the vertex shader instead, with the
+    // sectors of the level of detail it would have drawn; see proceduralPrimitives.h
+    void drawCylinder(ProceduralQueue& queue, const glm::mat4& model) const {
+        int level = lods.selectLevel(model);
+        queue.add(ProceduralShape::frustum(baseRadius, topRadius, height, -height / 2, lodSectorCount(sectorCount, level, 3), stackCount),
+            materialID, diffuseMap, specularMap, model);
     }
 
+    const Mesh& getMesh(int level = 0) const { return lods.get(level); }
+
 private:
-    unsigned int cylinderVAO;
+    // shared with every cylinder of the same shape, one mesh per level of
+    // detail (see levelOfDetail.h); the textures are per object
+    LodChain lods;
     float baseRadius, topRadius, height;
     int sectorCount, stackCount;
     vector<float> vertices;
@@ -93,7 +111,27 @@ private:
         this->shininess = shiny;
     }
 
+    // the full mesh and LOD_COUNT - 1 coarser ones with half the sectors each
+    void acquireLods() {
+        int fullSectorCount = sectorCount;
+        for (int level = 0; level < LOD_COUNT; ++level) {
+            sectorCount = lodSectorCount(fullSectorCount, level, 3);
+            lods.meshes[level] = meshRegistry().acquire(MeshKey("cylinder") << this->baseRadius << this->topRadius << this->height << this->sectorCount << this->stackCount,
+                [this](Mesh& cylinderMesh) {
+                    buildCoordinatesAndIndices();
+                    buildVertices();
+                    setupVAO(cylinderMesh);
+                });
+        }
+        sectorCount = fullSectorCount;
+        lods.boundingRadius = glm::length(glm::vec2(max(baseRadius, topRadius), height / 2));
+    }
+
     void buildCoordinatesAndIndices() {
+        coordinates.clear();
+        normals.clear();
+        texCoords.clear();
+        indices.clear();
         float sectorStep = 2 * PI / sectorCount;
         float stackStep = height / stackCount;
         float sectorAngle;
@@ -216,34 +254,9 @@ private:
         }
     }
 
-    void setupVAO() {
-        glGenVertexArrays(1, &cylinderVAO);
-        glBindVertexArray(cylinderVAO);
-
-        // Create VBO
-        unsigned int cylinderVBO;
-        glGenBuffers(1, &cylinderVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, cylinderVBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
-
-        // Create EBO
-        unsigned int cylinderEBO;
-        glGenBuffers(1, &cylinderEBO);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cylinderEBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // Configure vertex attributes
-        int stride = verticesStride;
-        glEnableVertexAttribArray(0); // Position
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
-
-        glEnableVertexAttribArray(1); // Normal
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
-
-        glEnableVertexAttribArray(2); // Texture coordinates
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
-
-        glBindVertexArray(0);
+    void setupVAO(Mesh& cylinderMesh) {
+        // Copy into the geometry arena; the layout matches verticesStride
+        cylinderMesh.setData(LAYOUT_POSITION_NORMAL_TEXCOORD, vertices.data(), (GLsizei)vertices.size() / 8, indices.data(), (GLsizei)indices.size());
     }
 };
 
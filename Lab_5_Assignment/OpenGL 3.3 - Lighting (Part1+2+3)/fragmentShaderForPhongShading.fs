@@ -1,167 +1,59 @@
 #version 330 core
 out vec4 FragColor;
 
+// colours and shininess come from the Materials block; TEXTURED takes the
+// ambient, diffuse and specular colours from the texture maps instead, and
+// TEXTURE_ARRAY reads those maps from the layers the material names
+#if defined(TEXTURED) && defined(TEXTURE_ARRAY)
+uniform sampler2DArray diffuseArray;
+uniform sampler2DArray specularArray;
+#elif defined(TEXTURED)
 struct Material {
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-    float shininess;
+    sampler2D diffuse;
+    sampler2D specular;
 };
+uniform Material material;
+#endif
 
-
-struct DiectionalLight {
-    vec3 direction;
-    
-    float k_c;  // attenuation factors
-    float k_l;  // attenuation factors
-    float k_q;  // attenuation factors
-    
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-};
-
-struct PointLight {
-    vec3 position;
-    
-    float k_c;  // attenuation factors
-    float k_l;  // attenuation factors
-    float k_q;  // attenuation factors
-    
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct SpotLight {
-    vec3 position;
-    vec3 direction;
-
-    float cos_theta;
-    
-    float k_c;  // attenuation factors
-    float k_l;  // attenuation factors
-    float k_q;  // attenuation factors
-    
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-
-
-
-#define NR_POINT_LIGHTS 4
+#include "perFrame.glsl"
+#include "phongLighting.glsl"
+#include "materials.glsl"
 
 in vec3 FragPos;
 in vec3 Normal;
-
-uniform vec3 viewPos;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform Material material;
-uniform DiectionalLight diectionalLight;
-uniform bool dlighton = true;
-uniform bool spotlighton = true;
-uniform SpotLight spotlight; 
-
-
-// function prototypes
-vec3 CalcPointLight(Material material, PointLight light, vec3 N, vec3 fragPos, vec3 V);
-vec3 CalcDirectionalLight(Material material, DiectionalLight light, vec3 N, vec3 V);
-vec3 CalcSpotLight(Material material, SpotLight light, vec3 N, vec3 fragPos, vec3 V);
-
+#ifdef TEXTURED
+in vec2 TexCoords;
+#endif
+#ifdef INSTANCED
+flat in uint MaterialIndex;
+#endif
 
 void main()
 {
     // properties
     vec3 N = normalize(Normal);
     vec3 V = normalize(viewPos - FragPos);
-    
-    vec3 result;
-    // point lights
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(material, pointLights[i], N, FragPos, V);
-    if(dlighton)
-        result += CalcDirectionalLight(material, diectionalLight, N, V);
-    if(spotlighton)
-        result += CalcSpotLight(material, spotlight, N, FragPos, V);
-    FragColor = vec4(result, 1.0);
-}
-
-// calculates the color when using a point light.
-vec3 CalcPointLight(Material material, PointLight light, vec3 N, vec3 fragPos, vec3 V)
-{
-    vec3 L = normalize(light.position - fragPos);
-    vec3 R = reflect(-L, N);
-    
-    vec3 K_A = material.ambient;
-    vec3 K_D = material.diffuse;
-    vec3 K_S = material.specular;
-    
-    // attenuation
-    float d = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.k_c + light.k_l * d + light.k_q * (d * d));
-    
-    vec3 ambient = K_A * light.ambient;
-    vec3 diffuse = K_D * max(dot(N, L), 0.0) * light.diffuse;
-    vec3 specular = K_S * pow(max(dot(V, R), 0.0), material.shininess) * light.specular;
-    
-    ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
-    
-    return (ambient + diffuse + specular);
-}
-
-vec3 CalcDirectionalLight(Material material, DiectionalLight light, vec3 N, vec3 V)
-{
-    vec3 L = normalize(-light.direction);
-    vec3 R = reflect(-L, N);
-    
-    vec3 K_A = material.ambient;
-    vec3 K_D = material.diffuse;
-    vec3 K_S = material.specular;
-      
-    
-    vec3 ambient = K_A * light.ambient;
-    vec3 diffuse = K_D * max(dot(N, L), 0.0) * light.diffuse;
-    vec3 specular = K_S * pow(max(dot(V, R), 0.0), material.shininess) * light.specular;
-    
-    
-    return (ambient + diffuse + specular);
-}
-vec3 CalcSpotLight(Material material, SpotLight light, vec3 N, vec3 fragPos, vec3 V)
-{
-    vec3 L = normalize(light.position - fragPos);
-    vec3 R = reflect(-L, N);
-    
-    vec3 K_A = material.ambient;
-    vec3 K_D = material.diffuse;
-    vec3 K_S = material.specular;
-    
-    // attenuation
-    float d = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.k_c + light.k_l * d + light.k_q * (d * d));
-    
-    vec3 ambient = K_A * light.ambient;
-    vec3 diffuse = K_D * max(dot(N, L), 0.0) * light.diffuse;
-    vec3 specular = K_S * pow(max(dot(V, R), 0.0), material.shininess) * light.specular;
 
-    float cos_alpha = dot(L, normalize(-light.direction));
-    float intensity;
-    if(cos_alpha<light.cos_theta)
-    {
-        intensity = 0.0;
-    }
-    else
-    {
-        intensity = cos_alpha;
-    }
-    
-    ambient *= attenuation * intensity;
-    diffuse *= attenuation * intensity;
-    specular *= attenuation * intensity;
-    
-    return (ambient + diffuse + specular);
+#ifdef INSTANCED
+    MaterialData m = materials[MaterialIndex];
+#else
+    MaterialData m = materials[materialIndex];
+#endif
+    Surface surface;
+#if defined(TEXTURED) && defined(TEXTURE_ARRAY)
+    surface.ambient = vec3(texture(diffuseArray, vec3(TexCoords, m.ambient.w)));
+    surface.diffuse = surface.ambient;
+    surface.specular = vec3(texture(specularArray, vec3(TexCoords, m.diffuse.w)));
+#elif defined(TEXTURED)
+    surface.ambient = vec3(texture(material.diffuse, TexCoords));
+    surface.diffuse = surface.ambient;
+    surface.specular = vec3(texture(material.specular, TexCoords));
+#else
+    surface.ambient = m.ambient.rgb;
+    surface.diffuse = m.diffuse.rgb;
+    surface.specular = m.specular.rgb;
+#endif
+    surface.shininess = m.specular.w;
+
+    FragColor = vec4(CalcLighting(surface, N, FragPos, V), 1.0);
 }
@@ -0,0 +1,369 @@
+//
+//  frustumCulling.h
+//  test
+//
+//  Skips the objects the camera can't see. Every object has a world-space
+//  bounding box (its mesh's box placed by its cached world matrix, see
+//  boundingBox.h and sceneGraph.h), kept as six float arrays so the test
+//  runs four or eight boxes at a time: a box is outside when its corner
+//  farthest along a plane's normal is still behind one of the six planes
+//  of projection * view. Which corner that is depends only on the signs of
+//  the plane, so each plane picks its min or max arrays once and the inner
+//  loop is multiplies, adds and a compare.
+//
+//  With the boxes following scene graph nodes, only the objects under a
+//  node that moved get a new box in a frame (see placeMoved()).
+//
+//  The kernel is AVX when the compiler targets it, SSE2 on any x86-64
+//  build, and plain C++ otherwise (or when useSimd is off).
+//
+
+#ifndef frustumCulling_h
+#define frustumCulling_h
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_CULLING_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRUSTUM_CULLING_SSE
+#endif
+
+#include "boundingBox.h"
+#include "sceneGraph.h"
+#include "renderStats.h"
+
+// the six planes of a view frustum, normals pointing inwards: a point p is
+// inside a plane when dot(plane.xyz, p) + plane.w >= 0
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // left, right, bottom, top, near and far from the rows of a
+    // projection * view matrix (Gribb and Hartmann)
+    static Frustum fromMatrix(const glm::mat4& viewProjection)
+    {
+        return fromMatrix(viewProjection, glm::vec2(-1.0f), glm::vec2(1.0f));
+    }
+
+    // the same through only the screen rectangle from low to high, in
+    // normalized device coordinates (a portal, see portalVisibility.h)
+    static Frustum fromMatrix(const glm::mat4& viewProjection, const glm::vec2& low, const glm::vec2& high)
+    {
+        glm::vec4 rows[4];
+        for (int row = 0; row < 4; ++row)
+            rows[row] = glm::vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row], viewProjection[3][row]);
+        Frustum frustum;
+        for (int axis = 0; axis < 2; ++axis)
+        {
+            frustum.planes[axis * 2] = rows[axis] - rows[3] * low[axis];
+            frustum.planes[axis * 2 + 1] = rows[3] * high[axis] - rows[axis];
+        }
+        frustum.planes[4] = rows[3] + rows[2];
+        frustum.planes[5] = rows[3] - rows[2];
+        for (glm::vec4& plane : frustum.planes)
+            plane /= glm::length(glm::vec3(plane));
+        return frustum;
+    }
+
+    // whether box is wholly behind one of the planes, the test cull() runs
+    bool excludes(const BoundingBox& box) const
+    {
+        for (const glm::vec4& plane : planes)
+        {
+            glm::vec3 farthest(plane.x >= 0.0f ? box.high.x : box.low.x, plane.y >= 0.0f ? box.high.y : box.low.y, plane.z >= 0.0f ? box.high.z : box.low.z);
+            if (glm::dot(glm::vec3(plane), farthest) + plane.w < 0.0f)
+                return true;
+        }
+        return false;
+    }
+
+    // whether box is wholly in front of all six planes
+    bool contains(const BoundingBox& box) const
+    {
+        for (const glm::vec4& plane : planes)
+        {
+            glm::vec3 nearest(plane.x >= 0.0f ? box.low.x : box.high.x, plane.y >= 0.0f ? box.low.y : box.high.y, plane.z >= 0.0f ? box.low.z : box.high.z);
+            if (glm::dot(glm::vec3(plane), nearest) + plane.w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
+
+class FrustumCuller {
+public:
+    // off: every object is visible
+    bool enabled = true;
+    // off: the scalar kernel, to compare against
+    bool useSimd = true;
+
+    FrustumCuller() = default;
+    FrustumCuller(const FrustumCuller&) = delete;
+    FrustumCuller& operator=(const FrustumCuller&) = delete;
+
+    // a new object whose mesh has the box local and which the scene graph
+    // node places, if any; returns its index. Its world box is a point at
+    // the origin until it is placed
+    unsigned int add(const BoundingBox& local, unsigned int node = NO_PARENT)
+    {
+        unsigned int object = (unsigned int)localBounds.size();
+        localBounds.push_back(local);
+        nodes.push_back(node);
+        // keep the arrays a whole number of eight-box blocks; the padding
+        // boxes are never looked at
+        size_t padded = (localBounds.size() + 7) / 8 * 8;
+        for (std::vector<float>& values : bounds)
+            values.resize(padded, 0.0f);
+        visible.resize(padded, 1);
+        return object;
+    }
+
+    // move the object's box to where world puts its mesh
+    void place(unsigned int object, const glm::mat4& world)
+    {
+        setWorldBounds(object, localBounds[object].transformed(world));
+    }
+
+    // place every object that has a node, whether the last scene.update()
+    // recomputed it or an earlier one did; for setting up
+    void placeAll(const SceneGraph& scene)
+    {
+        for (size_t object = 0; object < nodes.size(); ++object)
+            if (nodes[object] != NO_PARENT)
+                place((unsigned int)object, scene.world(nodes[object]));
+    }
+
+    // re-place the objects whose node the last scene.update() recomputed;
+    // a frame where nothing moved places nothing. Returns how many moved
+    unsigned int placeMoved(const SceneGraph& scene)
+    {
+        unsigned int moved = 0;
+        for (size_t object = 0; object < nodes.size(); ++object)
+            if (nodes[object] != NO_PARENT && scene.wasUpdated(nodes[object]))
+            {
+                place((unsigned int)object, scene.world(nodes[object]));
+                ++moved;
+            }
+        return moved;
+    }
+
+    BoundingBox worldBounds(unsigned int object) const
+    {
+        return BoundingBox(glm::vec3(bounds[0][object], bounds[1][object], bounds[2][object]),
+            glm::vec3(bounds[3][object], bounds[4][object], bounds[5][object]));
+    }
+
+    void setWorldBounds(unsigned int object, const BoundingBox& world)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            bounds[axis][object] = world.low[axis];
+            bounds[3 + axis][object] = world.high[axis];
+        }
+    }
+
+    // test every object against the frustum of viewProjection; the counts
+    // and the time it took go to renderStats()
+    void cull(const glm::mat4& viewProjection)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        size_t count = localBounds.size();
+        if (!enabled)
+            std::fill(visible.begin(), visible.end(), (unsigned char)1);
+        else
+            cull(Frustum::fromMatrix(viewProjection), 0, count);
+
+        unsigned int inside = 0;
+        for (size_t i = 0; i < count; ++i)
+            inside += visible[i];
+        renderStats().objectsVisible += inside;
+        renderStats().objectsCulled += (unsigned int)count - inside;
+        renderStats().cullSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // the same through a spatial index over the same world boxes, e.g. a
+    // BoundingVolumeHierarchy (see boundingVolumeHierarchy.h): only the
+    // objects in the subtrees it can't reject are looked at
+    template <class Index>
+    void cull(const glm::mat4& viewProjection, const Index& index)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        size_t count = localBounds.size();
+        unsigned int inside = 0;
+        if (!enabled)
+        {
+            std::fill(visible.begin(), visible.end(), (unsigned char)1);
+            inside = (unsigned int)count;
+        }
+        else
+        {
+            std::fill(visible.begin(), visible.end(), (unsigned char)0);
+            index.query(Frustum::fromMatrix(viewProjection), [&](unsigned int object) {
+                visible[object] = 1;
+                ++inside;
+                return true;
+            });
+        }
+        renderStats().objectsVisible += inside;
+        renderStats().objectsCulled += (unsigned int)count - inside;
+        renderStats().cullSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // the same test for objects [first, last) without touching the stats;
+    // first has to be a multiple of eight
+    void cull(const Frustum& frustum, size_t first, size_t last)
+    {
+        PlaneTest tests[6];
+        for (int p = 0; p < 6; ++p)
+            tests[p] = planeTest(frustum.planes[p]);
+#if defined(FRUSTUM_CULLING_AVX)
+        if (useSimd)
+            return cullAvx(tests, first, last);
+#elif defined(FRUSTUM_CULLING_SSE)
+        if (useSimd)
+            return cullSse(tests, first, last);
+#endif
+        cullScalar(tests, first, last);
+    }
+
+    bool isVisible(unsigned int object) const { return visible[object] != 0; }
+
+    // drop object from this frame's visible ones, for a later test that
+    // knows better (see portalVisibility.h)
+    void hide(unsigned int object) { visible[object] = 0; }
+
+    size_t size() const { return localBounds.size(); }
+
+    // the kernel cull() runs with the current settings
+    const char* kernelName() const
+    {
+#if defined(FRUSTUM_CULLING_AVX)
+        return useSimd ? "AVX" : "scalar";
+#elif defined(FRUSTUM_CULLING_SSE)
+        return useSimd ? "SSE2" : "scalar";
+#else
+        return "scalar";
+#endif
+    }
+
+    void clear()
+    {
+        localBounds.clear();
+        nodes.clear();
+        for (std::vector<float>& values : bounds)
+            values.clear();
+        visible.clear();
+    }
+
+private:
+    // one plane with, per axis, the array holding the box corner farthest
+    // along its normal
+    struct PlaneTest {
+        const float* corner[3];
+        float normal[3];
+        float distance;
+    };
+
+    std::vector<BoundingBox> localBounds;
+    std::vector<unsigned int> nodes;
+    // min x, y, z then max x, y, z of every world box
+    std::vector<float> bounds[6];
+    // one byte per object, 1 when it is at least partly inside
+    std::vector<unsigned char> visible;
+
+    PlaneTest planeTest(const glm::vec4& plane) const
+    {
+        PlaneTest test;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            test.corner[axis] = bounds[plane[axis] >= 0.0f ? 3 + axis : axis].data();
+            test.normal[axis] = plane[axis];
+        }
+        test.distance = plane.w;
+        return test;
+    }
+
+    void cullScalar(const PlaneTest* tests, size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; ++i)
+        {
+            unsigned char inside = 1;
+            for (int p = 0; p < 6; ++p)
+            {
+                const PlaneTest& test = tests[p];
+                float d = test.corner[0][i] * test.normal[0] + test.corner[1][i] * test.normal[1] + test.corner[2][i] * test.normal[2] + test.distance;
+                if (d < 0.0f)
+                {
+                    inside = 0;
+                    break;
+                }
+            }
+            visible[i] = inside;
+        }
+    }
+
+#if defined(FRUSTUM_CULLING_SSE)
+    void cullSse(const PlaneTest* tests, size_t first, size_t last)
+    {
+        __m128 normals[6][3], distances[6];
+        for (int p = 0; p < 6; ++p)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+                normals[p][axis] = _mm_set1_ps(tests[p].normal[axis]);
+            distances[p] = _mm_set1_ps(tests[p].distance);
+        }
+        const __m128 zero = _mm_setzero_ps();
+        for (size_t i = first; i < last; i += 4)
+        {
+            __m128 outside = zero;
+            for (int p = 0; p < 6; ++p)
+            {
+                __m128 d = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(tests[p].corner[0] + i), normals[p][0]), distances[p]);
+                d = _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(tests[p].corner[1] + i), normals[p][1]));
+                d = _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(tests[p].corner[2] + i), normals[p][2]));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(d, zero));
+            }
+            int mask = _mm_movemask_ps(outside);
+            for (int lane = 0; lane < 4; ++lane)
+                visible[i + lane] = (unsigned char)(((mask >> lane) & 1) ^ 1);
+        }
+    }
+#endif
+
+#if defined(FRUSTUM_CULLING_AVX)
+    void cullAvx(const PlaneTest* tests, size_t first, size_t last)
+    {
+        __m256 normals[6][3], distances[6];
+        for (int p = 0; p < 6; ++p)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+                normals[p][axis] = _mm256_set1_ps(tests[p].normal[axis]);
+            distances[p] = _mm256_set1_ps(tests[p].distance);
+        }
+        const __m256 zero = _mm256_setzero_ps();
+        for (size_t i = first; i < last; i += 8)
+        {
+            __m256 outside = zero;
+            for (int p = 0; p < 6; ++p)
+            {
+                __m256 d = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(tests[p].corner[0] + i), normals[p][0]), distances[p]);
+                d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_loadu_ps(tests[p].corner[1] + i), normals[p][1]));
+                d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_loadu_ps(tests[p].corner[2] + i), normals[p][2]));
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(d, zero, _CMP_LT_OQ));
+            }
+            int mask = _mm256_movemask_ps(outside);
+            for (int lane = 0; lane < 8; ++lane)
+                visible[i + lane] = (unsigned char)(((mask >> lane) & 1) ^ 1);
+        }
+    }
+#endif
+};
+
+#endif /* frustumCulling_h */
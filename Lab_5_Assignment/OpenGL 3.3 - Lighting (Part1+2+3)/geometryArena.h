@@ -0,0 +1,613 @@
+//
+//  geometryArena.h
+//  test
+//
+//  One big vertex buffer per vertex layout and one index buffer shared by
+//  all of them. Meshes are ranges inside those buffers and draw with
+//  glDrawElementsBaseVertex, so every primitive of a layout reads from the
+//  same VAO and a frame binds one VAO per layout instead of one per object.
+//
+//  Ranges come from a first-fit free list that merges neighbouring holes.
+//  When no hole is big enough the live ranges are packed to the front of a
+//  fresh buffer (twice the size if packing alone doesn't make room), so
+//  meshes can come and go while the program runs.
+//
+//  Each layout also has a second VAO that reads per-instance transforms
+//  from the instance buffer (see instanceQueue.h), for drawing many copies
+//  of a mesh with one glDrawElementsInstancedBaseVertex.
+//
+//  Vertices are packed into the arena's vertex format on the way in (see
+//  vertexPacking.h) and meshes with fewer than 65536 vertices get 16-bit
+//  indices; the index buffer holds both sizes side by side, each mesh
+//  drawing with its own index type.
+//
+
+#ifndef geometryArena_h
+#define geometryArena_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+#include "glState.h"
+#include "renderStats.h"
+#include "vertexPacking.h"
+
+// what the instanced VAOs read per instance: the model matrix at attribute
+// locations 3-6, the normal matrix at 7-9 and the material table row at 10,
+// as the INSTANCED variant of the Phong vertex shader expects
+struct InstanceData {
+    glm::mat4 model;
+    glm::mat3 normalMatrix;
+    unsigned int materialIndex;
+};
+
+static_assert(sizeof(InstanceData) == 26 * sizeof(float), "InstanceData must be tightly packed");
+
+// first-fit allocator over [0, capacity) in whatever unit the caller uses
+class RangeAllocator {
+public:
+    void reset(GLuint newCapacity, GLuint used = 0)
+    {
+        capacity = newCapacity;
+        freeRanges.clear();
+        if (used < capacity)
+            freeRanges.push_back(Range{ used, capacity - used });
+    }
+
+    // false when no single hole is big enough
+    bool allocate(GLuint size, GLuint& offset)
+    {
+        for (size_t i = 0; i < freeRanges.size(); ++i)
+        {
+            Range& range = freeRanges[i];
+            if (range.size < size)
+                continue;
+            offset = range.offset;
+            range.offset += size;
+            range.size -= size;
+            if (range.size == 0)
+                freeRanges.erase(freeRanges.begin() + i);
+            return true;
+        }
+        return false;
+    }
+
+    // give a range back, merging it with the holes on either side
+    void free(GLuint offset, GLuint size)
+    {
+        auto next = std::lower_bound(freeRanges.begin(), freeRanges.end(), offset,
+            [](const Range& range, GLuint value) { return range.offset < value; });
+        size_t index = next - freeRanges.begin();
+        freeRanges.insert(next, Range{ offset, size });
+
+        if (index + 1 < freeRanges.size() && freeRanges[index].offset + freeRanges[index].size == freeRanges[index + 1].offset)
+        {
+            freeRanges[index].size += freeRanges[index + 1].size;
+            freeRanges.erase(freeRanges.begin() + index + 1);
+        }
+        if (index > 0 && freeRanges[index - 1].offset + freeRanges[index - 1].size == freeRanges[index].offset)
+        {
+            freeRanges[index - 1].size += freeRanges[index].size;
+            freeRanges.erase(freeRanges.begin() + index);
+        }
+    }
+
+    GLuint getCapacity() const { return capacity; }
+    GLuint getFreeTotal() const
+    {
+        GLuint total = 0;
+        for (const Range& range : freeRanges)
+            total += range.size;
+        return total;
+    }
+    size_t getHoleCount() const { return freeRanges.size(); }
+
+private:
+    struct Range {
+        GLuint offset;
+        GLuint size;
+    };
+    GLuint capacity = 0;
+    // sorted by offset, never two touching
+    std::vector<Range> freeRanges;
+};
+
+// where one mesh lives inside the arena
+struct GeometryRange {
+    VertexLayout layout = LAYOUT_POSITION_NORMAL_TEXCOORD;
+    GLuint firstVertex = 0;
+    GLsizei vertexCount = 0;
+    // in indexType units from the start of the index buffer
+    GLuint firstIndex = 0;
+    GLsizei indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    // the 2-byte slots of the index buffer the mesh was given; a 32-bit
+    // mesh gets one spare so its first index can be 4-byte aligned
+    GLuint indexSlot = 0;
+    GLuint indexSlots = 0;
+    // undoes the vertex format's position packing
+    PositionDecode decode;
+    bool live = false;
+};
+
+class GeometryArena {
+public:
+    // starting sizes, the index buffer's in 32-bit indices; a full buffer doubles
+    GLuint initialVertexCapacity = 32 * 1024;
+    GLuint initialIndexCapacity = 128 * 1024;
+    // how vertices and indices are stored; only read when the first mesh is added
+    VertexFormat vertexFormat = VERTEX_FORMAT_UNORM16;
+    bool shortIndices = true;
+
+    GeometryArena() = default;
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    // copy a mesh into the arena; indices are relative to the mesh's own
+    // first vertex. Returns the id to draw and remove it with
+    unsigned int add(VertexLayout layout, const float* vertices, GLsizei vertexCount, const unsigned int* indices, GLsizei indexCount)
+    {
+        createBuffers();
+
+        GeometryRange range;
+        range.layout = layout;
+        range.vertexCount = vertexCount;
+        range.indexCount = indexCount;
+        // indices are relative to the mesh, so its own vertex count decides
+        range.indexType = shortIndices && vertexCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        range.indexSlots = indexSlotsFor(range.indexType, indexCount);
+        range.live = true;
+
+        LayoutBuffer& vertexBuffer = layoutBuffers[layout];
+        if (!vertexBuffer.allocator.allocate((GLuint)vertexCount, range.firstVertex))
+        {
+            repackVertices(layout, (GLuint)vertexCount);
+            vertexBuffer.allocator.allocate((GLuint)vertexCount, range.firstVertex);
+        }
+        if (!indexAllocator.allocate(range.indexSlots, range.indexSlot))
+        {
+            repackIndices(range.indexSlots);
+            indexAllocator.allocate(range.indexSlots, range.indexSlot);
+        }
+        range.firstIndex = alignedFirstIndex(range.indexType, range.indexSlot);
+
+        range.decode = positionDecodeFor(layout, vertexBuffer.format, vertices, vertexCount);
+        packVertices(layout, vertexBuffer.format, range.decode, vertices, vertexCount, packedVertices);
+        GLsizei stride = vertexStride(layout, vertexBuffer.format);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer.buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)range.firstVertex * stride, (GLsizeiptr)packedVertices.size(), packedVertices.data());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+        GLintptr indexOffset = (GLintptr)range.firstIndex * indexSize(range.indexType);
+        if (range.indexType == GL_UNSIGNED_SHORT)
+        {
+            shortIndexStaging.assign(indices, indices + indexCount);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset, (GLsizeiptr)indexCount * sizeof(unsigned short), shortIndexStaging.data());
+        }
+        else
+            glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset, (GLsizeiptr)indexCount * sizeof(unsigned int), indices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        unsigned int id;
+        if (!freeIDs.empty())
+        {
+            id = freeIDs.back();
+            freeIDs.pop_back();
+            ranges[id] = range;
+        }
+        else
+        {
+            id = (unsigned int)ranges.size();
+            ranges.push_back(range);
+        }
+        return id;
+    }
+
+    void remove(unsigned int id)
+    {
+        // release() may have dropped everything already
+        if (id >= ranges.size())
+            return;
+        GeometryRange& range = ranges[id];
+        if (!range.live)
+            return;
+        layoutBuffers[range.layout].allocator.free(range.firstVertex, (GLuint)range.vertexCount);
+        indexAllocator.free(range.indexSlot, range.indexSlots);
+        range.live = false;
+        freeIDs.push_back(id);
+    }
+
+    const GeometryRange& get(unsigned int id) const { return ranges[id]; }
+
+    // copy a mesh back from the GPU as floats and 32-bit indices, e.g. to
+    // merge it with others; slow, meant for load time only
+    void read(unsigned int id, std::vector<float>& vertices, std::vector<unsigned int>& indices) const
+    {
+        const GeometryRange& range = ranges[id];
+        const LayoutBuffer& source = layoutBuffers[range.layout];
+        GLsizei stride = vertexStride(range.layout, source.format);
+        std::vector<unsigned char> packed((size_t)range.vertexCount * stride);
+        std::vector<unsigned short> shortIndices(range.indexType == GL_UNSIGNED_SHORT ? (size_t)range.indexCount : 0);
+        indices.resize((size_t)range.indexCount);
+
+        glBindBuffer(GL_COPY_READ_BUFFER, source.buffer);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, (GLintptr)range.firstVertex * stride, (GLsizeiptr)packed.size(), packed.data());
+        glBindBuffer(GL_COPY_READ_BUFFER, indexBuffer);
+        GLintptr indexOffset = (GLintptr)range.firstIndex * indexSize(range.indexType);
+        if (range.indexType == GL_UNSIGNED_SHORT)
+            glGetBufferSubData(GL_COPY_READ_BUFFER, indexOffset, (GLsizeiptr)range.indexCount * sizeof(unsigned short), shortIndices.data());
+        else
+            glGetBufferSubData(GL_COPY_READ_BUFFER, indexOffset, (GLsizeiptr)range.indexCount * sizeof(unsigned int), indices.data());
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+        unpackVertices(range.layout, source.format, range.decode, packed.data(), range.vertexCount, vertices);
+        if (range.indexType == GL_UNSIGNED_SHORT)
+            std::copy(shortIndices.begin(), shortIndices.end(), indices.begin());
+    }
+
+    // bind the layout's VAO (skipped when it is bound already) and draw the
+    // first count indices of the mesh, or all of them when count is negative
+    void draw(unsigned int id, GLsizei count = -1)
+    {
+        const GeometryRange& range = ranges[id];
+        glState().bindVertexArray(layoutBuffers[range.layout].vertexArray);
+        setPositionDecode(range);
+        GLsizei indices = count < 0 ? range.indexCount : std::min(count, range.indexCount);
+        glDrawElementsBaseVertex(GL_TRIANGLES, indices, range.indexType,
+            (void*)((size_t)range.firstIndex * indexSize(range.indexType)), (GLint)range.firstVertex);
+        renderStats().drawCalls++;
+        countFetch(range, indices, 1);
+    }
+
+    // buffer of InstanceData the instanced VAOs read from; owned by the caller
+    void setInstanceBuffer(GLuint buffer)
+    {
+        createBuffers();
+        instanceBuffer = buffer;
+        for (int layout = 0; layout < VERTEX_LAYOUT_COUNT; ++layout)
+            describeVertices((VertexLayout)layout);
+    }
+
+    // draw instanceCount copies of count indices of the mesh starting at its
+    // index first (the rest of it when count is negative), one copy per
+    // InstanceData starting at byte offset instanceOffset of the instance
+    // buffer. GL 3.3 has no base instance, so a new offset re-points the
+    // instance attributes
+    void drawInstanced(unsigned int id, GLsizei first, GLsizei count, GLsizei instanceCount, GLintptr instanceOffset)
+    {
+        const GeometryRange& range = ranges[id];
+        LayoutBuffer& target = layoutBuffers[range.layout];
+        glState().bindVertexArray(target.instancedVertexArray);
+        if (target.instanceOffset != instanceOffset)
+            pointInstanceAttributes(target, instanceOffset);
+        setPositionDecode(range);
+        GLsizei available = range.indexCount - first;
+        GLsizei indices = count < 0 ? available : std::min(count, available);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, indices, range.indexType,
+            (void*)(((size_t)range.firstIndex + first) * indexSize(range.indexType)), instanceCount, (GLint)range.firstVertex);
+        renderStats().drawCalls++;
+        renderStats().instancesDrawn += (unsigned int)instanceCount;
+        countFetch(range, indices, instanceCount);
+    }
+
+    // pack every buffer so all free space is one hole at the end; the
+    // arena does this by itself when an add doesn't fit anywhere
+    void compact()
+    {
+        if (indexBuffer == 0)
+            return;
+        for (int layout = 0; layout < VERTEX_LAYOUT_COUNT; ++layout)
+            repackVertices((VertexLayout)layout, 0);
+        repackIndices(0);
+    }
+
+    // buffer usage, then what every live mesh takes next to what it would
+    // as floats and 32-bit indices
+    void printUsage() const
+    {
+        GLuint vertexBytes = 0, vertexFree = 0;
+        size_t holes = indexAllocator.getHoleCount();
+        for (int layout = 0; layout < VERTEX_LAYOUT_COUNT; ++layout)
+        {
+            const LayoutBuffer& target = layoutBuffers[layout];
+            GLsizei stride = vertexStride((VertexLayout)layout, target.format);
+            vertexBytes += target.allocator.getCapacity() * stride;
+            vertexFree += target.allocator.getFreeTotal() * stride;
+            holes += target.allocator.getHoleCount();
+        }
+        std::cout << "geometry arena: vertices " << (vertexBytes - vertexFree) / 1024 << " of " << vertexBytes / 1024 << " KB"
+            << ", indices " << (indexAllocator.getCapacity() - indexAllocator.getFreeTotal()) * 2 / 1024
+            << " of " << indexAllocator.getCapacity() * 2 / 1024 << " KB"
+            << ", free holes " << holes
+            << std::endl;
+
+        size_t packedTotal = 0, unpackedTotal = 0;
+        for (size_t id = 0; id < ranges.size(); ++id)
+        {
+            const GeometryRange& range = ranges[id];
+            if (!range.live)
+                continue;
+            size_t packed = meshBytes(range, false), unpacked = meshBytes(range, true);
+            std::cout << "  mesh " << id << ": " << range.vertexCount << " vertices x " << vertexStride(range.layout, layoutBuffers[range.layout].format)
+                << " B, " << range.indexCount << " indices x " << indexSize(range.indexType) << " B = " << packed
+                << " B (" << unpacked << " B unpacked)" << std::endl;
+            packedTotal += packed;
+            unpackedTotal += unpacked;
+        }
+        if (unpackedTotal > 0)
+            std::cout << "geometry arena: meshes take " << packedTotal / 1024 << " KB, " << unpackedTotal / 1024
+                << " KB unpacked (" << packedTotal * 100 / unpackedTotal << "%)" << std::endl;
+    }
+
+    // delete the buffers while the context is still alive
+    void release()
+    {
+        for (LayoutBuffer& layout : layoutBuffers)
+        {
+            if (layout.vertexArray != 0)
+                glState().deleteVertexArrays(1, &layout.vertexArray);
+            if (layout.instancedVertexArray != 0)
+                glState().deleteVertexArrays(1, &layout.instancedVertexArray);
+            if (layout.buffer != 0)
+                glDeleteBuffers(1, &layout.buffer);
+            layout = LayoutBuffer();
+        }
+        if (indexBuffer != 0)
+            glDeleteBuffers(1, &indexBuffer);
+        indexBuffer = 0;
+        instanceBuffer = 0;
+        decodeSet = false;
+        ranges.clear();
+        freeIDs.clear();
+    }
+
+private:
+    struct LayoutBuffer {
+        GLuint buffer = 0;
+        // vertexFormat when the buffer was created
+        VertexFormat format = VERTEX_FORMAT_FLOAT;
+        GLuint vertexArray = 0;
+        GLuint instancedVertexArray = 0;
+        // where the instanced VAO's instance attributes point right now
+        GLintptr instanceOffset = -1;
+        RangeAllocator allocator;
+    };
+
+    LayoutBuffer layoutBuffers[VERTEX_LAYOUT_COUNT];
+    GLuint indexBuffer = 0;
+    GLuint instanceBuffer = 0;
+    RangeAllocator indexAllocator;
+    std::vector<GeometryRange> ranges;
+    std::vector<unsigned int> freeIDs;
+    // the position decode the constant attributes hold right now
+    PositionDecode currentDecode;
+    bool decodeSet = false;
+    // reused by add()
+    std::vector<unsigned char> packedVertices;
+    std::vector<unsigned short> shortIndexStaging;
+
+    static GLuint indexSize(GLenum type)
+    {
+        return type == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+    }
+
+    static GLuint indexSlotsFor(GLenum type, GLsizei count)
+    {
+        return type == GL_UNSIGNED_SHORT ? (GLuint)count : (GLuint)count * 2 + 1;
+    }
+
+    // first index of a mesh whose slots start at slot
+    static GLuint alignedFirstIndex(GLenum type, GLuint slot)
+    {
+        return type == GL_UNSIGNED_SHORT ? slot : (slot + 1) / 2;
+    }
+
+    size_t meshBytes(const GeometryRange& range, bool unpacked) const
+    {
+        if (unpacked)
+            return (size_t)range.vertexCount * vertexStride(range.layout, VERTEX_FORMAT_FLOAT) + (size_t)range.indexCount * sizeof(unsigned int);
+        return (size_t)range.vertexCount * vertexStride(range.layout, layoutBuffers[range.layout].format)
+            + (size_t)range.indexCount * indexSize(range.indexType);
+    }
+
+    // the compact formats read the mesh's position decode from two constant
+    // attributes; those are context state in GL 3.3, not VAO state, so
+    // they only change when the mesh does
+    void setPositionDecode(const GeometryRange& range)
+    {
+        if (layoutBuffers[range.layout].format == VERTEX_FORMAT_FLOAT || (decodeSet && currentDecode == range.decode))
+            return;
+        glVertexAttrib3f(POSITION_SCALE_ATTRIBUTE, range.decode.scale.x, range.decode.scale.y, range.decode.scale.z);
+        glVertexAttrib3f(POSITION_BIAS_ATTRIBUTE, range.decode.bias.x, range.decode.bias.y, range.decode.bias.z);
+        currentDecode = range.decode;
+        decodeSet = true;
+    }
+
+    // triangles of a draw, and the vertex and index bytes it reads next to
+    // what it would read unpacked; bytes are counted per index, as if the
+    // post-transform cache missed every time, so they are an upper bound
+    // that moves like the real traffic
+    void countFetch(const GeometryRange& range, GLsizei indices, GLsizei instances) const
+    {
+        size_t reads = (size_t)indices * (size_t)instances;
+        renderStats().trianglesDrawn += (unsigned int)(reads / 3);
+        renderStats().vertexBytesFetched += (unsigned int)(reads * (vertexStride(range.layout, layoutBuffers[range.layout].format) + indexSize(range.indexType)));
+        renderStats().unpackedVertexBytesFetched += (unsigned int)(reads * (vertexStride(range.layout, VERTEX_FORMAT_FLOAT) + sizeof(unsigned int)));
+    }
+
+    static GLuint createBuffer(GLsizeiptr bytes)
+    {
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, bytes, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        renderStats().meshBuffersCreated++;
+        return buffer;
+    }
+
+    void createBuffers()
+    {
+        if (indexBuffer != 0)
+            return;
+        // the index allocator counts 2-byte slots
+        indexBuffer = createBuffer((GLsizeiptr)initialIndexCapacity * sizeof(unsigned int));
+        indexAllocator.reset(initialIndexCapacity * 2);
+        for (int layout = 0; layout < VERTEX_LAYOUT_COUNT; ++layout)
+        {
+            LayoutBuffer& target = layoutBuffers[layout];
+            target.format = vertexFormat;
+            target.buffer = createBuffer((GLsizeiptr)initialVertexCapacity * vertexStride((VertexLayout)layout, target.format));
+            target.allocator.reset(initialVertexCapacity);
+            glGenVertexArrays(1, &target.vertexArray);
+            glGenVertexArrays(1, &target.instancedVertexArray);
+            describeVertices((VertexLayout)layout);
+        }
+    }
+
+    // point the layout's VAOs at its current vertex buffer and the index
+    // buffer, and the instanced one at the instance buffer too
+    void describeVertices(VertexLayout layout)
+    {
+        LayoutBuffer& target = layoutBuffers[layout];
+        const GLuint vertexArrays[2] = { target.vertexArray, target.instancedVertexArray };
+        for (GLuint vertexArray : vertexArrays)
+        {
+            glState().bindVertexArray(vertexArray);
+            glBindBuffer(GL_ARRAY_BUFFER, target.buffer);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+            pointVertexAttributes(layout, target.format);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        if (instanceBuffer != 0)
+            pointInstanceAttributes(target, 0);
+    }
+
+    // expects the layout's instanced VAO to be bound
+    void pointInstanceAttributes(LayoutBuffer& target, GLintptr offset)
+    {
+        GLsizei stride = sizeof(InstanceData);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        // model matrix, one column per location
+        for (GLuint column = 0; column < 4; ++column)
+        {
+            glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, stride, (void*)(offset + column * 4 * sizeof(float)));
+            glEnableVertexAttribArray(3 + column);
+            glVertexAttribDivisor(3 + column, 1);
+        }
+        // normal matrix
+        for (GLuint column = 0; column < 3; ++column)
+        {
+            glVertexAttribPointer(7 + column, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset + (16 + column * 3) * sizeof(float)));
+            glEnableVertexAttribArray(7 + column);
+            glVertexAttribDivisor(7 + column, 1);
+        }
+        // material table row
+        glVertexAttribIPointer(10, 1, GL_UNSIGNED_INT, stride, (void*)(offset + 25 * sizeof(float)));
+        glEnableVertexAttribArray(10);
+        glVertexAttribDivisor(10, 1);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        target.instanceOffset = offset;
+    }
+
+    // live ranges of the given layout (or every live range for the index
+    // buffer), in buffer order
+    std::vector<GeometryRange*> liveRanges(bool byVertex, VertexLayout layout)
+    {
+        std::vector<GeometryRange*> live;
+        for (GeometryRange& range : ranges)
+        {
+            if (range.live && (!byVertex || range.layout == layout))
+                live.push_back(&range);
+        }
+        std::sort(live.begin(), live.end(), [byVertex](const GeometryRange* a, const GeometryRange* b) {
+            return byVertex ? a->firstVertex < b->firstVertex : a->indexSlot < b->indexSlot;
+        });
+        return live;
+    }
+
+    // new capacity that holds what is live plus extra, doubling when needed
+    static GLuint grownCapacity(GLuint capacity, GLuint used, GLuint extra)
+    {
+        while (used + extra > capacity)
+            capacity *= 2;
+        return capacity;
+    }
+
+    // copy the live vertex ranges of a layout to the front of a new buffer
+    // with room for extra more vertices; indices don't move, they are
+    // relative to each range's base vertex
+    void repackVertices(VertexLayout layout, GLuint extra)
+    {
+        LayoutBuffer& target = layoutBuffers[layout];
+        GLsizei stride = vertexStride(layout, target.format);
+        std::vector<GeometryRange*> live = liveRanges(true, layout);
+        GLuint used = target.allocator.getCapacity() - target.allocator.getFreeTotal();
+        GLuint capacity = grownCapacity(target.allocator.getCapacity(), used, extra);
+
+        GLuint packed = createBuffer((GLsizeiptr)capacity * stride);
+        glBindBuffer(GL_COPY_READ_BUFFER, target.buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, packed);
+        GLuint offset = 0;
+        for (GeometryRange* range : live)
+        {
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                (GLintptr)range->firstVertex * stride, (GLintptr)offset * stride, (GLsizeiptr)range->vertexCount * stride);
+            range->firstVertex = offset;
+            offset += (GLuint)range->vertexCount;
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        glDeleteBuffers(1, &target.buffer);
+        target.buffer = packed;
+        target.allocator.reset(capacity, offset);
+        describeVertices(layout);
+        renderStats().geometryRepacks++;
+    }
+
+    // same for the index buffer, which every layout's VAO points at; sizes
+    // are in 2-byte slots, and each mesh's indices are realigned for their
+    // type inside its new slots
+    void repackIndices(GLuint extra)
+    {
+        std::vector<GeometryRange*> live = liveRanges(false, LAYOUT_POSITION_NORMAL_TEXCOORD);
+        GLuint used = indexAllocator.getCapacity() - indexAllocator.getFreeTotal();
+        GLuint capacity = grownCapacity(indexAllocator.getCapacity(), used, extra);
+
+        GLuint packed = createBuffer((GLsizeiptr)capacity * 2);
+        glBindBuffer(GL_COPY_READ_BUFFER, indexBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, packed);
+        GLuint offset = 0;
+        for (GeometryRange* range : live)
+        {
+            GLuint size = indexSize(range->indexType);
+            GLuint firstIndex = alignedFirstIndex(range->indexType, offset);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                (GLintptr)range->firstIndex * size, (GLintptr)firstIndex * size, (GLsizeiptr)range->indexCount * size);
+            range->firstIndex = firstIndex;
+            range->indexSlot = offset;
+            offset += range->indexSlots;
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        glDeleteBuffers(1, &indexBuffer);
+        indexBuffer = packed;
+        indexAllocator.reset(capacity, offset);
+        for (int layout = 0; layout < VERTEX_LAYOUT_COUNT; ++layout)
+            describeVertices((VertexLayout)layout);
+        renderStats().geometryRepacks++;
+    }
+};
+
+inline GeometryArena& geometryArena()
+{
+    static GeometryArena arena;
+    return arena;
+}
+
+#endif /* geometryArena_h */
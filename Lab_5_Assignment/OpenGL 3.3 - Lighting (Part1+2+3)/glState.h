@@ -0,0 +1,206 @@
+//
+//  glState.h
+//  test
+//
+//  Shadow copy of the bits of GL state the draw code keeps setting: the
+//  program, the VAO, the active texture unit, the texture bound to each
+//  unit and a few enable bits. A call that wouldn't change anything is
+//  skipped. Everything that binds or deletes one of these objects has to go
+//  through here, otherwise the shadow copy goes stale.
+//
+
+#ifndef glState_h
+#define glState_h
+
+#include <glad/glad.h>
+
+#include "renderStats.h"
+
+class GLStateCache {
+public:
+    static const int MAX_TEXTURE_UNITS = 16;
+
+    void useProgram(GLuint program)
+    {
+        if (program == currentProgram)
+        {
+            skipped();
+            return;
+        }
+        glUseProgram(program);
+        currentProgram = program;
+        issued();
+    }
+
+    void bindVertexArray(GLuint vao)
+    {
+        if (vao == currentVertexArray)
+        {
+            skipped();
+            return;
+        }
+        glBindVertexArray(vao);
+        currentVertexArray = vao;
+        issued();
+    }
+
+    // unit is 0-based, i.e. GL_TEXTURE0 + unit
+    void activeTexture(GLuint unit)
+    {
+        if (unit == currentUnit)
+        {
+            skipped();
+            return;
+        }
+        glActiveTexture(GL_TEXTURE0 + unit);
+        currentUnit = unit;
+        issued();
+    }
+
+    // bind to the active unit
+    void bindTexture(GLenum target, GLuint texture)
+    {
+        GLuint* bound = boundTexture(currentUnit, target);
+        if (bound != nullptr && *bound == texture)
+        {
+            skipped();
+            return;
+        }
+        glBindTexture(target, texture);
+        if (bound != nullptr)
+            *bound = texture;
+        issued();
+    }
+
+    // bind to the given unit; touches the active unit only when the binding changes
+    void bindTextureToUnit(GLuint unit, GLenum target, GLuint texture)
+    {
+        GLuint* bound = boundTexture(unit, target);
+        if (bound != nullptr && *bound == texture)
+        {
+            skipped();
+            return;
+        }
+        activeTexture(unit);
+        bindTexture(target, texture);
+    }
+
+    void enable(GLenum capability) { setCapability(capability, true); }
+    void disable(GLenum capability) { setCapability(capability, false); }
+
+    // delete through the cache so a recycled name is never mistaken for a bound one
+    void deleteProgram(GLuint program)
+    {
+        if (program == currentProgram)
+            currentProgram = UNKNOWN;
+        glDeleteProgram(program);
+    }
+    void deleteVertexArrays(GLsizei count, const GLuint* vaos)
+    {
+        for (GLsizei i = 0; i < count; ++i)
+        {
+            if (vaos[i] == currentVertexArray)
+                currentVertexArray = UNKNOWN;
+        }
+        glDeleteVertexArrays(count, vaos);
+    }
+    void deleteTextures(GLsizei count, const GLuint* textures)
+    {
+        for (GLsizei i = 0; i < count; ++i)
+        {
+            for (TextureUnit& unit : units)
+            {
+                if (unit.texture2D == textures[i])
+                    unit.texture2D = UNKNOWN;
+                if (unit.texture2DArray == textures[i])
+                    unit.texture2DArray = UNKNOWN;
+            }
+        }
+        glDeleteTextures(count, textures);
+    }
+
+    // forget everything, e.g. after code that talks to GL directly
+    void invalidate()
+    {
+        currentProgram = UNKNOWN;
+        currentVertexArray = UNKNOWN;
+        currentUnit = UNKNOWN;
+        for (TextureUnit& unit : units)
+            unit = TextureUnit();
+        for (Capability& capability : capabilities)
+            capability.state = UNKNOWN_STATE;
+    }
+
+    GLuint getProgram() const { return currentProgram; }
+    GLuint getVertexArray() const { return currentVertexArray; }
+
+private:
+    // no GL name is ~0, so the first call for anything always goes through
+    static const GLuint UNKNOWN = ~0u;
+    static const int UNKNOWN_STATE = -1;
+
+    struct TextureUnit {
+        GLuint texture2D = UNKNOWN;
+        GLuint texture2DArray = UNKNOWN;
+    };
+    struct Capability {
+        GLenum capability;
+        int state;
+    };
+
+    GLuint currentProgram = UNKNOWN;
+    GLuint currentVertexArray = UNKNOWN;
+    GLuint currentUnit = UNKNOWN;
+    TextureUnit units[MAX_TEXTURE_UNITS];
+    Capability capabilities[5] = {
+        { GL_DEPTH_TEST, UNKNOWN_STATE },
+        { GL_CULL_FACE, UNKNOWN_STATE },
+        { GL_BLEND, UNKNOWN_STATE },
+        { GL_SCISSOR_TEST, UNKNOWN_STATE },
+        { GL_STENCIL_TEST, UNKNOWN_STATE }
+    };
+
+    // targets and units that aren't tracked return nullptr and are always issued
+    GLuint* boundTexture(GLuint unit, GLenum target)
+    {
+        if (unit >= (GLuint)MAX_TEXTURE_UNITS)
+            return nullptr;
+        if (target == GL_TEXTURE_2D)
+            return &units[unit].texture2D;
+        if (target == GL_TEXTURE_2D_ARRAY)
+            return &units[unit].texture2DArray;
+        return nullptr;
+    }
+
+    void setCapability(GLenum capability, bool on)
+    {
+        for (Capability& tracked : capabilities)
+        {
+            if (tracked.capability != capability)
+                continue;
+            if (tracked.state == (on ? 1 : 0))
+            {
+                skipped();
+                return;
+            }
+            tracked.state = on ? 1 : 0;
+            break;
+        }
+        if (on)
+            glEnable(capability);
+        else
+            glDisable(capability);
+        issued();
+    }
+
+    static void issued() { renderStats().glStateCallsIssued++; }
+    static void skipped() { renderStats().glStateCallsSkipped++; }
+};
+
+inline GLStateCache& glState()
+{
+    static GLStateCache cache;
+    return cache;
+}
+
+#endif /* glState_h */
@@ -7,6 +7,11 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "shader.h"
+#include "glState.h"
+#include "materials.h"
+#include "meshRegistry.h"
+#include "instanceQueue.h"
+#include "proceduralPrimitives.h"
 
 using namespace std;
 
@@ -14,20 +19,24 @@ class Hexagon {
 public:
 
     // materialistic property
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
+    glm::vec3 ambient = glm::vec3(0.0f);
+    glm::vec3 diffuse = glm::vec3(0.0f);
+    glm::vec3 specular = glm::vec3(0.0f);
 
     // texture property
     float TXmin = 0.0f;
     float TXmax = 1.0f;
     float TYmin = 0.0f;
     float TYmax = 1.0f;
-    unsigned int diffuseMap;
-    unsigned int specularMap;
+    unsigned int diffuseMap = 0;
+    unsigned int specularMap = 0;
 
     // common property
-    float shininess;
+    float shininess = 0.0f;
+
+    // row of the material table, shared with every primitive that has the
+    // same values; see materials.h
+    unsigned int materialID = DEFAULT_MATERIAL;
 
     // constructors
     Hexagon()
@@ -41,6 +50,7 @@ public:
         this->diffuse = diff;
         this->specular = spec;
         this->shininess = shiny;
+        updateMaterialID();
 
         setUpHexagonVertexDataAndConfigureVertexAttribute();
     }
@@ -54,54 +64,56 @@ public:
         this->TYmin = textureYmin;
         this->TXmax = textureXmax;
         this->TYmax = textureYmax;
+        updateMaterialID();
 
         setUpHexagonVertexDataAndConfigureVertexAttribute();
     }
 
-    // destructor
-    ~Hexagon()
-    {
-        glDeleteVertexArrays(1, &hexagonVAO);
-        glDeleteVertexArrays(1, &lightHexagonVAO);
-        glDeleteVertexArrays(1, &lightTexHexagonVAO);
-        glDeleteBuffers(1, &hexagonVBO);
-        glDeleteBuffers(1, &hexagonEBO);
-    }
-
     void drawHexagonWithTexture(Shader& lightingShaderWithTexture, glm::mat4 model = glm::mat4(1.0f))
     {
         lightingShaderWithTexture.use();
 
+        lightingShaderWithTexture.setMaterial(materialID);
         lightingShaderWithTexture.setInt("material.diffuse", 0);
         lightingShaderWithTexture.setInt("material.specular", 1);
-        lightingShaderWithTexture.setFloat("material.shininess", this->shininess);
 
         // bind diffuse map
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, this->diffuseMap);
+        glState().bindTextureToUnit(0, GL_TEXTURE_2D, this->diffuseMap);
         // bind specular map
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, this->specularMap);
+        glState().bindTextureToUnit(1, GL_TEXTURE_2D, this->specularMap);
 
-        lightingShaderWithTexture.setMat4("model", model);
+        lightingShaderWithTexture.setModel(model);
 
-        glBindVertexArray(lightTexHexagonVAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        mesh->draw();
+    }
+
+    // same, drawn later with every other copy of this hexagon; see instanceQueue.h
+    void drawHexagonWithTexture(InstanceQueue& queue, const glm::mat4& model)
+    {
+        queue.add(*mesh, -1, materialID, this->diffuseMap, this->specularMap, model);
+    }
+
+    // same, with the normal matrix cached by the scene graph; see sceneGraph.h
+    void drawHexagonWithTexture(InstanceQueue& queue, const glm::mat4& model, const glm::mat3& normalMatrix)
+    {
+        queue.add(*mesh, -1, materialID, this->diffuseMap, this->specularMap, model, normalMatrix);
+    }
+
+    // same, made in the vertex shader; see proceduralPrimitives.h
+    void drawHexagonWithTexture(ProceduralQueue& queue, const glm::mat4& model)
+    {
+        queue.add(ProceduralShape::polygon(1.0f, 6).textureRect(TXmin, TYmin, TXmax, TYmax), materialID, this->diffuseMap, this->specularMap, model);
     }
 
     void drawHexagonWithMaterialisticProperty(Shader& lightingShader, glm::mat4 model = glm::mat4(1.0f))
     {
         lightingShader.use();
 
-        lightingShader.setVec3("material.ambient", this->ambient);
-        lightingShader.setVec3("material.diffuse", this->diffuse);
-        lightingShader.setVec3("material.specular", this->specular);
-        lightingShader.setFloat("material.shininess", this->shininess);
+        lightingShader.setMaterial(materialID);
 
-        lightingShader.setMat4("model", model);
+        lightingShader.setModel(model);
 
-        glBindVertexArray(lightHexagonVAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        mesh->draw();
     }
 
     void drawHexagon(Shader& shader, glm::mat4 model = glm::mat4(1.0f), float r = 1.0f, float g = 1.0f, float b = 1.0f)
@@ -111,16 +123,19 @@ public:
         shader.setVec3("color", glm::vec3(r, g, b));
         shader.setMat4("model", model);
 
-        glBindVertexArray(hexagonVAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        mesh->draw();
     }
 
+    // a hexagon has no coarser levels of detail, see levelOfDetail.h
+    const Mesh& getMesh(int /*level*/ = 0) const { return *mesh; }
+
     void setMaterialisticProperty(glm::vec3 amb, glm::vec3 diff, glm::vec3 spec, float shiny)
     {
         this->ambient = amb;
         this->diffuse = diff;
         this->specular = spec;
         this->shininess = shiny;
+        updateMaterialID();
     }
 
     void setTextureProperty(unsigned int dMap, unsigned int sMap, float shiny)
@@ -128,16 +143,27 @@ public:
         this->diffuseMap = dMap;
         this->specularMap = sMap;
         this->shininess = shiny;
+        updateMaterialID();
+    }
+
+    // call after changing the material fields directly
+    void updateMaterialID()
+    {
+        materialID = registerMaterial(ambient, diffuse, specular, shininess, diffuseMap, specularMap);
     }
 
 private:
-    unsigned int hexagonVAO;
-    unsigned int lightHexagonVAO;
-    unsigned int lightTexHexagonVAO;
-    unsigned int hexagonVBO;
-    unsigned int hexagonEBO;
+    // shared with every Hexagon that has the same texture coordinates
+    MeshHandle mesh;
 
     void setUpHexagonVertexDataAndConfigureVertexAttribute()
+    {
+        // the texture coordinates are baked into the vertices, so they are part of the key
+        mesh = meshRegistry().acquire(MeshKey("hexagon") << TXmin << TYmin << TXmax << TYmax,
+            [this](Mesh& hexagonMesh) { buildHexagonMesh(hexagonMesh); });
+    }
+
+    void buildHexagonMesh(Mesh& hexagonMesh)
     {
         // Hexagon vertex data and buffer setup
         const float Pi = 3.14159265359f;
@@ -162,50 +188,7 @@ private:
             }
         }
 
-        glGenVertexArrays(1, &hexagonVAO);
-        glGenVertexArrays(1, &lightHexagonVAO);
-        glGenVertexArrays(1, &lightTexHexagonVAO);
-        glGenBuffers(1, &hexagonVBO);
-        glGenBuffers(1, &hexagonEBO);
-
-        glBindVertexArray(lightTexHexagonVAO);
-
-        glBindBuffer(GL_ARRAY_BUFFER, hexagonVBO);
-        glBufferData(GL_ARRAY_BUFFER, hexagon_vertices.size() * sizeof(float), hexagon_vertices.data(), GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, hexagonEBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, hexagon_indices.size() * sizeof(unsigned int), hexagon_indices.data(), GL_STATIC_DRAW);
-
-        // position attribute
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
-
-        // vertex normal attribute
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(1);
-
-        // texture coordinate attribute
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-        glEnableVertexAttribArray(2);
-
-        glBindVertexArray(lightHexagonVAO);
-
-        glBindBuffer(GL_ARRAY_BUFFER, hexagonVBO);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, hexagonEBO);
-
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
-
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(1);
-
-        glBindVertexArray(hexagonVAO);
-
-        glBindBuffer(GL_ARRAY_BUFFER, hexagonVBO);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, hexagonEBO);
-
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
+        hexagonMesh.setData(LAYOUT_POSITION_NORMAL_TEXCOORD, hexagon_vertices.data(), (GLsizei)hexagon_vertices.size() / 8, hexagon_indices.data(), (GLsizei)hexagon_indices.size());
     }
 };
 
@@ -0,0 +1,218 @@
+//
+//  instanceQueue.h
+//  test
+//
+//  Collects the textured draws of a frame and issues them instanced: every
+//  draw of the same mesh with the same textures goes into one batch, and a
+//  batch is a single glDrawElementsInstancedBaseVertex whose model and
+//  normal matrices and material row stream from the instance buffer.
+//  Sixteen chairs of twelve parts each become two draws, one for the legs
+//  and one for the wooden parts, and adding chairs only adds instances.
+//  With texture arrays (see textureArrays.h) the textures of a batch are
+//  the arrays, so meshes that only differ by their maps share a draw.
+//
+//  Batches live across frames and only their instance lists are cleared,
+//  so once the scene has been seen the queue doesn't allocate.
+//
+
+#ifndef instanceQueue_h
+#define instanceQueue_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "shader.h"
+#include "glState.h"
+#include "meshRegistry.h"
+#include "geometryArena.h"
+#include "textureArrays.h"
+
+class InstanceQueue {
+public:
+    InstanceQueue() = default;
+    InstanceQueue(const InstanceQueue&) = delete;
+    InstanceQueue& operator=(const InstanceQueue&) = delete;
+
+    // what a batch has in common
+    struct BatchKey {
+        unsigned int geometry;
+        // index range of the mesh to draw; count is negative for the rest of it
+        GLsizei first;
+        GLsizei count;
+        // GL_TEXTURE_2D, or GL_TEXTURE_2D_ARRAY when both maps are in arrays
+        GLenum textureTarget;
+        GLuint diffuseMap;
+        GLuint specularMap;
+
+        bool operator==(const BatchKey& other) const
+        {
+            return geometry == other.geometry && first == other.first && count == other.count && textureTarget == other.textureTarget
+                && diffuseMap == other.diffuseMap && specularMap == other.specularMap;
+        }
+    };
+
+    // the key for drawing a range of a mesh with these maps: their texture
+    // arrays when both were packed into one, the maps themselves otherwise
+    static BatchKey keyFor(unsigned int geometry, GLsizei first, GLsizei count, GLuint diffuseMap, GLuint specularMap)
+    {
+        BatchKey key = { geometry, first, count, GL_TEXTURE_2D, diffuseMap, specularMap };
+        GLuint diffuseArray, specularArray;
+        int layer;
+        if (textureArrays().find(diffuseMap, diffuseArray, layer) && textureArrays().find(specularMap, specularArray, layer))
+        {
+            key.textureTarget = GL_TEXTURE_2D_ARRAY;
+            key.diffuseMap = diffuseArray;
+            key.specularMap = specularArray;
+        }
+        return key;
+    }
+
+    // queue one copy of the first count indices of mesh (all of them when
+    // count is negative)
+    void add(const Mesh& mesh, GLsizei count, unsigned int materialID, GLuint diffuseMap, GLuint specularMap, const glm::mat4& model)
+    {
+        add(mesh, count, materialID, diffuseMap, specularMap, model, glm::mat3(glm::transpose(glm::inverse(model))));
+    }
+
+    // same, with the normal matrix already known (see sceneGraph.h)
+    void add(const Mesh& mesh, GLsizei count, unsigned int materialID, GLuint diffuseMap, GLuint specularMap,
+        const glm::mat4& model, const glm::mat3& normalMatrix)
+    {
+        InstanceData instance;
+        instance.model = model;
+        instance.normalMatrix = normalMatrix;
+        instance.materialIndex = materialID;
+        add(keyFor(mesh.geometry, 0, count, diffuseMap, specularMap), instance);
+    }
+
+    // queue an instance whose normal matrix is already known, e.g. one
+    // placement of a prefab that draws a range per material
+    void add(const BatchKey& key, const InstanceData& instance)
+    {
+        findBatch(key).instances.push_back(instance);
+    }
+
+    // draw everything queued since the last flush with shader, which has to
+    // be an INSTANCED variant (and a TEXTURE_ARRAY one once the arrays are
+    // built), and empty the queue
+    void flush(Shader& shader)
+    {
+        size_t total = 0;
+        for (const Batch& batch : batches)
+            total += batch.instances.size();
+        if (total == 0)
+            return;
+
+        reserve((GLsizeiptr)(total * sizeof(InstanceData)));
+
+        shader.use();
+        setTextureUnits(shader);
+
+        GLintptr offset = 0;
+        for (Batch& batch : batches)
+        {
+            if (batch.instances.empty())
+                continue;
+            GLsizeiptr bytes = (GLsizeiptr)(batch.instances.size() * sizeof(InstanceData));
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, batch.instances.data());
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            glState().bindTextureToUnit(0, batch.key.textureTarget, batch.key.diffuseMap);
+            glState().bindTextureToUnit(1, batch.key.textureTarget, batch.key.specularMap);
+            geometryArena().drawInstanced(batch.key.geometry, batch.key.first, batch.key.count, (GLsizei)batch.instances.size(), offset);
+
+            offset += bytes;
+            batch.instances.clear();
+        }
+    }
+
+    // drop everything queued without drawing it
+    void clear()
+    {
+        for (Batch& batch : batches)
+            batch.instances.clear();
+    }
+
+    // hand each non-empty batch to visitor(key, instances) without drawing
+    // it; lets load-time code reuse what the scene queued (see staticBatch.h)
+    template <typename Visitor>
+    void visit(Visitor visitor) const
+    {
+        for (const Batch& batch : batches)
+        {
+            if (!batch.instances.empty())
+                visitor(batch.key, batch.instances);
+        }
+    }
+
+    // delete the instance buffer while the context is still alive
+    void release()
+    {
+        if (buffer != 0)
+            glDeleteBuffers(1, &buffer);
+        buffer = 0;
+        capacity = 0;
+        batches.clear();
+    }
+
+    // point the textured Phong samplers at units 0 and 1, whichever of the
+    // 2D or array samplers the variant has
+    static void setTextureUnits(Shader& shader)
+    {
+        shader.setInt("material.diffuse", 0);
+        shader.setInt("material.specular", 1);
+        shader.setInt("diffuseArray", 0);
+        shader.setInt("specularArray", 1);
+    }
+
+private:
+    struct Batch {
+        BatchKey key;
+        std::vector<InstanceData> instances;
+    };
+
+    std::vector<Batch> batches;
+    // draws come in runs of the same part, so try the last batch first
+    size_t lastBatch = 0;
+    GLuint buffer = 0;
+    GLsizeiptr capacity = 0;
+
+    // a scene has a few dozen mesh and material pairs, a linear search will do
+    Batch& findBatch(const BatchKey& key)
+    {
+        if (lastBatch < batches.size() && batches[lastBatch].key == key)
+            return batches[lastBatch];
+        for (size_t i = 0; i < batches.size(); ++i)
+        {
+            if (batches[i].key == key)
+            {
+                lastBatch = i;
+                return batches[i];
+            }
+        }
+        batches.push_back(Batch{ key, std::vector<InstanceData>() });
+        lastBatch = batches.size() - 1;
+        return batches.back();
+    }
+
+    // orphan the instance buffer so this frame's writes don't wait for the
+    // draws of the last one, growing it when the frame has more instances
+    void reserve(GLsizeiptr bytes)
+    {
+        if (buffer == 0)
+        {
+            glGenBuffers(1, &buffer);
+            geometryArena().setInstanceBuffer(buffer);
+        }
+        while (capacity < bytes)
+            capacity = capacity == 0 ? 1024 * (GLsizeiptr)sizeof(InstanceData) : capacity * 2;
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+};
+
+#endif /* instanceQueue_h */
@@ -0,0 +1,167 @@
+//
+//  levelOfDetail.h
+//  test
+//
+//  Coarser copies of the parametric primitives for when they are small on
+//  screen. Cylinders, cones and spheres build a chain of LOD_COUNT meshes
+//  in the geometry arena, each with half the sectors of the one before
+//  (36, 18, 9, 4 for the room's cylinders), and every draw picks a level
+//  from the projected size of the object's bounding sphere. A level only
+//  changes once the size is clearly past the switch size, so an object
+//  sitting near a switch size doesn't flicker between two levels.
+//
+
+#ifndef levelOfDetail_h
+#define levelOfDetail_h
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#include "renderStats.h"
+#include "meshRegistry.h"
+
+const int LOD_COUNT = 4;
+
+// sectors (or stacks) of a parametric shape at a level: halved per level,
+// never fewer than minimum
+inline int lodSectorCount(int fullCount, int level, int minimum)
+{
+    return std::max(fullCount >> level, minimum);
+}
+
+class LevelOfDetail {
+public:
+    // off: every draw uses the full mesh
+    bool enabled = true;
+    // projected diameter of the bounding sphere, in pixels, under which
+    // level i + 1 takes over from level i
+    float switchSizes[LOD_COUNT - 1] = { 240.0f, 120.0f, 60.0f };
+    // how far past a switch size (as a fraction of it) the size has to get
+    // before a draw changes level
+    float hysteresis = 0.15f;
+
+    LevelOfDetail() = default;
+    LevelOfDetail(const LevelOfDetail&) = delete;
+    LevelOfDetail& operator=(const LevelOfDetail&) = delete;
+
+    // the camera the sizes are measured from; call once a frame. Until the
+    // first call every draw gets level 0, so what is merged at load time
+    // (static batch, prefabs) is built from the full meshes
+    void setView(const glm::vec3& eye, float fovY, float viewportHeight)
+    {
+        this->eye = eye;
+        pixelsPerUnit = viewportHeight / (2.0f * std::tan(fovY * 0.5f));
+        viewSet = true;
+    }
+
+    bool hasView() const { return enabled && viewSet; }
+
+    // diameter in pixels of a bounding sphere placed by model
+    float screenSize(const glm::mat4& model, const glm::vec3& centre, float radius) const
+    {
+        glm::vec3 position = glm::vec3(model * glm::vec4(centre, 1.0f));
+        float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        float worldRadius = radius * scale;
+        float distance = glm::length(position - eye);
+        if (distance <= worldRadius)
+            return FLT_MAX;
+        return 2.0f * worldRadius * pixelsPerUnit / distance;
+    }
+
+    // the level for an object of size pixels that had level current last
+    // frame (-1 when it wasn't drawn)
+    int select(int current, float size) const
+    {
+        int level = 0;
+        for (int boundary = 0; boundary < LOD_COUNT - 1; ++boundary)
+        {
+            float margin = current < 0 ? 1.0f : current <= boundary ? 1.0f - hysteresis : 1.0f + hysteresis;
+            if (size >= switchSizes[boundary] * margin)
+                break;
+            level = boundary + 1;
+        }
+        return level;
+    }
+
+private:
+    glm::vec3 eye = glm::vec3(0.0f);
+    float pixelsPerUnit = 0.0f;
+    bool viewSet = false;
+};
+
+inline LevelOfDetail& levelOfDetail()
+{
+    static LevelOfDetail lod;
+    return lod;
+}
+
+// a draw that isn't tied to an object, and gets no hysteresis
+const unsigned int NO_DRAW_ID = ~0u;
+
+// picks the level of each draw of one shape and remembers it for the next
+// frame's hysteresis. Draws are told apart by an id that stays with the
+// object, its FrustumCuller object in main(), so culling one object never
+// hands its level to another; an object that wasn't drawn last frame
+// starts afresh
+class LodSelector {
+public:
+    int select(unsigned int id, const glm::mat4& model, const glm::vec3& centre, float radius, int levels = LOD_COUNT) const
+    {
+        if (!levelOfDetail().hasView())
+            return 0;
+        unsigned long long frame = renderStats().getFrameCount();
+        int current = -1;
+        if (id != NO_DRAW_ID)
+        {
+            if (id >= lastLevels.size())
+                lastLevels.resize(id + 1);
+            const LastLevel& last = lastLevels[id];
+            if (last.level >= 0 && frame - last.frame <= 1)
+                current = last.level;
+        }
+
+        int level = levelOfDetail().select(current, levelOfDetail().screenSize(model, centre, radius));
+        level = std::min(level, levels - 1);
+        if (id != NO_DRAW_ID)
+            lastLevels[id] = LastLevel{ (signed char)level, frame };
+        renderStats().lodDraws[level]++;
+        return level;
+    }
+
+private:
+    struct LastLevel {
+        signed char level = -1;
+        unsigned long long frame = 0;
+    };
+
+    mutable std::vector<LastLevel> lastLevels;
+};
+
+// the meshes of one shape from fine to coarse, with the bounding sphere
+// the levels are chosen by
+struct LodChain {
+    MeshHandle meshes[LOD_COUNT];
+    glm::vec3 boundingCentre = glm::vec3(0.0f);
+    float boundingRadius = 0.0f;
+    LodSelector selector;
+
+    const Mesh& get(int level) const { return *meshes[level]; }
+
+    // the level for a draw of the shape placed by model, for object id
+    int selectLevel(const glm::mat4& model, unsigned int id = NO_DRAW_ID) const
+    {
+        return selector.select(id, model, boundingCentre, boundingRadius);
+    }
+
+    // the mesh for a draw of the shape placed by model, for object id
+    const Mesh& select(const glm::mat4& model, unsigned int id = NO_DRAW_ID) const
+    {
+        return *meshes[selectLevel(model, id)];
+    }
+};
+
+#endif /* levelOfDetail_h */
@@ -0,0 +1,203 @@
+//
+//  lightManager.h
+//  test
+//
+//  Owns every light of the scene and mirrors them into the Lights uniform
+//  block. The block is rewritten only when a light actually changed, so a
+//  frame without toggles or moving lights costs no light uploads at all.
+//
+
+#ifndef lightManager_h
+#define lightManager_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <cstddef>
+#include <iostream>
+
+#include "pointLight.h"
+#include "uniformBlocks.h"
+#include "renderStats.h"
+
+// capacity of the pointLights array in the Lights block; the shaders loop
+// over pointLightCount, so this only bounds how many lights can be added
+#define MAX_POINT_LIGHTS 128
+
+struct DirectionalLight {
+    glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    glm::vec3 ambient = glm::vec3(0.0f);
+    glm::vec3 diffuse = glm::vec3(0.0f);
+    glm::vec3 specular = glm::vec3(0.0f);
+    bool on = true;
+};
+
+struct SpotLight {
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    float cos_theta = 1.0f;
+    float k_c = 1.0f;
+    float k_l = 0.0f;
+    float k_q = 0.0f;
+    glm::vec3 ambient = glm::vec3(0.0f);
+    glm::vec3 diffuse = glm::vec3(0.0f);
+    glm::vec3 specular = glm::vec3(0.0f);
+    bool on = true;
+};
+
+// std140 mirrors of the structs in the Lights block; every vec3 shares its
+// 16 byte slot with the float that follows it
+struct PointLightData {
+    glm::vec3 position; float k_c;
+    glm::vec3 ambient;  float k_l;
+    glm::vec3 diffuse;  float k_q;
+    glm::vec3 specular; float padding;
+};
+
+struct DirectionalLightData {
+    glm::vec3 direction; float padding0;
+    glm::vec3 ambient;   float padding1;
+    glm::vec3 diffuse;   float padding2;
+    glm::vec3 specular;  float padding3;
+};
+
+struct SpotLightData {
+    glm::vec3 position;  float cos_theta;
+    glm::vec3 direction; float k_c;
+    glm::vec3 ambient;   float k_l;
+    glm::vec3 diffuse;   float k_q;
+    glm::vec3 specular;  float padding;
+};
+
+struct LightsBlockData {
+    DirectionalLightData directionalLight;
+    SpotLightData spotLight;
+    int pointLightCount;
+    int dlighton;
+    int spotlighton;
+    int padding;
+    PointLightData pointLights[MAX_POINT_LIGHTS];
+};
+
+static_assert(sizeof(PointLightData) == 64, "PointLightData must match std140");
+static_assert(sizeof(DirectionalLightData) == 64, "DirectionalLightData must match std140");
+static_assert(sizeof(SpotLightData) == 80, "SpotLightData must match std140");
+
+class LightManager {
+public:
+    DirectionalLight directionalLight;
+    SpotLight spotLight;
+
+    LightManager()
+    {
+        std::memset((void*)&staged, 0, sizeof(staged));
+        std::memset((void*)&uploaded, 0, sizeof(uploaded));
+    }
+
+    // returns the index of the new light, or -1 when the block is full
+    int addPointLight(const PointLight& light)
+    {
+        if (pointLights.size() >= MAX_POINT_LIGHTS)
+        {
+            std::cout << "WARNING::LIGHT_MANAGER::TOO_MANY_POINT_LIGHTS" << std::endl;
+            return -1;
+        }
+        pointLights.push_back(light);
+        return (int)pointLights.size() - 1;
+    }
+
+    PointLight& getPointLight(int index) { return pointLights[index]; }
+    std::vector<PointLight>& getPointLights() { return pointLights; }
+    int getPointLightCount() const { return (int)pointLights.size(); }
+    // lights that are not switched off; these are the ones the Lights block holds
+    int getActivePointLightCount() const
+    {
+        int count = 0;
+        for (const PointLight& light : pointLights)
+            count += light.isOn() ? 1 : 0;
+        return count;
+    }
+
+    // pack all lights and write the part of the block that differs from the
+    // last upload; call once a frame before drawing
+    void upload()
+    {
+        if (!buffer)
+        {
+            // created lazily so a LightManager can live before the GL context
+            buffer.reset(new UniformBuffer(LIGHTS_BLOCK_BINDING, sizeof(LightsBlockData)));
+            firstUpload = true;
+        }
+
+        pack();
+
+        size_t bytes = offsetof(LightsBlockData, pointLights) + staged.pointLightCount * sizeof(PointLightData);
+        if (!firstUpload && std::memcmp(&staged, &uploaded, bytes) == 0)
+            return;
+
+        buffer->update(0, bytes, &staged);
+        std::memcpy(&uploaded, &staged, bytes);
+        firstUpload = false;
+        renderStats().lightBufferUploads++;
+    }
+
+    // drop the buffer while the context is still alive; the manager is
+    // usually a global and would otherwise outlive glfwTerminate()
+    void releaseBuffer()
+    {
+        buffer.reset();
+    }
+
+private:
+    std::vector<PointLight> pointLights;
+    std::unique_ptr<UniformBuffer> buffer;
+    LightsBlockData staged;
+    LightsBlockData uploaded;
+    bool firstUpload = true;
+
+    void pack()
+    {
+        DirectionalLightData& d = staged.directionalLight;
+        d.direction = directionalLight.direction;
+        d.ambient = directionalLight.ambient;
+        d.diffuse = directionalLight.diffuse;
+        d.specular = directionalLight.specular;
+
+        SpotLightData& s = staged.spotLight;
+        s.position = spotLight.position;
+        s.direction = spotLight.direction;
+        s.cos_theta = spotLight.cos_theta;
+        s.k_c = spotLight.k_c;
+        s.k_l = spotLight.k_l;
+        s.k_q = spotLight.k_q;
+        s.ambient = spotLight.ambient;
+        s.diffuse = spotLight.diffuse;
+        s.specular = spotLight.specular;
+
+        staged.dlighton = directionalLight.on ? 1 : 0;
+        staged.spotlighton = spotLight.on ? 1 : 0;
+
+        // only lights that are on go into the block, packed to the front, so
+        // the shaders (and the specialised variants) never loop over dark lights
+        int count = 0;
+        for (const PointLight& light : pointLights)
+        {
+            if (!light.isOn())
+                continue;
+            PointLightData& p = staged.pointLights[count++];
+            p.position = light.position;
+            p.ambient = light.getAmbient();
+            p.diffuse = light.getDiffuse();
+            p.specular = light.getSpecular();
+            p.k_c = light.k_c;
+            p.k_l = light.k_l;
+            p.k_q = light.k_q;
+        }
+        staged.pointLightCount = count;
+    }
+};
+
+#endif /* lightManager_h */
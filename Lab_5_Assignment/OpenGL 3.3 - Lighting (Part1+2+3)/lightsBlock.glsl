@@ -0,0 +1,43 @@
+struct DiectionalLight {
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight {
+    vec3 position;
+    float k_c;  // attenuation factors
+    vec3 ambient;
+    float k_l;  // attenuation factors
+    vec3 diffuse;
+    float k_q;  // attenuation factors
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 position;
+    float cos_theta;
+    vec3 direction;
+    float k_c;  // attenuation factors
+    vec3 ambient;
+    float k_l;  // attenuation factors
+    vec3 diffuse;
+    float k_q;  // attenuation factors
+    vec3 specular;
+};
+
+// capacity only, the number of lights in use is pointLightCount
+#define MAX_POINT_LIGHTS 128
+
+// filled by LightManager, std140 layout must match lightManager.h;
+// lights that are switched off are left out, so pointLights[0, pointLightCount) are all on
+layout (std140) uniform Lights
+{
+    DiectionalLight diectionalLight;
+    SpotLight spotlight;
+    int pointLightCount;
+    bool dlighton;
+    bool spotlighton;
+    PointLight pointLights[MAX_POINT_LIGHTS];
+};
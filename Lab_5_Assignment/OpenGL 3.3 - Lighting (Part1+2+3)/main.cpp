@@ -20,14 +20,60 @@
 #include "hexagon.h"
 #include "basic_camera.h"
 #include "pointLight.h"
+#include "lightManager.h"
+#include "materials.h"
+#include "geometryArena.h"
+#include "instanceQueue.h"
+#include "staticBatch.h"
+#include "prefab.h"
+#include "textureArrays.h"
+#include "meshOptimizer.h"
+#include "levelOfDetail.h"
+#include "proceduralPrimitives.h"
+#include "sceneGraph.h"
+#include "frustumCulling.h"
+#include "boundingVolumeHierarchy.h"
+#include "portalVisibility.h"
+#include "occlusionCulling.h"
 #include "stb_image.h"
 #include "cylinder.h"
+#include "renderStats.h"
+#include "cameraUniformBuffer.h"
+#include "programBinaryCache.h"
+#include "shaderBuildQueue.h"
+#include "shaderVariants.h"
+#include "glState.h"
 
 
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <chrono>
+#include <vector>
+#include <iterator>
+#include <functional>
+#include <random>
 
 using namespace std;
 
+// count every heap allocation so the frame stats can show the render loop doesn't allocate
+void* operator new(std::size_t size)
+{
+    renderStats().allocations++;
+    if (void* memory = std::malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+void operator delete(void* memory, std::size_t) noexcept
+{
+    operator delete(memory);
+}
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
@@ -43,6 +89,15 @@ glm::mat4 RotationMatricesZ(float theta);
 const unsigned int SCR_WIDTH = 1800;
 const unsigned int SCR_HEIGHT = 900;
 
+// rooms tiled along x with --rooms, each one ROOM_SPACING past the last;
+// neighbours see each other through a doorway in the later room's Besin Wall, from
+// z = DOORWAY_START to DOORWAY_END and DOORWAY_HEIGHT tall
+unsigned int roomCount = 1;
+const float ROOM_SPACING = 23.5f;
+const float DOORWAY_START = 2.6f;
+const float DOORWAY_END = 4.8f;
+const float DOORWAY_HEIGHT = 3.0f;
+
 // modelling transform
 float rotateAngle_X = 0.0;
 float rotateAngle_Y = -90.0;
@@ -62,8 +117,6 @@ float r_fan = 0.0;
 float r_sphere = 0.0;
 
 bool fanOn = false;
-bool directionalLightOn = true;
-bool spotLightOn = true;
 
 
 
@@ -92,50 +145,87 @@ glm::vec3 pointLightPositions[] = {
 //glm::vec3(-0.5, 1, -0.5)
 
 
-PointLight pointlight1(
-
-    pointLightPositions[0].x, pointLightPositions[0].y, pointLightPositions[0].z,  // position
-    0.05f, 0.05f, 0.05f,     // ambient
-    1.0f, 1.0f, 1.0f,     // diffuse
-    1.0f, 1.0f, 1.0f,        // specular
-    1.0f,   //k_c
-    0.09f,  //k_l
-    0.032f, //k_q
-    1       // light number
-);
-PointLight pointlight2(
-
-    pointLightPositions[1].x, pointLightPositions[1].y, pointLightPositions[1].z,  // position
-    0.05f, 0.05f, 0.05f,     // ambient
-    1.0f, 1.0f, 1.0f,     // diffuse
-    1.0f, 1.0f, 1.0f,        // specular
-    1.0f,   //k_c
-    0.09f,  //k_l
-    0.032f, //k_q
-    2       // light number
-);
-PointLight pointlight3(
-
-    pointLightPositions[2].x, pointLightPositions[2].y, pointLightPositions[2].z,  // position
-    0.05f, 0.05f, 0.05f,     // ambient
-    1.0f, 1.0f, 1.0f,     // diffuse
-    1.0f, 1.0f, 1.0f,        // specular
-    1.0f,   //k_c
-    0.09f,  //k_l
-    0.032f, //k_q
-    3       // light number
-);
-PointLight pointlight4(
-
-    pointLightPositions[3].x, pointLightPositions[3].y, pointLightPositions[3].z,  // position
-    0.05f, 0.05f, 0.05f,     // ambient
-    1.0f, 1.0f, 1.0f,     // diffuse
-    1.0f, 1.0f, 1.0f,        // specular
-    1.0f,   //k_c
-    0.09f,  //k_l
-    0.032f, //k_q
-    4       // light number
-);
+// every light of the scene, uploaded to the Lights block by lights.upload()
+LightManager lights;
+
+void setUpLights()
+{
+    for (const glm::vec3& position : pointLightPositions)
+    {
+        lights.addPointLight(PointLight(
+            position.x, position.y, position.z,  // position
+            0.05f, 0.05f, 0.05f,     // ambient
+            1.0f, 1.0f, 1.0f,     // diffuse
+            1.0f, 1.0f, 1.0f,        // specular
+            1.0f,   //k_c
+            0.09f,  //k_l
+            0.032f, //k_q
+            lights.getPointLightCount() + 1       // light number
+        ));
+    }
+
+    lights.directionalLight.direction = glm::vec3(0.0f, 3.0f, 20.0f);
+    lights.directionalLight.ambient = glm::vec3(.2, .2, .2);
+    lights.directionalLight.diffuse = glm::vec3(.8f, .8f, .8f);
+    lights.directionalLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+
+    lights.spotLight.position = glm::vec3(0.0f, 0.0f, 0.0f);
+    lights.spotLight.direction = glm::vec3(0, -1, 0);
+    lights.spotLight.ambient = glm::vec3(.2, .2, .2);
+    lights.spotLight.diffuse = glm::vec3(.8f, .8f, .8f);
+    lights.spotLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    lights.spotLight.k_c = 1.0f;
+    lights.spotLight.k_l = 0.09;
+    lights.spotLight.k_q = 0.032;
+    lights.spotLight.cos_theta = glm::cos(glm::radians(5.5f));
+}
+
+// the Phong variant for a light set
+LightingVariant lightingVariant(int pointLights, bool directional, bool spot, bool textured, bool instanced, bool procedural)
+{
+    LightingVariant variant;
+    variant.pointLights = pointLights;
+    // textured surfaces have only ever been lit by the point lights
+    variant.directional = !textured && directional;
+    variant.spot = !textured && spot;
+    variant.textured = textured;
+    variant.instanced = instanced || procedural;
+    variant.procedural = procedural;
+    // only the instance queues bind texture arrays; single draws keep their 2D maps
+    variant.textureArray = textured && variant.instanced && textureArrays().isBuilt();
+    // procedural shapes read no vertices at all
+    variant.compactVertices = !procedural && geometryArena().vertexFormat != VERTEX_FORMAT_FLOAT;
+    return variant;
+}
+
+// the Phong variant matching the current light switches
+LightingVariant currentLightingVariant(bool textured, bool instanced = false, bool procedural = false)
+{
+    return lightingVariant(lights.getActivePointLightCount(), lights.directionalLight.on, lights.spotLight.on, textured, instanced, procedural);
+}
+
+// submit every variant the light keys (none, one or all point lights,
+// directional and spot on or off) and the procedural switch (K) can ask
+// for, so toggling never waits on the compiler in the middle of a frame.
+// Textured variants depend on the texture arrays, so call once with textured
+// false early on and once with it true after textureArrays().build()
+void prewarmReachableVariants(LightingShaderVariants& variants, bool textured)
+{
+    std::vector<int> pointLightCounts = { 0, 1, lights.getPointLightCount() };
+    pointLightCounts.erase(std::unique(pointLightCounts.begin(), pointLightCounts.end()), pointLightCounts.end());
+    for (int pointLights : pointLightCounts)
+        for (int directional = 0; directional < 2; ++directional)
+            for (int spot = 0; spot < 2; ++spot)
+            {
+                // textured variants ignore the directional and spot lights
+                if (textured && (directional || spot))
+                    continue;
+                variants.prewarm(lightingVariant(pointLights, directional != 0, spot != 0, textured, false, false));
+                if (textured)
+                    variants.prewarm(lightingVariant(pointLights, false, false, true, true, false));
+                variants.prewarm(lightingVariant(pointLights, directional != 0, spot != 0, textured, true, true));
+            }
+}
 
 
 // light settings
@@ -143,246 +233,572 @@ bool onOffToggle = true;
 bool ambientToggle = true;
 bool diffuseToggle = true;
 bool specularToggle = true;
+// merged static scenery (H) or object by object (J)
+bool staticBatching = true;
+// chair cones made in the vertex shader (K) or drawn from their meshes (L)
+bool proceduralPrimitives = false;
+// skip objects outside the view (N) or draw everything (M)
+bool frustumCulling = true;
+bool scalarCulling = false;
+// walk the scene's bounding volume hierarchy instead of testing every box
+bool hierarchyCulling = false;
+// report the object at the centre of the view (P), cast through the hierarchy
+bool pickRequested = false;
+// draw only the rooms seen through doorways, see portalVisibility.h
+bool portalCulling = true;
+// skip objects behind the walls, counters and boxes (O) or don't (I); see occlusionCulling.h
+bool occlusionCulling = true;
+int occlusionThreads = -1;
+bool vsync = true;
 
 
 // timing
 float deltaTime = 0.0f;    // time between current frame and last frame
 float lastFrame = 0.0f;
 
-void drawChairWithTransformations(const glm::mat4& identityMatrix,
-    const glm::mat4& globalTranslationMatrix,
-    const glm::vec3& translation,
-    const glm::vec3& rotation,
-    Shader& lightingShaderWithTexture,
-    Shader& ourShader,
+// the parts of each piece of furniture relative to the piece itself; main()
+// compiles them into prefabs once and places those every frame
+void describeChair(Prefab& chair,
     CylinderWithTexture& cylinder_window,
-    Cube& cube_floor,
-    const glm::vec3& viewPos) {
-
-    // Start with the identity matrix for the whole chair
-    glm::mat4 chairTransformMatrix = glm::translate(identityMatrix, translation);
-
-    // Apply rotation (on all axes)
-    chairTransformMatrix = glm::rotate(chairTransformMatrix, glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
-    chairTransformMatrix = glm::rotate(chairTransformMatrix, glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
-    chairTransformMatrix = glm::rotate(chairTransformMatrix, glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+    Cube& cube_floor) {
 
-    // Keep the original structure for the chair as it was
-    glm::mat4 translateMatrix, scaleMatrix, model;
+    glm::mat4 identityMatrix = glm::mat4(1.0f);
+    glm::mat4 translateMatrix, scaleMatrix;
 
     // Vertical cylinders (legs)
     translateMatrix = glm::translate(identityMatrix, glm::vec3(4.0f, 0.8f, 5.5f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(0.1f, 1.0f, 0.1f));
-    model = globalTranslationMatrix * chairTransformMatrix * scaleMatrix;
-    cylinder_window.drawCylinder(lightingShaderWithTexture, model, viewPos);
+    chair.add(cylinder_window, scaleMatrix);
 
     translateMatrix = glm::translate(identityMatrix, glm::vec3(3.0f, 0.8f, 5.5f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(0.1f, 1.0f, 0.1f));
-    model = globalTranslationMatrix*chairTransformMatrix * scaleMatrix;
-    cylinder_window.drawCylinder(lightingShaderWithTexture, model, viewPos);
+    chair.add(cylinder_window, scaleMatrix);
 
     translateMatrix = glm::translate(identityMatrix, glm::vec3(4.0f, 0.8f, 6.5f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(0.1f, 1.0f, 0.1f));
-    model = globalTranslationMatrix*chairTransformMatrix * scaleMatrix;
-    cylinder_window.drawCylinder(lightingShaderWithTexture, model, viewPos);
+    chair.add(cylinder_window, scaleMatrix);
 
     translateMatrix = glm::translate(identityMatrix, glm::vec3(3.0f, 0.8f, 6.5f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(0.1f, 1.0f, 0.1f));
-    model = globalTranslationMatrix*chairTransformMatrix * scaleMatrix;
-    cylinder_window.drawCylinder(lightingShaderWithTexture, model, viewPos);
+    chair.add(cylinder_window, scaleMatrix);
 
     // Seat (cube)
     translateMatrix = glm::translate(identityMatrix, glm::vec3(2.7f, 1.5f, 5.5f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(1.5f, 0.2f, 1.1f));
-    model = globalTranslationMatrix*chairTransformMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    cube_floor.drawCubeWithTexture(lightingShaderWithTexture, model);
+    chair.add(cube_floor, scaleMatrix);
 
     // Backrest (cube)
     translateMatrix = glm::translate(identityMatrix, glm::vec3(2.7f, 1.6f, 6.5f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(0.1f, 0.5f, 0.1f));
-    model = globalTranslationMatrix*chairTransformMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    cube_floor.drawCubeWithTexture(lightingShaderWithTexture, model);
+    chair.add(cube_floor, scaleMatrix);
 
     // Armrests (cubes)
     translateMatrix = glm::translate(identityMatrix, glm::vec3(4.1f, 1.6f, 6.5f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(0.1f, 0.5f, 0.1f));
-    model = globalTranslationMatrix*chairTransformMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    cube_floor.drawCubeWithTexture(lightingShaderWithTexture, model);
+    chair.add(cube_floor, scaleMatrix);
 
     // Backrest vertical sections
     translateMatrix = glm::translate(identityMatrix, glm::vec3(2.7f, 2.0f, 5.5f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(0.1f, 0.1f, 1.0f));
-    model = globalTranslationMatrix*chairTransformMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    cube_floor.drawCubeWithTexture(lightingShaderWithTexture, model);
+    chair.add(cube_floor, scaleMatrix);
 
     translateMatrix = glm::translate(identityMatrix, glm::vec3(4.1f, 2.0f, 5.5f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(0.1f, 0.1f, 1.0f));
-    model = globalTranslationMatrix*chairTransformMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    cube_floor.drawCubeWithTexture(lightingShaderWithTexture, model);
+    chair.add(cube_floor, scaleMatrix);
 
     // Seat bottom part
     translateMatrix = glm::translate(identityMatrix, glm::vec3(2.7f, 2.0f, 5.5f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(1.5f, 0.8f, 0.1f));
-    model = globalTranslationMatrix*chairTransformMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    cube_floor.drawCubeWithTexture(lightingShaderWithTexture, model);
+    chair.add(cube_floor, scaleMatrix);
 }
 
-void drawTableWithTransformations(const glm::mat4& identityMatrix,
-    const glm::mat4& globalTranslationMatrix,
-    const glm::vec3& translation,
-    const glm::vec3& rotation,
-    Shader& lightingShaderWithTexture,
-    Shader& ourShader,
+void describeTable(Prefab& table,
     Cube& cube_floor) {
 
-    // Start with the identity matrix for the whole table
-    glm::mat4 tableTransformMatrix = glm::translate(identityMatrix, translation);
-
-    // Apply rotation (on all axes)
-    tableTransformMatrix = glm::rotate(tableTransformMatrix, glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
-    tableTransformMatrix = glm::rotate(tableTransformMatrix, glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
-    tableTransformMatrix = glm::rotate(tableTransformMatrix, glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
-
-    // Keep the original structure for the table as it was
-    glm::mat4 translateMatrix, scaleMatrix, model;
+    glm::mat4 identityMatrix = glm::mat4(1.0f);
+    glm::mat4 translateMatrix, scaleMatrix;
 
     // Table top (rectangular surface)
     translateMatrix = glm::translate(identityMatrix, glm::vec3(6.7f, 2.0f, 5.7f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(2.0f, 0.1f, 1.5f));
-    model = globalTranslationMatrix*tableTransformMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    cube_floor.drawCubeWithTexture(lightingShaderWithTexture, model);
+    table.add(cube_floor, scaleMatrix);
 
     // Table leg 1
     translateMatrix = glm::translate(identityMatrix, glm::vec3(7.7f, 0.0f, 6.25f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(0.2f, 2.0f, 0.2f));
-    model = globalTranslationMatrix*tableTransformMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    cube_floor.drawCubeWithTexture(lightingShaderWithTexture, model);
+    table.add(cube_floor, scaleMatrix);
 
     // Table leg 2
     translateMatrix = glm::translate(identityMatrix, glm::vec3(7.4f, 0.0f, 5.9f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(1.0f, 0.1f, 1.0f));
-    model = globalTranslationMatrix*tableTransformMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    cube_floor.drawCubeWithTexture(lightingShaderWithTexture, model);
+    table.add(cube_floor, scaleMatrix);
 }
 
 
-void drawSofaWithTransformations(const glm::mat4& identityMatrix,
-    const glm::mat4& globalTranslationMatrix,
-    const glm::vec3& translation,
-    const glm::vec3& rotation,
-    Shader& lightingShaderWithTexture,
-    Shader& ourShader,
+void describeSofa(Prefab& sofa,
     Cube& cube_floor,
     Cube& cube_box) {
 
-    // Start with the identity matrix for the whole sofa
-    glm::mat4 sofaTransformMatrix = glm::translate(identityMatrix, translation);
-
-    // Apply rotation (on all axes)
-    sofaTransformMatrix = glm::rotate(sofaTransformMatrix, glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
-    sofaTransformMatrix = glm::rotate(sofaTransformMatrix, glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
-    sofaTransformMatrix = glm::rotate(sofaTransformMatrix, glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
-
-    glm::mat4 translateMatrix, scaleMatrix, model;
+    glm::mat4 identityMatrix = glm::mat4(1.0f);
+    glm::mat4 translateMatrix, scaleMatrix;
 
     // Sofa parts (like seat cushions, backrest, and armrests)
     // Seat 1
     translateMatrix = glm::translate(identityMatrix, glm::vec3(10.0f, 2.0f, 5.0f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(0.2f, 0.2f, 2.0f));
-    model = globalTranslationMatrix*sofaTransformMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    cube_floor.drawCubeWithTexture(lightingShaderWithTexture, model);
+    sofa.add(cube_floor, scaleMatrix);
 
     // Seat 2
     translateMatrix = glm::translate(identityMatrix, glm::vec3(10.0f, -0.01f, 5.0f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(0.2f, 0.2f, 2.0f));
-    model = globalTranslationMatrix*sofaTransformMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    cube_floor.drawCubeWithTexture(lightingShaderWithTexture, model);
+    sofa.add(cube_floor, scaleMatrix);
 
     // Backrest 1
     translateMatrix = glm::translate(identityMatrix, glm::vec3(10.0f, -.01f, 6.8f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(0.2f, 2.1f, 0.2f));
-    model = globalTranslationMatrix*sofaTransformMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    cube_floor.drawCubeWithTexture(lightingShaderWithTexture, model);
+    sofa.add(cube_floor, scaleMatrix);
 
     // Backrest 2
     translateMatrix = glm::translate(identityMatrix, glm::vec3(10.0f, -.01f, 5.0f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(0.2f, 2.1f, 0.2f));
-    model = globalTranslationMatrix*sofaTransformMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    cube_floor.drawCubeWithTexture(lightingShaderWithTexture, model);
+    sofa.add(cube_floor, scaleMatrix);
 
     // Armrest 1
     translateMatrix = glm::translate(identityMatrix, glm::vec3(14.0f, 2.0f, 5.0f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(0.2f, 0.2f, 2.0f));
-    model = globalTranslationMatrix*sofaTransformMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    cube_floor.drawCubeWithTexture(lightingShaderWithTexture, model);
+    sofa.add(cube_floor, scaleMatrix);
 
     // Armrest 2
     translateMatrix = glm::translate(identityMatrix, glm::vec3(14.0f, -0.01f, 5.0f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(0.2f, 0.2f, 2.0f));
-    model = globalTranslationMatrix*sofaTransformMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    cube_floor.drawCubeWithTexture(lightingShaderWithTexture, model);
+    sofa.add(cube_floor, scaleMatrix);
 
     // Backrest (large part)
     translateMatrix = glm::translate(identityMatrix, glm::vec3(14.0f, -.01f, 6.8f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(0.2f, 2.1f, 0.2f));
-    model = globalTranslationMatrix*sofaTransformMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    cube_floor.drawCubeWithTexture(lightingShaderWithTexture, model);
+    sofa.add(cube_floor, scaleMatrix);
 
     // Backrest (small part)
     translateMatrix = glm::translate(identityMatrix, glm::vec3(14.0f, -.01f, 5.0f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(0.2f, 2.1f, 0.2f));
-    model = globalTranslationMatrix*sofaTransformMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    cube_floor.drawCubeWithTexture(lightingShaderWithTexture, model);
+    sofa.add(cube_floor, scaleMatrix);
 
     // Bottom Seat Cushion 1
     translateMatrix = glm::translate(identityMatrix, glm::vec3(10.0f, 1.0f, 5.0f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(4.0f, 0.2f, 0.2f));
-    model = globalTranslationMatrix*sofaTransformMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    cube_floor.drawCubeWithTexture(lightingShaderWithTexture, model);
+    sofa.add(cube_floor, scaleMatrix);
 
     // Bottom Seat Cushion 2
     translateMatrix = glm::translate(identityMatrix, glm::vec3(10.0f, 1.0f, 6.8f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(4.0f, 0.2f, 0.2f));
-    model = globalTranslationMatrix*sofaTransformMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    cube_floor.drawCubeWithTexture(lightingShaderWithTexture, model);
+    sofa.add(cube_floor, scaleMatrix);
 
     // Side Cushion 1
     translateMatrix = glm::translate(identityMatrix, glm::vec3(10.2f, 1.2f, 5.0f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(3.8f, 0.6f, 2.0f));
-    model = globalTranslationMatrix*sofaTransformMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    cube_box.drawCubeWithTexture(lightingShaderWithTexture, model);
+    sofa.add(cube_box, scaleMatrix);
 
     // Side Cushion 2
     translateMatrix = glm::translate(identityMatrix, glm::vec3(10.2f, 1.8f, 6.5f));
     scaleMatrix = glm::scale(translateMatrix, glm::vec3(3.8f, 1.6f, 0.6f));
-    model = globalTranslationMatrix*sofaTransformMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    cube_box.drawCubeWithTexture(lightingShaderWithTexture, model);
+    sofa.add(cube_box, scaleMatrix);
 }
 
+// a textured primitive placed by a scene graph node; queue(queue, model,
+// normalMatrix, object) adds it to an instance queue at the node's cached
+// matrices. object is its box in the frustum culler, and the id its level
+// of detail is kept by
+struct SceneDraw {
+    unsigned int node;
+    unsigned int object;
+    std::function<void(InstanceQueue&, const glm::mat4&, const glm::mat3&, unsigned int)> queue;
+};
+
+// a compiled prefab (see prefab.h) placed by a scene graph node
+struct PrefabPlacement {
+    unsigned int node;
+    unsigned int object;
+    const Prefab* prefab;
+};
+
+// a mesh drawn directly (the lamps) or through a queue (the cones) at a node
+struct PlacedMesh {
+    unsigned int node;
+    unsigned int object;
+};
+
+// one placement of prefab under the room; translation and rotation (pitch,
+// yaw, roll in degrees) put it in the room, the room node moves the room
+void placePrefab(SceneGraph& scene, FrustumCuller& culler, unsigned int room, std::vector<PrefabPlacement>& placements,
+    const glm::vec3& translation, const glm::vec3& rotation, const Prefab& prefab) {
+
+    unsigned int node = scene.createNode(room, translation, rotation);
+    placements.push_back(PrefabPlacement{ node, culler.add(prefab.getBounds(), node), &prefab });
+}
+
+// a node under the room for a mesh whose own box is bounds
+PlacedMesh placeMesh(SceneGraph& scene, FrustumCuller& culler, unsigned int room, const BoundingBox& bounds,
+    const glm::vec3& translation, const glm::vec3& rotation, const glm::vec3& scale) {
+
+    unsigned int node = scene.createNode(room, translation, rotation, scale);
+    return PlacedMesh{ node, culler.add(bounds, node) };
+}
+
+
+// the walls, floor, boxes, besin counters, wall designs and hexagon panels
+// as nodes under the room; none of them ever moves on its own, so main()
+// bakes them into a StaticBatch once (before the room node has moved) unless
+// batching is off. With doorway the Besin Wall has an opening into the
+// room next door. The walls, boxes and counters are occluders too
+void placeStaticScenery(SceneGraph& scene,
+    FrustumCuller& culler,
+    OcclusionCuller& occlusion,
+    unsigned int room,
+    bool doorway,
+    std::vector<SceneDraw>& draws,
+    Cube& cube_wall,
+    Cube& cube_floor,
+    Cube& cube_box,
+    Cube& cube_besin,
+    CylinderWithTexture& cylinder_window,
+    CylinderWithTexture& cylinder_design1,
+    CylinderWithTexture& cylinder_design2,
+    CylinderWithTexture& cylinder_design3,
+    CylinderWithTexture& cylinder_design4,
+    CylinderWithTexture& cylinder_design5,
+    Hexagon& hexagon_design1,
+    Hexagon& hexagon_design2,
+    Hexagon& hexagon_design3) {
+
+    typedef std::function<void(InstanceQueue&, const glm::mat4&, const glm::mat3&, unsigned int)> QueueDraw;
+    // how to queue a primitive and the box of its mesh
+    struct Primitive {
+        QueueDraw queue;
+        BoundingBox bounds;
+    };
+    auto place = [&](const glm::vec3& translation, const glm::vec3& rotation, const glm::vec3& scale, const Primitive& primitive) {
+        unsigned int node = scene.createNode(room, translation, rotation, scale);
+        draws.push_back(SceneDraw{ node, culler.add(primitive.bounds, node), primitive.queue });
+    };
+    auto placeOccluder = [&](const glm::vec3& translation, const glm::vec3& rotation, const glm::vec3& scale, const Primitive& primitive) {
+        place(translation, rotation, scale, primitive);
+        occlusion.addOccluder(primitive.bounds, draws.back().node, draws.back().object);
+    };
+    auto cube = [](Cube& primitive) -> Primitive {
+        return Primitive{ [&primitive](InstanceQueue& queue, const glm::mat4& model, const glm::mat3& normalMatrix, unsigned int) { primitive.drawCubeWithTexture(queue, model, normalMatrix); },
+            primitive.getMesh().bounds };
+    };
+    auto cylinder = [](CylinderWithTexture& primitive) -> Primitive {
+        return Primitive{ [&primitive](InstanceQueue& queue, const glm::mat4& model, const glm::mat3& normalMatrix, unsigned int object) { primitive.drawCylinder(queue, model, normalMatrix, object); },
+            primitive.getMesh().bounds };
+    };
+    auto hexagon = [](Hexagon& primitive) -> Primitive {
+        return Primitive{ [&primitive](InstanceQueue& queue, const glm::mat4& model, const glm::mat3& normalMatrix, unsigned int) { primitive.drawHexagonWithTexture(queue, model, normalMatrix); },
+            primitive.getMesh().bounds };
+    };
+    const glm::vec3 noRotation(0.0f);
+
+    // ************************************************************************ Boundary ************************************************************************
+
+    // Drink Wall
+    placeOccluder(glm::vec3(0.0f, 0.0f, 0.0f), noRotation, glm::vec3(23.0f, 7.5f, 0.5f), cube(cube_wall));
+
+    //Design Wall
+    placeOccluder(glm::vec3(-0.5f, 0.0f, 30.0f), noRotation, glm::vec3(23.5f, 7.5f, 0.5f), cube(cube_wall));
+
+    //Besin Wall
+    if (doorway) {
+        // either side of the doorway, and the lintel above it
+        placeOccluder(glm::vec3(0.0f, 0.0f, 0.0f), noRotation, glm::vec3(-0.5f, 7.5f, DOORWAY_START), cube(cube_wall));
+        placeOccluder(glm::vec3(0.0f, 0.0f, DOORWAY_END), noRotation, glm::vec3(-0.5f, 7.5f, 30.0f - DOORWAY_END), cube(cube_wall));
+        placeOccluder(glm::vec3(0.0f, DOORWAY_HEIGHT, DOORWAY_START), noRotation, glm::vec3(-0.5f, 7.5f - DOORWAY_HEIGHT, DOORWAY_END - DOORWAY_START), cube(cube_wall));
+    }
+    else
+        placeOccluder(glm::vec3(0.0f, 0.0f, 0.0f), noRotation, glm::vec3(-0.5f, 7.5f, 30.0f), cube(cube_wall));
+
+    // Floor
+    place(glm::vec3(-0.5f, 0.0f, 0.0f), noRotation, glm::vec3(23.5f, -0.5f, 30.5f), cube(cube_floor));
+
+
 
-int main()
+    // ************************************************************************ Box ************************************************************************
+
+    for (int i = 0; i < 6; i++) {
+        placeOccluder(glm::vec3(0.0f + i * 3, 0.0f, 0.5f), noRotation, glm::vec3(3.0f, 2.0f, 2.0f), cube(cube_box));
+    }
+
+
+    // ************************************************************************ Besin ************************************************************************
+
+    for (int i = 0; i < 4; i++) {
+        place(glm::vec3(0.0f, 4.8f, 6.5f + i * 3), glm::vec3(90.0f, 0.0f, 90.0f), glm::vec3(3.5f, 0.1f, 3.5f), cylinder(cylinder_window));
+    }
+    for (int i = 0; i < 4; i++) {
+        placeOccluder(glm::vec3(0.0f, 0.0f, 5.0f + i * 3), noRotation, glm::vec3(1.5f, 2.0f, 3.0f), cube(cube_besin));
+    }
+
+    // ************************************************************************ Design ************************************************************************
+
+    // the same pattern on the design wall (z = 30) and the drink wall (z = 0.5)
+    const glm::vec3 faceWall(90.0f, 0.0f, 0.0f);
+    const float wallZ[2] = { 30.0f, 0.5f };
+    for (float z : wallZ) {
+        for (int i = 0; i < 3; i++) {
+            place(glm::vec3(5.0f + 5 * i, 5.0f, z), faceWall, glm::vec3(1.3f, 0.1f, 1.3f), cylinder(cylinder_design3));
+            place(glm::vec3(6.5f + 5 * i, 6.0f, z), faceWall, glm::vec3(1.1f, 0.1f, 1.1f), cylinder(cylinder_design2));
+            place(glm::vec3(7.8f + 5 * i, 5.2f, z), faceWall, glm::vec3(0.9f, 0.1f, 0.9f), cylinder(cylinder_design1));
+            place(glm::vec3(7.3f + 5 * i, 4.0f, z), faceWall, glm::vec3(0.7f, 0.1f, 0.7f), cylinder(cylinder_design4));
+            place(glm::vec3(6.0f + 5 * i, 3.8f, z), faceWall, glm::vec3(0.5f, 0.1f, 0.5f), cylinder(cylinder_design5));
+        }
+    }
+
+
+    // ************************************************************************ Hexagon ************************************************************************
+
+    const glm::vec3 faceBesinWall(0.0f, 90.0f, 0.0f);
+    place(glm::vec3(0.5f, 4.0f, 25.0f), faceBesinWall, glm::vec3(1.8f, 1.8f, 1.8f), hexagon(hexagon_design1));
+    place(glm::vec3(0.5f, 2.6f, 22.25f), faceBesinWall, glm::vec3(1.5f, 1.5f, 1.5f), hexagon(hexagon_design2));
+    place(glm::vec3(0.5f, 5.15f, 22.4f), faceBesinWall, glm::vec3(1.2f, 1.2f, 1.2f), hexagon(hexagon_design3));
+}
+
+// --cull-benchmark: 100000 boxes scattered around a camera, culled by the
+// SIMD kernel and by the scalar one, which have to agree
+int benchmarkFrustumCulling() {
+    const unsigned int objects = 100000;
+    const int runs = 200;
+
+    FrustumCuller culler;
+    std::mt19937 random(4208);
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f), size(0.1f, 2.0f);
+    for (unsigned int i = 0; i < objects; ++i)
+    {
+        unsigned int object = culler.add(BoundingBox(glm::vec3(-0.5f), glm::vec3(0.5f)));
+        glm::vec3 low(position(random), position(random), position(random));
+        culler.setWorldBounds(object, BoundingBox(low, low + glm::vec3(size(random), size(random), size(random))));
+    }
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.2f, 0.5f), glm::vec3(0.0f, 1.0f, 0.0f));
+    Frustum frustum = Frustum::fromMatrix(projection * view);
+
+    std::vector<unsigned char> simdVisible(objects);
+    const bool simd[2] = { true, false };
+    for (bool useSimd : simd)
+    {
+        culler.useSimd = useSimd;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int run = 0; run < runs; ++run)
+            culler.cull(frustum, 0, objects);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / runs;
+
+        unsigned int visible = 0, mismatches = 0;
+        for (unsigned int i = 0; i < objects; ++i)
+        {
+            visible += culler.isVisible(i);
+            if (useSimd)
+                simdVisible[i] = culler.isVisible(i);
+            else if (simdVisible[i] != (unsigned char)culler.isVisible(i))
+                ++mismatches;
+        }
+        std::cout << "frustum culling, " << culler.kernelName() << ": " << objects << " boxes in " << seconds * 1000000.0 << " us"
+            << ", " << visible << " visible";
+        if (!useSimd)
+            std::cout << ", " << mismatches << " differ from the SIMD kernel";
+        std::cout << std::endl;
+    }
+    return 0;
+}
+
+// --bvh-benchmark: hierarchies over 10 thousand to a million boxes, built,
+// refitted after every box moved, and queried through each kind of volume.
+// The frustum query and the first checkedQueries rays and box overlaps are
+// compared with a scan over every box, which has to agree
+int benchmarkHierarchy() {
+    const unsigned int sizes[3] = { 10000, 100000, 1000000 };
+    const int queries = 1000;
+    const int checkedQueries = 100;
+    std::mt19937 random(4208);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f), size(0.5f, 5.0f), jitter(-1.0f, 1.0f), unit(-1.0f, 1.0f);
+
+    for (unsigned int objects : sizes)
+    {
+        std::vector<BoundingBox> boxes(objects);
+        for (BoundingBox& box : boxes)
+        {
+            box.low = glm::vec3(position(random), position(random), position(random));
+            box.high = box.low + glm::vec3(size(random), size(random), size(random));
+        }
+        BoundingVolumeHierarchy hierarchy;
+        hierarchy.build(boxes);
+        std::cout << "BVH of " << objects << " boxes: " << hierarchy.nodeCount() << " nodes, built in " << hierarchy.lastBuildSeconds() * 1000.0 << " ms";
+
+        for (unsigned int i = 0; i < objects; ++i)
+        {
+            glm::vec3 offset(jitter(random), jitter(random), jitter(random));
+            boxes[i] = BoundingBox(boxes[i].low + offset, boxes[i].high + offset);
+            hierarchy.setBounds(i, boxes[i]);
+        }
+        hierarchy.refit();
+        std::cout << ", refitted in " << hierarchy.lastRefitSeconds() * 1000.0 << " ms" << (hierarchy.degraded() ? " (degraded)" : "") << std::endl;
+
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.2f, 0.5f), glm::vec3(0.0f, 1.0f, 0.0f));
+        Frustum frustum = Frustum::fromMatrix(projection * view);
+        std::vector<unsigned char> inFrustum(objects, 0);
+        unsigned int found = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        hierarchy.query(frustum, [&](unsigned int object) { ++found; inFrustum[object] = 1; return true; });
+        double frustumSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        unsigned int frustumMismatches = 0;
+        for (unsigned int i = 0; i < objects; ++i)
+            if (inFrustum[i] != (unsigned char)!frustum.excludes(boxes[i]))
+                ++frustumMismatches;
+
+        std::vector<glm::vec3> directions(queries);
+        std::vector<unsigned int> rayHits(queries);
+        std::vector<float> rayDistances(queries);
+        for (glm::vec3& direction : directions)
+            direction = glm::vec3(unit(random), unit(random), unit(random));
+        unsigned int hits = 0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < queries; ++i)
+        {
+            rayDistances[i] = 1000.0f;
+            rayHits[i] = hierarchy.raycast(glm::vec3(0.0f), directions[i], rayDistances[i]);
+            if (rayHits[i] != BoundingVolumeHierarchy::NO_OBJECT)
+                ++hits;
+        }
+        double raySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / queries;
+        // the nearest entry of all boxes; another box at the same distance is as good
+        unsigned int rayMismatches = 0;
+        for (int i = 0; i < checkedQueries; ++i)
+        {
+            float maxDistance = 1000.0f, nearest = maxDistance;
+            RayQuery ray(glm::vec3(0.0f), directions[i], &maxDistance);
+            unsigned int nearestObject = BoundingVolumeHierarchy::NO_OBJECT;
+            for (unsigned int object = 0; object < objects; ++object)
+            {
+                float entry = ray.entry(boxes[object]);
+                if (entry >= 0.0f && entry < nearest)
+                {
+                    nearest = entry;
+                    nearestObject = object;
+                }
+            }
+            if ((nearestObject == BoundingVolumeHierarchy::NO_OBJECT) != (rayHits[i] == BoundingVolumeHierarchy::NO_OBJECT)
+                || (nearestObject != BoundingVolumeHierarchy::NO_OBJECT && rayDistances[i] != nearest))
+                ++rayMismatches;
+        }
+
+        std::vector<BoundingBox> regions(queries);
+        for (BoundingBox& region : regions)
+        {
+            glm::vec3 low(position(random), position(random), position(random));
+            region = BoundingBox(low, low + glm::vec3(20.0f));
+        }
+        unsigned int overlaps = 0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < queries; ++i)
+            hierarchy.query(BoxQuery{ regions[i] }, [&](unsigned int) { ++overlaps; return true; });
+        double overlapSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / queries;
+        unsigned int overlapMismatches = 0;
+        std::vector<unsigned int> queried, scanned;
+        for (int i = 0; i < checkedQueries; ++i)
+        {
+            BoxQuery query{ regions[i] };
+            queried.clear();
+            scanned.clear();
+            hierarchy.query(query, [&](unsigned int object) { queried.push_back(object); return true; });
+            for (unsigned int object = 0; object < objects; ++object)
+                if (query.classify(boxes[object]) != BvhOverlap::OUTSIDE)
+                    scanned.push_back(object);
+            std::sort(queried.begin(), queried.end());
+            if (queried != scanned)
+                ++overlapMismatches;
+        }
+
+        std::cout << "  frustum query " << frustumSeconds * 1000000.0 << " us (" << found << " found)"
+            << ", ray cast " << raySeconds * 1000000.0 << " us (" << hits << " of " << queries << " hit)"
+            << ", 20 unit box overlap " << overlapSeconds * 1000000.0 << " us (" << overlaps / (double)queries << " found)" << std::endl;
+        std::cout << "  against a scan of every box: frustum " << frustumMismatches << " of " << objects << " boxes differ"
+            << ", rays " << rayMismatches << " of " << checkedQueries << " differ"
+            << ", box overlaps " << overlapMismatches << " of " << checkedQueries << " differ" << std::endl;
+    }
+    return 0;
+}
+
+// the world boxes of everything the culler knows, for the scene's hierarchy
+std::vector<BoundingBox> worldBoxes(const FrustumCuller& culler) {
+    std::vector<BoundingBox> boxes(culler.size());
+    for (unsigned int object = 0; object < boxes.size(); ++object)
+        boxes[object] = culler.worldBounds(object);
+    return boxes;
+}
+
+// taken during static initialisation, as close to process start as we can get
+static const std::chrono::steady_clock::time_point processStart = std::chrono::steady_clock::now();
+
+int main(int argc, char* argv[])
 {
+    for (int i = 1; i < argc; ++i)
+    {
+        // compile every program from source, to compare a cold start with a warm one
+        if (std::strcmp(argv[i], "--no-shader-cache") == 0)
+            programBinaryCache().enabled = false;
+        // draw the static scenery object by object, to compare frame times with the merged batch
+        if (std::strcmp(argv[i], "--no-static-batching") == 0)
+            staticBatching = false;
+        // don't wait for vertical sync, so the frame times show the real cost of a frame
+        if (std::strcmp(argv[i], "--no-vsync") == 0)
+            vsync = false;
+        // bind every texture on its own, to compare draw counts with the texture arrays
+        if (std::strcmp(argv[i], "--no-texture-arrays") == 0)
+            textureArrays().enabled = false;
+        // how the geometry arena stores vertices, see vertexPacking.h; float also keeps 32-bit indices
+        if (std::strcmp(argv[i], "--vertex-format=float") == 0)
+        {
+            geometryArena().vertexFormat = VERTEX_FORMAT_FLOAT;
+            geometryArena().shortIndices = false;
+        }
+        if (std::strcmp(argv[i], "--vertex-format=half") == 0)
+            geometryArena().vertexFormat = VERTEX_FORMAT_HALF;
+        if (std::strcmp(argv[i], "--vertex-format=unorm16") == 0)
+            geometryArena().vertexFormat = VERTEX_FORMAT_UNORM16;
+        // upload meshes in generated order; the startup report still shows their ACMR
+        if (std::strcmp(argv[i], "--no-mesh-optimization") == 0)
+            meshOptimizer().enabled = false;
+        // draw every cylinder, cone and sphere at full detail, to compare triangle counts
+        if (std::strcmp(argv[i], "--no-lod") == 0)
+            levelOfDetail().enabled = false;
+        // start with the chair cones made in the vertex shader, see proceduralPrimitives.h
+        if (std::strcmp(argv[i], "--procedural-primitives") == 0)
+            proceduralPrimitives = true;
+        // draw everything, to compare against, or cull with the plain C++ kernel
+        if (std::strcmp(argv[i], "--no-frustum-culling") == 0)
+            frustumCulling = false;
+        if (std::strcmp(argv[i], "--scalar-culling") == 0)
+            scalarCulling = true;
+        // time the culling kernels on generated boxes and exit, no window needed
+        if (std::strcmp(argv[i], "--cull-benchmark") == 0)
+            return benchmarkFrustumCulling();
+        if (std::strcmp(argv[i], "--bvh-culling") == 0)
+            hierarchyCulling = true;
+        // a row of copies of the room joined by doorways, and whether rooms
+        // out of sight through them are skipped
+        if (std::strncmp(argv[i], "--rooms=", 8) == 0)
+            roomCount = (unsigned int)std::max(1, std::atoi(argv[i] + 8));
+        if (std::strcmp(argv[i], "--no-portal-culling") == 0)
+            portalCulling = false;
+        // draw everything the occluders hide, or rasterize them with this many
+        // threads besides the main one (default: one per spare core)
+        if (std::strcmp(argv[i], "--no-occlusion-culling") == 0)
+            occlusionCulling = false;
+        if (std::strncmp(argv[i], "--occlusion-threads=", 20) == 0)
+            occlusionThreads = std::max(0, std::atoi(argv[i] + 20));
+        // time building, refitting and querying hierarchies of generated scenes and exit
+        if (std::strcmp(argv[i], "--bvh-benchmark") == 0)
+            return benchmarkHierarchy();
+    }
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -404,6 +820,8 @@ int main()
         return -1;
     }
     glfwMakeContextCurrent(window);
+    if (!vsync)
+        glfwSwapInterval(0);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
@@ -418,17 +836,43 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    programBinaryCache().init((GLADloadproc)glfwGetProcAddress);
+    shaderBuildQueue().init((GLADloadproc)glfwGetProcAddress);
+    // without parallel compile, hot reloads are built on a hidden window's
+    // context sharing this one's objects, so checking them can't stall a frame
+    GLFWwindow* compileContext = nullptr;
+    if (!shaderBuildQueue().isParallel())
+    {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        compileContext = glfwCreateWindow(1, 1, "shader compile", NULL, window);
+        if (compileContext != nullptr)
+            shaderCompileThread().start([compileContext] { glfwMakeContextCurrent(compileContext); }, [] { glfwMakeContextCurrent(NULL); });
+        else
+            std::cout << "no parallel compile and no shared context: a shader hot reload stalls the frame it is checked in" << std::endl;
+    }
 
     // configure global opengl state
     // -----------------------------
-    glEnable(GL_DEPTH_TEST);
+    glState().enable(GL_DEPTH_TEST);
 
     // build and compile our shader zprogram
+    // all programs are submitted here and only checked on first use, so the
+    // driver compiles them while the geometry and textures below are set up
     // ------------------------------------
-    Shader lightingShader("vertexShaderForPhongShading.vs", "fragmentShaderForPhongShading.fs");
+    // the Phong programs are specialised per light set, see currentLightingVariant()
+    LightingShaderVariants phongShaders("vertexShaderForPhongShading.vs", "fragmentShaderForPhongShading.fs");
     //Shader lightingShader("vertexShaderForGouraudShading.vs", "fragmentShaderForGouraudShading.fs");
     Shader ourShader("vertexShader.vs", "fragmentShader.fs");
 
+    // camera matrices shared by all programs through the PerFrame uniform block
+    CameraUniformBuffer cameraUniforms;
+    // textured objects are collected here and drawn instanced once a frame
+    InstanceQueue instanceQueue;
+    // primitives picked to be made in the vertex shader go here instead
+    ProceduralQueue proceduralQueue;
+    setUpLights();
+    prewarmReachableVariants(phongShaders, false);
+
     // set up vertex data (and buffer(s)) and configure vertex attributes
     // ------------------------------------------------------------------
 
@@ -962,13 +1406,17 @@ int main()
     glGenBuffers(1, &VBO_cyl);
     glGenBuffers(1, &EBO_cyl);
 
-    glBindVertexArray(VAO_cyl);
+    glState().bindVertexArray(VAO_cyl);
 
     glBindBuffer(GL_ARRAY_BUFFER, VBO_cyl);
     glBufferData(GL_ARRAY_BUFFER, sizeof(cylinder_vertices), cylinder_vertices, GL_STATIC_DRAW);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_cyl);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cylinder_indices), cylinder_indices, GL_STATIC_DRAW);
+    // the lamp tables are long fans; put them in cache order (the cone shares these vertices)
+    size_t lampVertexCount = sizeof(cylinder_vertices) / (6 * sizeof(float));
+    std::vector<unsigned int> cylinderIndices(std::begin(cylinder_indices), std::end(cylinder_indices));
+    meshOptimizer().optimizeIndices(cylinderIndices, lampVertexCount);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, cylinderIndices.size() * sizeof(unsigned int), cylinderIndices.data(), GL_STATIC_DRAW);
 
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
@@ -982,13 +1430,15 @@ int main()
     glGenBuffers(1, &VBO_cone);
     glGenBuffers(1, &EBO_cone);
 
-    glBindVertexArray(VAO_cone);
+    glState().bindVertexArray(VAO_cone);
 
     glBindBuffer(GL_ARRAY_BUFFER, VBO_cone);
     glBufferData(GL_ARRAY_BUFFER, sizeof(cylinder_vertices), cylinder_vertices, GL_STATIC_DRAW);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_cone);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cone_indices), cone_indices, GL_STATIC_DRAW);
+    std::vector<unsigned int> coneIndices(std::begin(cone_indices), std::end(cone_indices));
+    meshOptimizer().optimizeIndices(coneIndices, lampVertexCount);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, coneIndices.size() * sizeof(unsigned int), coneIndices.data(), GL_STATIC_DRAW);
 
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
@@ -1002,7 +1452,7 @@ int main()
     glGenBuffers(1, &VBO);
     glGenBuffers(1, &EBO);
 
-    glBindVertexArray(VAO);
+    glState().bindVertexArray(VAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
@@ -1022,7 +1472,7 @@ int main()
     glGenBuffers(1, &cubeVBO);
     glGenBuffers(1, &cubeEBO);
 
-    glBindVertexArray(cubeVAO);
+    glState().bindVertexArray(cubeVAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
@@ -1041,7 +1491,7 @@ int main()
 
     unsigned int lightCubeVAO;
     glGenVertexArrays(1, &lightCubeVAO);
-    glBindVertexArray(lightCubeVAO);
+    glState().bindVertexArray(lightCubeVAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
@@ -1052,7 +1502,7 @@ int main()
     // second, configure the light's VAO (VBO stays the same; the vertices are the same for the light object which is also a 3D cube)
     unsigned int lightCubeVAO1;
     glGenVertexArrays(1, &lightCubeVAO1);
-    glBindVertexArray(lightCubeVAO1);
+    glState().bindVertexArray(lightCubeVAO1);
 
     glBindBuffer(GL_ARRAY_BUFFER, VBO_cyl);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_cyl);
@@ -1062,7 +1512,7 @@ int main()
 
     unsigned int lightCubeVAO2;
     glGenVertexArrays(1, &lightCubeVAO2);
-    glBindVertexArray(lightCubeVAO2);
+    glState().bindVertexArray(lightCubeVAO2);
 
     glBindBuffer(GL_ARRAY_BUFFER, VBO_cone);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_cone);
@@ -1074,7 +1524,6 @@ int main()
 
 
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    Shader lightingShaderWithTexture("vertexShaderForPhongShadingWithTexture.vs", "fragmentShaderForPhongShadingWithTexture.fs");
 
     string diffuseMapPath;
     unsigned int diffMap;
@@ -1199,6 +1648,157 @@ int main()
     diffMap = loadTexture(diffuseMapPath.c_str(), GL_REPEAT, GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
     Cube cube_sofa = Cube(diffMap, specMap, 32.0f, 0.0f, 0.0f, 1.0f, 1.0f);
 
+    // every texture is loaded; pack them into arrays before anything is
+    // queued, the batch keys depend on it
+    textureArrays().build();
+    prewarmReachableVariants(phongShaders, true);
+
+    // everything hangs off the venue node, whose transform is the global one
+    // the arrow and rotate keys change, through one node per room; see sceneGraph.h
+    SceneGraph scene;
+    unsigned int venue = scene.createNode(NO_PARENT);
+    // a world box per placed object, refreshed when its node moves and
+    // tested against the view before anything is queued; see frustumCulling.h
+    FrustumCuller culler;
+    culler.useSimd = !scalarCulling;
+
+    // every room is a cell, from the outside of its walls and floor to the
+    // top of the walls, and each doorway a portal to the room before it
+    PortalVisibility portals;
+    portals.enabled = portalCulling;
+    std::vector<unsigned int> rooms;
+    for (unsigned int cell = 0; cell < roomCount; cell++) {
+        glm::vec3 origin(ROOM_SPACING * cell, 0.0f, 0.0f);
+        rooms.push_back(scene.createNode(venue, origin));
+        portals.addCell(BoundingBox(origin + glm::vec3(-0.5f, -0.5f, 0.0f), origin + glm::vec3(23.0f, 7.5f, 30.5f)));
+        if (cell > 0) {
+            // in the middle of the wall, which belongs to this cell; the one
+            // before ends at the wall's outer face, origin.x - 0.5
+            float x = origin.x - 0.25f;
+            const glm::vec3 doorway[4] = { glm::vec3(x, 0.0f, DOORWAY_START), glm::vec3(x, 0.0f, DOORWAY_END),
+                glm::vec3(x, DOORWAY_HEIGHT, DOORWAY_END), glm::vec3(x, DOORWAY_HEIGHT, DOORWAY_START) };
+            portals.addPortal(cell - 1, cell, doorway);
+        }
+    }
+
+    // the walls, boxes and counters in view drawn into a small depth buffer
+    // on the CPU every frame, hiding whatever is behind them
+    OcclusionCuller occlusion;
+    occlusion.useSimd = !scalarCulling;
+    if (occlusionThreads < 0)
+        occlusionThreads = (int)std::min(7u, std::max(1u, std::thread::hardware_concurrency()) - 1);
+    occlusion.startThreads((unsigned int)occlusionThreads);
+
+    // bake the static scenery while the venue node is still at the origin, so
+    // it is placed as if there were no global transform. The first room has
+    // a solid Besin Wall, every later one the same scenery with a doorway into
+    // the room before; the first room's and the second room's are baked, each
+    // relative to its room, and drawn at each room's matrix
+    StaticBatch staticScenery, sceneryWithDoorway;
+    std::vector<SceneDraw> sceneryDraws;
+    size_t firstRoomDraws = 0, secondRoomDraws = 0;
+    for (unsigned int cell = 0; cell < rooms.size(); cell++) {
+        placeStaticScenery(scene, culler, occlusion, rooms[cell], cell > 0, sceneryDraws, cube_wall, cube_floor, cube_box, cube_besin, cylinder_window,
+            cylinder_design1, cylinder_design2, cylinder_design3, cylinder_design4, cylinder_design5, hexagon_design1, hexagon_design2, hexagon_design3);
+        if (cell == 0)
+            firstRoomDraws = sceneryDraws.size();
+        else if (cell == 1)
+            secondRoomDraws = sceneryDraws.size() - firstRoomDraws;
+    }
+    scene.update();
+    for (size_t i = 0; i < firstRoomDraws; ++i)
+        sceneryDraws[i].queue(instanceQueue, scene.world(sceneryDraws[i].node), scene.normalMatrix(sceneryDraws[i].node), sceneryDraws[i].object);
+    staticScenery.build(instanceQueue);
+    if (rooms.size() > 1) {
+        // rooms only move by translation, so the normal matrices stay as they are
+        glm::mat4 toRoom = glm::inverse(scene.world(rooms[1]));
+        for (size_t i = firstRoomDraws; i < firstRoomDraws + secondRoomDraws; ++i)
+            sceneryDraws[i].queue(instanceQueue, toRoom * scene.world(sceneryDraws[i].node), scene.normalMatrix(sceneryDraws[i].node), sceneryDraws[i].object);
+        sceneryWithDoorway.build(instanceQueue);
+    }
+    renderStats().mode = staticBatching ? "static batching on" : "static batching off";
+
+    // furniture is compiled once into one mesh each and only placed per frame
+    Prefab chair("chair"), table("table"), sofa("sofa");
+    describeChair(chair, cylinder_window, cube_floor);
+    chair.compile();
+    describeTable(table, cube_floor);
+    table.compile();
+    describeSofa(sofa, cube_floor, cube_sofa);
+    sofa.compile();
+
+    // the furniture, cones and lamps of every room, room by room. The lamps:
+    // wall and table lights are drawn with lightCubeVAO1, the room corner
+    // lights with lightCubeVAO
+    std::vector<PlacedMesh> cones;
+    std::vector<PrefabPlacement> furniture;
+    std::vector<PlacedMesh> lamps, cornerLights;
+    const BoundingBox& coneBounds = cone_chair.getMesh().bounds;
+    const BoundingBox lampBounds = BoundingBox::ofPositions(cylinder_vertices, lampVertexCount, 6);
+    const BoundingBox cornerLightBounds = BoundingBox::ofPositions(cube_vertices, sizeof(cube_vertices) / (6 * sizeof(float)), 6);
+    for (unsigned int room : rooms) {
+        // the chair cones, a second one upside down on top of each
+        for (int i = 0; i < 6; i++) {
+            cones.push_back(placeMesh(scene, culler, room, coneBounds, glm::vec3(2.0f + i * 2.7f, 0.0f, 4.5f), glm::vec3(0.0f), glm::vec3(0.7f)));
+            cones.push_back(placeMesh(scene, culler, room, coneBounds, glm::vec3(2.0f + i * 2.7f, 1.7f, 4.5f), glm::vec3(180.0f, 0.0f, 0.0f), glm::vec3(0.7f)));
+        }
+
+        //1st set
+        for (int i = 0; i < 4; i++)
+            placePrefab(scene, culler, room, furniture, glm::vec3(1.0f, 0.0f, 13.0 + i * 4.4f), glm::vec3(0.0f, 90.0f, 0.0f), chair);
+        for (int i = 0; i < 4; i++)
+            placePrefab(scene, culler, room, furniture, glm::vec3(1.5f, 0.0f, 3.1f + i * 4.4f), glm::vec3(0.0f, 0.0f, 0.0f), table);
+        for (int i = 0; i < 4; i++)
+            placePrefab(scene, culler, room, furniture, glm::vec3(18.0f, 0.0f, 6.0 + i * 4.4f), glm::vec3(0.0f, -90.0f, 0.0f), chair);
+
+        //2nd set
+        for (int i = 0; i < 4; i++)
+            placePrefab(scene, culler, room, furniture, glm::vec3(8.0f, 0.0f, 13.0 + i * 4.4f), glm::vec3(0.0f, 90.0f, 0.0f), chair);
+        for (int i = 0; i < 4; i++)
+            placePrefab(scene, culler, room, furniture, glm::vec3(8.5f, 0.0f, 3.1f + i * 4.4f), glm::vec3(0.0f, 0.0f, 0.0f), table);
+        for (int i = 0; i < 4; i++)
+            placePrefab(scene, culler, room, furniture, glm::vec3(25.0, 0.0f, 6.0 + i * 4.4f), glm::vec3(0.0f, -90.0f, 0.0f), chair);
+
+        //sofa
+        for (int i = 0; i < 3; i++)
+            placePrefab(scene, culler, room, furniture, glm::vec3(-8.0f + i * 5.5f, 0.0f, 22.5f), glm::vec3(0.0f, 0.0f, 0.0f), sofa);
+
+        for (int i = 0; i < 3; i++) {
+            lamps.push_back(placeMesh(scene, culler, room, lampBounds, glm::vec3(6.0f + 5 * i, 5.2f, 30.0f), glm::vec3(90.0f, 0.0f, 0.0f), glm::vec3(1.0f, -0.15f, 1.0f)));
+            lamps.push_back(placeMesh(scene, culler, room, lampBounds, glm::vec3(6.0f + 5 * i, 5.2f, 0.75f), glm::vec3(90.0f, 0.0f, 0.0f), glm::vec3(1.0f, -0.15f, 1.0f)));
+        }
+        const float tableLightZ[3] = { 5.0f, 15.0f, 25.0f };
+        for (float z : tableLightZ) {
+            for (int i = 0; i < 6; i++)
+                lamps.push_back(placeMesh(scene, culler, room, lampBounds, glm::vec3(1.5f + i * 4.0f, 5.0f, z), glm::vec3(0.0f), glm::vec3(1.5f, 1.7, 1.5f)));
+        }
+        for (int i = 0; i < 2; i++) {
+            cornerLights.push_back(placeMesh(scene, culler, room, cornerLightBounds, glm::vec3(0.0f, 0.0f, 29.75f - i * 29.25f), glm::vec3(0.0f), glm::vec3(0.5f, 15.0f, 0.5f)));
+            cornerLights.push_back(placeMesh(scene, culler, room, cornerLightBounds, glm::vec3(23.0f, 0.0f, 29.75f - i * 29.25f), glm::vec3(0.0f), glm::vec3(0.5f, 15.0f, 0.5f)));
+            cornerLights.push_back(placeMesh(scene, culler, room, cornerLightBounds, glm::vec3(0.0f, 7.5f, 29.75f - i * 29.25f), glm::vec3(0.0f), glm::vec3(46.0f, -0.5f, 0.5f)));
+        }
+    }
+
+    scene.update();
+    // the scenery's nodes were recomputed by the update before this one, so
+    // placeMoved() would skip them
+    culler.placeAll(scene);
+    // with the venue at the origin the world boxes are in venue space, where
+    // the cells are: each object belongs to the room its centre is in
+    std::vector<unsigned int> objectCells(culler.size());
+    for (unsigned int object = 0; object < culler.size(); ++object)
+        objectCells[object] = portals.cellAt(culler.worldBounds(object).centre());
+    // a hierarchy over the same world boxes, for culling with --bvh-culling
+    // and for picking; it is refitted whenever the boxes move
+    BoundingVolumeHierarchy sceneIndex;
+    sceneIndex.build(worldBoxes(culler));
+    renderStats().hierarchyNodes = (unsigned int)sceneIndex.nodeCount();
+    renderStats().hierarchyBuildSeconds = sceneIndex.lastBuildSeconds();
+
+    // the prewarmed variants had the whole of the loading to compile; what
+    // is left of that is waited for here, not when a light key is pressed
+    phongShaders.finishAll();
+
     //ourShader.use();
     //lightingShader.use();
 
@@ -1221,37 +1821,27 @@ int main()
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // be sure to activate shader when setting uniforms/drawing objects
-        lightingShader.use();
-        lightingShader.setVec3("viewPos", camera.Position);
-
-        // point light 1
-        pointlight1.setUpPointLight(lightingShader);
-        // point light 2
-        pointlight2.setUpPointLight(lightingShader);
-        // point light 3
-        pointlight3.setUpPointLight(lightingShader);
-        // point light 4
-        pointlight4.setUpPointLight(lightingShader);
-
-        lightingShader.setVec3("diectionalLight.directiaon", 0.0f, 3.0f, 20.0f);
-        lightingShader.setVec3("diectionalLight.ambient", .2, .2, .2);
-        lightingShader.setVec3("diectionalLight.diffuse", .8f, .8f, .8f);
-        lightingShader.setVec3("diectionalLight.specular", 1.0f, 1.0f, 1.0f);
-        lightingShader.setBool("dlighton", directionalLightOn);
-
-
-        lightingShader.setVec3("spotlight.position", 0.0f, 0.0f, 0.0f);
-        lightingShader.setVec3("spotlight.direction", 0, -1, 0);
-        lightingShader.setVec3("spotlight.ambient", .2, .2, .2);
-        lightingShader.setVec3("spotlight.diffuse", .8f, .8f, .8f);
-        lightingShader.setVec3("spotlight.specular", 1.0f, 1.0f, 1.0f);
-        lightingShader.setFloat("spotlight.k_c", 1.0f);
-        lightingShader.setFloat("spotlight.k_l", 0.09);
-        lightingShader.setFloat("spotlight.k_q", 0.032);
-        lightingShader.setFloat("cos_theta", glm::cos(glm::radians(5.5f)));
-        lightingShader.setBool("spotlighton", spotLightOn);
+        // pass projection matrix, view matrix and eye position to every program at once
+        // (note that in this case they could change every frame)
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        //glm::mat4 projection = glm::ortho(-2.0f, +2.0f, -1.5f, +1.5f, 0.1f, 100.0f);
+        glm::mat4 view = camera.GetViewMatrix();
+        //glm::mat4 view = basic_camera.createViewMatrix();
+        cameraUniforms.update(projection, view, camera.Position);
+        // levels of detail are picked by size on screen from this camera
+        levelOfDetail().setView(camera.Position, glm::radians(camera.Zoom), (float)SCR_HEIGHT);
+
+        // pick up shader files saved since the last frame
+        Shader::updateHotReload();
+
+        // lights live in the Lights block; this is a no-op unless a light changed
+        lights.upload();
+        materialRegistry().upload();
 
+        // pick the programs built for the lights that are on right now
+        Shader& lightingShader = phongShaders.select(currentLightingVariant(false));
+        Shader& lightingShaderWithTexture = phongShaders.select(currentLightingVariant(true));
+        Shader& instancedShaderWithTexture = phongShaders.select(currentLightingVariant(true, true));
 
         //pointLightPositions[0].x, pointLightPositions[0].y, pointLightPositions[0].z,  // position
         //    1.0f, 1.0f, 1.0f,     // ambient
@@ -1267,366 +1857,98 @@ int main()
         // activate shader
         lightingShader.use();
 
-        // pass projection matrix to shader (note that in this case it could change every frame)
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        //glm::mat4 projection = glm::ortho(-2.0f, +2.0f, -1.5f, +1.5f, 0.1f, 100.0f);
-        lightingShader.setMat4("projection", projection);
-
-        // camera/view transformation
-        glm::mat4 view = camera.GetViewMatrix();
-        //glm::mat4 view = basic_camera.createViewMatrix();
-        lightingShader.setMat4("view", view);
-
         // Modelling Transformation
-        glm::mat4 identityMatrix = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
-        glm::mat4 translateMatrix, rotateXMatrix, rotateYMatrix, rotateZMatrix, scaleMatrix, model, globalTranslationMatrix;
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(translate_X, translate_Y, translate_Z));
-        rotateXMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_X), glm::vec3(1.0f, 0.0f, 0.0f));
-        rotateYMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_Y), glm::vec3(0.0f, 1.0f, 0.0f));
-        rotateZMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_Z), glm::vec3(0.0f, 0.0f, 1.0f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(1.0f, 1.0f, 1.0f));
-        globalTranslationMatrix = translateMatrix * rotateXMatrix * rotateYMatrix * rotateZMatrix * scaleMatrix;
-        lightingShader.setMat4("model", globalTranslationMatrix);
-
-        // be sure to activate shader when setting uniforms/drawing objects
-        lightingShaderWithTexture.use();
-        lightingShaderWithTexture.setVec3("viewPos", camera.Position);
-
-        // pass projection matrix to shader (note that in this case it could change every frame)
-        // glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        //glm::mat4 projection = glm::ortho(-2.0f, +2.0f, -1.5f, +1.5f, 0.1f, 100.0f);
-        lightingShaderWithTexture.setMat4("projection", projection);
-
-        // camera/view transformation
-        // glm::mat4 view = camera.GetViewMatrix();
-        //glm::mat4 view = basic_camera.createViewMatrix();
-        lightingShaderWithTexture.setMat4("view", view);
-
-        lightingShaderWithTexture.use();
-        // point light 1
-        pointlight1.setUpPointLight(lightingShaderWithTexture);
-        // point light 2
-        pointlight2.setUpPointLight(lightingShaderWithTexture);
-        // point light 3
-        pointlight3.setUpPointLight(lightingShaderWithTexture);
-        // point light 4
-        pointlight4.setUpPointLight(lightingShaderWithTexture);
-
-
-        // ************************************************************************ Boundary ************************************************************************
-
-        // Drink Wall
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
-        scaleMatrix = glm::scale(translateMatrix, glm::vec3(23.0f, 7.5f, 0.5f));
-        model = globalTranslationMatrix * scaleMatrix;
-        cube_wall.drawCubeWithTexture(lightingShaderWithTexture, model);
-
-        //Design Wall
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.5f, 0.0f, 30.0f));
-        scaleMatrix = glm::scale(translateMatrix, glm::vec3(23.5f, 7.5f, 0.5f));
-        model = globalTranslationMatrix * scaleMatrix;
-        cube_wall.drawCubeWithTexture(lightingShaderWithTexture, model);
-
-        //Besin Wall
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
-        scaleMatrix = glm::scale(translateMatrix, glm::vec3(-0.5f, 7.5f, 30.0f));
-        model = globalTranslationMatrix * scaleMatrix;
-        cube_wall.drawCubeWithTexture(lightingShaderWithTexture, model);
-
-        // Floor
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.5f, 0.0f, 0.0f));
-        scaleMatrix = glm::scale(translateMatrix, glm::vec3(23.5f, -0.5f, 30.5f));
-        model = globalTranslationMatrix * scaleMatrix;
-        ourShader.setMat4("model", model);
-        cube_floor.drawCubeWithTexture(lightingShaderWithTexture, model);
-
-        
-
-        // ************************************************************************ Box ************************************************************************
-
-        for (int i = 0; i < 6; i++) {
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0f + i * 3, 0.0f, 0.5f));
-            scaleMatrix = glm::scale(translateMatrix, glm::vec3(3.0f, 2.0f, 2.0f));
-            model = globalTranslationMatrix * scaleMatrix;
-            cube_box.drawCubeWithTexture(lightingShaderWithTexture, model);
+        // the global transform is the venue node's; the scene graph only
+        // recomputes matrices under it on frames where a key changed it
+        scene.setTransform(venue, glm::vec3(translate_X, translate_Y, translate_Z), glm::vec3(rotateAngle_X, rotateAngle_Y, rotateAngle_Z));
+        scene.update();
+        lightingShader.setModel(scene.world(venue), scene.normalMatrix(venue));
+        // boxes only move with their nodes, the view moves every frame
+        culler.enabled = frustumCulling;
+        if (culler.placeMoved(scene) > 0)
+        {
+            for (unsigned int object = 0; object < culler.size(); ++object)
+                sceneIndex.setBounds(object, culler.worldBounds(object));
+            sceneIndex.refit();
+            if (sceneIndex.degraded())
+                sceneIndex.build(worldBoxes(culler));
         }
-
-
-        // ************************************************************************ Chair ************************************************************************
-
-        for (int i = 0; i < 6; i++) {
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(2.0f + i * 2.7f, 0.0f, 4.5f));
-            scaleMatrix = glm::scale(translateMatrix, glm::vec3(0.7f, 0.7f, 0.7f));
-            model = globalTranslationMatrix * scaleMatrix;
-            cone_chair.drawConeWithTexture(lightingShaderWithTexture, model);
-
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(2.0f + i * 2.7f, 1.7f, 4.5f));
-            glm::mat4 rotateMatrix = glm::rotate(translateMatrix, glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-            scaleMatrix = glm::scale(rotateMatrix, glm::vec3(0.7f, 0.7f, 0.7f));
-            model = globalTranslationMatrix * scaleMatrix;
-            cone_chair.drawConeWithTexture(lightingShaderWithTexture, model);
-        }
-
-        // ************************************************************************ Besin ************************************************************************
-
-        glm::vec3 viewPos = glm::vec3(0.0f, 0.0f, 5.0f);
-
-        for (int i = 0; i < 4; i++) {
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0f, 4.8f, 6.5f + i * 3));
-            glm::mat4 rotateMatrix = glm::rotate(translateMatrix, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-            glm::mat4 rotateMatrix2 = glm::rotate(rotateMatrix, glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-            scaleMatrix = glm::scale(rotateMatrix2, glm::vec3(3.5f, 0.1f, 3.5f));
-            model = globalTranslationMatrix * scaleMatrix;
-            cylinder_window.drawCylinder(lightingShaderWithTexture, model, viewPos);
-        }
-        for (int i = 0; i < 4; i++) {
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, 5.0f + i * 3));
-            scaleMatrix = glm::scale(translateMatrix, glm::vec3(1.5f, 2.0f, 3.0f));
-            model = globalTranslationMatrix * scaleMatrix;
-            cube_besin.drawCubeWithTexture(lightingShaderWithTexture, model);
-        }
-
-        // ************************************************************************ Design ************************************************************************
-
-        glm::mat4 rotateMatrix;
-
-        for (int i = 0; i < 3; i++) {
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(5.0f + 5 * i, 5.0f, 30.0f));
-            rotateMatrix = glm::rotate(translateMatrix, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-            scaleMatrix = glm::scale(rotateMatrix, glm::vec3(1.3f, 0.1f, 1.3f));
-            model = globalTranslationMatrix * scaleMatrix;
-            cylinder_design3.drawCylinder(lightingShaderWithTexture, model, viewPos);
-
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(6.5f + 5 * i, 6.0f, 30.0f));
-            rotateMatrix = glm::rotate(translateMatrix, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-            scaleMatrix = glm::scale(rotateMatrix, glm::vec3(1.1f, 0.1f, 1.1f));
-            model = globalTranslationMatrix * scaleMatrix;
-            cylinder_design2.drawCylinder(lightingShaderWithTexture, model, viewPos);
-
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(7.8f + 5 * i, 5.2f, 30.0f));
-            rotateMatrix = glm::rotate(translateMatrix, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-            scaleMatrix = glm::scale(rotateMatrix, glm::vec3(0.9f, 0.1f, 0.9f));
-            model = globalTranslationMatrix * scaleMatrix;
-            cylinder_design1.drawCylinder(lightingShaderWithTexture, model, viewPos);
-
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(7.3f + 5 * i, 4.0f, 30.0f));
-            rotateMatrix = glm::rotate(translateMatrix, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-            scaleMatrix = glm::scale(rotateMatrix, glm::vec3(0.7f, 0.1f, 0.7f));
-            model = globalTranslationMatrix * scaleMatrix;
-            cylinder_design4.drawCylinder(lightingShaderWithTexture, model, viewPos);
-
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(6.0f + 5 * i, 3.8f, 30.0f));
-            rotateMatrix = glm::rotate(translateMatrix, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-            scaleMatrix = glm::scale(rotateMatrix, glm::vec3(0.5f, 0.1f, 0.5f));
-            model = globalTranslationMatrix * scaleMatrix;
-            cylinder_design5.drawCylinder(lightingShaderWithTexture, model, viewPos);
+        if (hierarchyCulling)
+            culler.cull(projection * view, sceneIndex);
+        else
+            culler.cull(projection * view);
+        // then the rooms behind walls, and what can't be seen through a doorway
+        portals.update(projection * view, scene.world(venue), camera.Position);
+        portals.cull(culler, objectCells);
+        // and last what the nearest walls, boxes and counters cover
+        occlusion.enabled = occlusionCulling;
+        occlusion.cull(scene, culler, projection * view);
+        if (pickRequested)
+        {
+            float distance = 100.0f;
+            unsigned int object = sceneIndex.raycast(camera.Position, camera.Front, distance);
+            if (object == BoundingVolumeHierarchy::NO_OBJECT)
+                std::cout << "pick: nothing within " << distance << " units" << std::endl;
+            else
+                std::cout << "pick: object " << object << " at " << distance << " units" << std::endl;
+            pickRequested = false;
         }
 
-        // ************************************************************************ Design 2 ************************************************************************
-
-
-        for (int i = 0; i < 3; i++) {
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(5.0f + 5 * i, 5.0f, 0.5f));
-            rotateMatrix = glm::rotate(translateMatrix, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-            scaleMatrix = glm::scale(rotateMatrix, glm::vec3(1.3f, 0.1f, 1.3f));
-            model = globalTranslationMatrix * scaleMatrix;
-            cylinder_design3.drawCylinder(lightingShaderWithTexture, model, viewPos);
-
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(6.5f + 5 * i, 6.0f, 0.5f));
-            rotateMatrix = glm::rotate(translateMatrix, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-            scaleMatrix = glm::scale(rotateMatrix, glm::vec3(1.1f, 0.1f, 1.1f));
-            model = globalTranslationMatrix * scaleMatrix;
-            cylinder_design2.drawCylinder(lightingShaderWithTexture, model, viewPos);
-
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(7.8f + 5 * i, 5.2f, 0.5f));
-            rotateMatrix = glm::rotate(translateMatrix, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-            scaleMatrix = glm::scale(rotateMatrix, glm::vec3(0.9f, 0.1f, 0.9f));
-            model = globalTranslationMatrix * scaleMatrix;
-            cylinder_design1.drawCylinder(lightingShaderWithTexture, model, viewPos);
-
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(7.3f + 5 * i, 4.0f, 0.5f));
-            rotateMatrix = glm::rotate(translateMatrix, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-            scaleMatrix = glm::scale(rotateMatrix, glm::vec3(0.7f, 0.1f, 0.7f));
-            model = globalTranslationMatrix * scaleMatrix;
-            cylinder_design4.drawCylinder(lightingShaderWithTexture, model, viewPos);
-
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(6.0f + 5 * i, 3.8f, 0.5f));
-            rotateMatrix = glm::rotate(translateMatrix, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-            scaleMatrix = glm::scale(rotateMatrix, glm::vec3(0.5f, 0.1f, 0.5f));
-            model = globalTranslationMatrix * scaleMatrix;
-            cylinder_design5.drawCylinder(lightingShaderWithTexture, model, viewPos);
+        // the textured objects below only queue themselves; they are drawn
+        // instanced, one draw per mesh and material, once the queue is flushed.
+        // The scenery that never moves was merged at load time and only needs
+        // the transform of each room that can be seen
+        if (staticBatching) {
+            for (unsigned int cell = 0; cell < rooms.size(); cell++)
+                if (portals.isVisible(cell))
+                    (cell == 0 ? staticScenery : sceneryWithDoorway).draw(lightingShaderWithTexture, scene.world(rooms[cell]), scene.normalMatrix(rooms[cell]));
         }
-
-
-        // ************************************************************************ Hexagon ************************************************************************
-        
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.5f, 4.0f, 25.0f));
-        rotateMatrix = glm::rotate(translateMatrix, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        scaleMatrix = glm::scale(rotateMatrix, glm::vec3(1.8f, 1.8f, 1.8f));
-        model = globalTranslationMatrix * scaleMatrix;
-        hexagon_design1.drawHexagonWithTexture(lightingShaderWithTexture, model);
-
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.5f, 2.6f, 22.25f));
-        rotateMatrix = glm::rotate(translateMatrix, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        scaleMatrix = glm::scale(rotateMatrix, glm::vec3(1.5f, 1.5f, 1.5f));
-        model = globalTranslationMatrix * scaleMatrix;
-        hexagon_design2.drawHexagonWithTexture(lightingShaderWithTexture, model);
-
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.5f, 5.15f, 22.4f));
-        rotateMatrix = glm::rotate(translateMatrix, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        scaleMatrix = glm::scale(rotateMatrix, glm::vec3(1.2f, 1.2f, 1.2f));
-        model = globalTranslationMatrix * scaleMatrix;
-        hexagon_design3.drawHexagonWithTexture(lightingShaderWithTexture, model);
+        else
+            for (const SceneDraw& draw : sceneryDraws)
+                if (culler.isVisible(draw.object))
+                    draw.queue(instanceQueue, scene.world(draw.node), scene.normalMatrix(draw.node), draw.object);
 
         // ************************************************************************ Chair ************************************************************************
 
-        //1st set
-        
-        //chair
-        for (int i = 0; i < 4; i++) {
-            glm::vec3 translation(1.0f, 0.0f, 13.0 + i*4.4f);  // Translation for the chair
-            glm::vec3 rotation(0.0f, 90.0f, 0.0f);  // Rotation for the chair (pitch, yaw, roll in degrees)
-            drawChairWithTransformations(identityMatrix, globalTranslationMatrix, translation, rotation, lightingShaderWithTexture, ourShader, cylinder_window, cube_floor, viewPos);
-        }
-
-        //table
-        for (int i = 0; i < 4; i++) {
-            glm::vec3 translation(1.5f, 0.0f, 3.1f+i*4.4f);  // Translation for the table
-            glm::vec3 rotation(0.0f, 0.0f, 0.0f);  // Rotation for the table (pitch, yaw, roll in degrees)
-            drawTableWithTransformations(identityMatrix, globalTranslationMatrix, translation, rotation, lightingShaderWithTexture, ourShader, cube_floor);
-        }
-
-        //chair
-        for (int i = 0; i < 4; i++) {
-            glm::vec3 translation(18.0f, 0.0f, 6.0 + i * 4.4f);  // Translation for the chair
-            glm::vec3 rotation(0.0f,-90.0f, 0.0f);  // Rotation for the chair (pitch, yaw, roll in degrees)
-            drawChairWithTransformations(identityMatrix, globalTranslationMatrix, translation, rotation, lightingShaderWithTexture, ourShader, cylinder_window, cube_floor, viewPos);
-        }
-
-
-        //2nd set
-
-        //chair
-        for (int i = 0; i < 4; i++) {
-            glm::vec3 translation(8.0f, 0.0f, 13.0 + i * 4.4f);  // Translation for the chair
-            glm::vec3 rotation(0.0f, 90.0f, 0.0f);  // Rotation for the chair (pitch, yaw, roll in degrees)
-            drawChairWithTransformations(identityMatrix, globalTranslationMatrix, translation, rotation, lightingShaderWithTexture, ourShader, cylinder_window, cube_floor, viewPos);
-        }
-
-        //table
-        for (int i = 0; i < 4; i++) {
-            glm::vec3 translation(8.5f, 0.0f, 3.1f + i * 4.4f);  // Translation for the table
-            glm::vec3 rotation(0.0f, 0.0f, 0.0f);  // Rotation for the table (pitch, yaw, roll in degrees)
-            drawTableWithTransformations(identityMatrix, globalTranslationMatrix, translation, rotation, lightingShaderWithTexture, ourShader, cube_floor);
+        for (const PlacedMesh& cone : cones) {
+            if (!culler.isVisible(cone.object))
+                continue;
+            if (proceduralPrimitives)
+                cone_chair.drawConeWithTexture(proceduralQueue, scene.world(cone.node), scene.normalMatrix(cone.node), cone.object);
+            else
+                cone_chair.drawConeWithTexture(instanceQueue, scene.world(cone.node), scene.normalMatrix(cone.node), cone.object);
         }
 
-        //chair
-        for (int i = 0; i < 4; i++) {
-            glm::vec3 translation(25.0, 0.0f, 6.0 + i * 4.4f);  // Translation for the chair
-            glm::vec3 rotation(0.0f, -90.0f, 0.0f);  // Rotation for the chair (pitch, yaw, roll in degrees)
-            drawChairWithTransformations(identityMatrix, globalTranslationMatrix, translation, rotation, lightingShaderWithTexture, ourShader, cylinder_window, cube_floor, viewPos);
-        }
+        // chairs, tables and sofas
+        for (const PrefabPlacement& placement : furniture)
+            if (culler.isVisible(placement.object))
+                placement.prefab->draw(instanceQueue, scene.world(placement.node), scene.normalMatrix(placement.node), placement.object);
 
-        //sofa
-        for (int i = 0; i < 3; i++) {
-            glm::vec3 sofaTranslation(-8.0f + i*5.5f, 0.0f, 22.5f);  // Translation for the sofa
-            glm::vec3 sofaRotation(0.0f, 0.0f, 0.0f);  // Rotation for the sofa (pitch, yaw, roll in degrees)
-            drawSofaWithTransformations(identityMatrix, globalTranslationMatrix, sofaTranslation, sofaRotation, lightingShaderWithTexture, ourShader, cube_floor, cube_sofa);
-        }
+        instanceQueue.flush(instancedShaderWithTexture);
+        proceduralQueue.flush([&](bool textured) -> Shader& {
+            return phongShaders.select(currentLightingVariant(textured, true, true));
+        });
         // ************************************************************************************************************************************************
 
         // also draw the lamp object(s)
         ourShader.use();
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
+        ourShader.setVec3("color", glm::vec3(0.8f, 0.8f, 0.8f));
 
         // ************************************************************************ Light ************************************************************************
 
-        // ************************************************************************ Wall Light ************************************************************************
-
-        for (int i = 0; i < 3; i++) {
-            glBindVertexArray(lightCubeVAO1);
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(6.0f + 5*i, 5.2f, 30.0f));
-            rotateMatrix = glm::rotate(translateMatrix, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-            scaleMatrix = glm::scale(rotateMatrix, glm::vec3(1.0f, -0.15f, 1.0f));
-            model = globalTranslationMatrix * scaleMatrix;
-            ourShader.setMat4("model", model);
-            ourShader.setVec3("color", glm::vec3(0.8f, 0.8f, 0.8f));
-            glDrawElements(GL_TRIANGLES, 5000, GL_UNSIGNED_INT, 0);
-        }
-
-        for (int i = 0; i < 3; i++) {
-            glBindVertexArray(lightCubeVAO1);
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(6.0f + 5 * i, 5.2f, 0.75f));
-            rotateMatrix = glm::rotate(translateMatrix, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-            scaleMatrix = glm::scale(rotateMatrix, glm::vec3(1.0f, -0.15f, 1.0f));
-            model = globalTranslationMatrix * scaleMatrix;
-            ourShader.setMat4("model", model);
-            ourShader.setVec3("color", glm::vec3(0.8f, 0.8f, 0.8f));
-            glDrawElements(GL_TRIANGLES, 5000, GL_UNSIGNED_INT, 0);
-        }
-
-        // ************************************************************************ Room Corner Light ************************************************************************
-
-        for (int i = 0; i < 2; i++) {
-            glBindVertexArray(lightCubeVAO);
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, 29.75f - i*29.25f));
-            scaleMatrix = glm::scale(translateMatrix, glm::vec3(0.5f, 15.0f, 0.5f));
-            model = globalTranslationMatrix * scaleMatrix;
-            ourShader.setMat4("model", model);
-            ourShader.setVec3("color", glm::vec3(0.8f, 0.8f, 0.8f));
-            glDrawElements(GL_TRIANGLES, 5000, GL_UNSIGNED_INT, 0);
-        }
-
-        for (int i = 0; i < 2; i++) {
-            glBindVertexArray(lightCubeVAO);
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(23.0f, 0.0f, 29.75f - i * 29.25f));
-            scaleMatrix = glm::scale(translateMatrix, glm::vec3(0.5f, 15.0f, 0.5f));
-            model = globalTranslationMatrix * scaleMatrix;
-            ourShader.setMat4("model", model);
-            ourShader.setVec3("color", glm::vec3(0.8f, 0.8f, 0.8f));
-            glDrawElements(GL_TRIANGLES, 5000, GL_UNSIGNED_INT, 0);
-        }
-
-        for (int i = 0; i < 2; i++) {
-            glBindVertexArray(lightCubeVAO);
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0f, 7.5f, 29.75f - i * 29.25f));
-            scaleMatrix = glm::scale(translateMatrix, glm::vec3(46.0f, -0.5f, 0.5f));
-            model = globalTranslationMatrix * scaleMatrix;
-            ourShader.setMat4("model", model);
-            ourShader.setVec3("color", glm::vec3(0.8f, 0.8f, 0.8f));
-            glDrawElements(GL_TRIANGLES, 5000, GL_UNSIGNED_INT, 0);
-        }
-
-        // ************************************************************************ Table Light ************************************************************************
-
-        for (int i = 0; i < 6; i++) {
-            glBindVertexArray(lightCubeVAO1);
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(1.5f + i * 4.0f, 5.0f, 5.0f));
-            scaleMatrix = glm::scale(translateMatrix, glm::vec3(1.5f, 1.7, 1.5f));
-            model = globalTranslationMatrix * scaleMatrix;
-            ourShader.setMat4("model", model);
-            ourShader.setVec3("color", glm::vec3(0.8f, 0.8f, 0.8f));
-            glDrawElements(GL_TRIANGLES, 5000, GL_UNSIGNED_INT, 0);
-        }
-
-        for (int i = 0; i < 6; i++) {
-            glBindVertexArray(lightCubeVAO1);
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(1.5f + i * 4.0f, 5.0f, 15.0f));
-            scaleMatrix = glm::scale(translateMatrix, glm::vec3(1.5f, 1.7, 1.5f));
-            model = globalTranslationMatrix * scaleMatrix;
-            ourShader.setMat4("model", model);
-            ourShader.setVec3("color", glm::vec3(0.8f, 0.8f, 0.8f));
+        glState().bindVertexArray(lightCubeVAO1);
+        for (const PlacedMesh& lamp : lamps) {
+            if (!culler.isVisible(lamp.object))
+                continue;
+            ourShader.setMat4("model", scene.world(lamp.node));
             glDrawElements(GL_TRIANGLES, 5000, GL_UNSIGNED_INT, 0);
         }
 
-        for (int i = 0; i < 6; i++) {
-            glBindVertexArray(lightCubeVAO1);
-            translateMatrix = glm::translate(identityMatrix, glm::vec3(1.5f + i * 4.0f, 5.0f, 25.0f));
-            scaleMatrix = glm::scale(translateMatrix, glm::vec3(1.5f, 1.7, 1.5f));
-            model = globalTranslationMatrix * scaleMatrix;
-            ourShader.setMat4("model", model);
-            ourShader.setVec3("color", glm::vec3(0.8f, 0.8f, 0.8f));
+        glState().bindVertexArray(lightCubeVAO);
+        for (const PlacedMesh& cornerLight : cornerLights) {
+            if (!culler.isVisible(cornerLight.object))
+                continue;
+            ourShader.setMat4("model", scene.world(cornerLight.node));
             glDrawElements(GL_TRIANGLES, 5000, GL_UNSIGNED_INT, 0);
         }
 
@@ -1635,16 +1957,38 @@ int main()
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
         glfwPollEvents();
+
+        if (renderStats().getFrameCount() == 0)
+        {
+            renderStats().reportStartup(std::chrono::duration<double>(std::chrono::steady_clock::now() - processStart).count());
+            geometryArena().printUsage();
+        }
+        renderStats().endFrame(glfwGetTime());
     }
 
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
-    glDeleteVertexArrays(1, &cubeVAO);
-    glDeleteVertexArrays(1, &lightCubeVAO);
-    glDeleteVertexArrays(1, &lightCubeVAO1);
-    glDeleteVertexArrays(1, &lightCubeVAO2);
+    glState().deleteVertexArrays(1, &cubeVAO);
+    glState().deleteVertexArrays(1, &lightCubeVAO);
+    glState().deleteVertexArrays(1, &lightCubeVAO1);
+    glState().deleteVertexArrays(1, &lightCubeVAO2);
     glDeleteBuffers(1, &cubeVBO);
     glDeleteBuffers(1, &cubeEBO);
+    lights.releaseBuffer();
+    materialRegistry().releaseBuffer();
+    staticScenery.release();
+    sceneryWithDoorway.release();
+    chair.release();
+    table.release();
+    sofa.release();
+    instanceQueue.release();
+    proceduralQueue.release();
+    textureArrays().release();
+    geometryArena().release();
+
+    shaderCompileThread().stop();
+    if (compileContext != nullptr)
+        glfwDestroyWindow(compileContext);
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -1656,14 +2000,11 @@ void drawCube(unsigned int& cubeVAO, Shader& lightingShader, glm::mat4 model = g
 {
     lightingShader.use();
 
-    lightingShader.setVec3("material.ambient", glm::vec3(r, g, b));
-    lightingShader.setVec3("material.diffuse", glm::vec3(r, g, b));
-    lightingShader.setVec3("material.specular", glm::vec3(r, g, b));
-    lightingShader.setFloat("material.shininess", 32.0f);
+    lightingShader.setMaterial(registerMaterial(glm::vec3(r, g, b), glm::vec3(r, g, b), glm::vec3(r, g, b), 32.0f));
 
-    lightingShader.setMat4("model", model);
+    lightingShader.setModel(model);
 
-    glBindVertexArray(cubeVAO);
+    glState().bindVertexArray(cubeVAO);
     glDrawElements(GL_TRIANGLES, 5000, GL_UNSIGNED_INT, 0);
 }
 
@@ -1734,101 +2075,80 @@ void processInput(GLFWwindow* window)
 
     if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS)
     {
-        pointlight1.turnOff();
-        pointlight2.turnOff();
-        pointlight3.turnOff();
-        pointlight4.turnOff();
-        directionalLightOn = false;
-        spotLightOn = false;
+        for (PointLight& light : lights.getPointLights())
+            light.turnOff();
+        lights.directionalLight.on = false;
+        lights.spotLight.on = false;
     }
     if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS)
     {
-        pointlight1.turnOn();
-        pointlight2.turnOn();
-        pointlight3.turnOn();
-        pointlight4.turnOn();
-        directionalLightOn = true;
-        spotLightOn = true;
+        for (PointLight& light : lights.getPointLights())
+            light.turnOn();
+        lights.directionalLight.on = true;
+        lights.spotLight.on = true;
     }
     if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS)
     {
-        pointlight1.turnOff();
-        pointlight2.turnOff();
-        pointlight3.turnOff();
-        pointlight4.turnOff();
+        for (PointLight& light : lights.getPointLights())
+            light.turnOff();
     }
     if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS)
     {
-        pointlight1.turnOn();
-        pointlight2.turnOn();
-        pointlight3.turnOn();
-        pointlight4.turnOn();
+        for (PointLight& light : lights.getPointLights())
+            light.turnOn();
     }
     if (glfwGetKey(window, GLFW_KEY_0) == GLFW_PRESS)
     {
-        pointlight1.turnOn();
-        pointlight3.turnOff();
-        pointlight2.turnOff();
-        pointlight4.turnOff();
+        for (PointLight& light : lights.getPointLights())
+            light.turnOff();
+        lights.getPointLight(0).turnOn();
     }
     if (glfwGetKey(window, GLFW_KEY_5) == GLFW_PRESS)
     {
-        directionalLightOn = false;
+        lights.directionalLight.on = false;
     }
     if (glfwGetKey(window, GLFW_KEY_6) == GLFW_PRESS)
     {
-        directionalLightOn = true;
+        lights.directionalLight.on = true;
     }
     if (glfwGetKey(window, GLFW_KEY_7) == GLFW_PRESS)
     {
-        spotLightOn = false;
+        lights.spotLight.on = false;
     }
     if (glfwGetKey(window, GLFW_KEY_8) == GLFW_PRESS)
     {
-        spotLightOn = true;
+        lights.spotLight.on = true;
     }
 
     if (glfwGetKey(window, GLFW_KEY_KP_1) == GLFW_PRESS)
     {
-        pointlight1.turnAmbientOff();
-        pointlight2.turnAmbientOff();
-        pointlight3.turnAmbientOff();
-        pointlight4.turnAmbientOff();
+        for (PointLight& light : lights.getPointLights())
+            light.turnAmbientOff();
     }
     if (glfwGetKey(window, GLFW_KEY_KP_2) == GLFW_PRESS)
     {
-        pointlight1.turnAmbientOn();
-        pointlight2.turnAmbientOn();
-        pointlight3.turnAmbientOn();
-        pointlight4.turnAmbientOn();
+        for (PointLight& light : lights.getPointLights())
+            light.turnAmbientOn();
     }
     if (glfwGetKey(window, GLFW_KEY_KP_3) == GLFW_PRESS)
     {
-        pointlight1.turnDiffuseOff();
-        pointlight2.turnDiffuseOff();
-        pointlight3.turnDiffuseOff();
-        pointlight4.turnDiffuseOff();
+        for (PointLight& light : lights.getPointLights())
+            light.turnDiffuseOff();
     }
     if (glfwGetKey(window, GLFW_KEY_KP_4) == GLFW_PRESS)
     {
-        pointlight1.turnDiffuseOn();
-        pointlight2.turnDiffuseOn();
-        pointlight3.turnDiffuseOn();
-        pointlight4.turnDiffuseOn();
+        for (PointLight& light : lights.getPointLights())
+            light.turnDiffuseOn();
     }
     if (glfwGetKey(window, GLFW_KEY_KP_5) == GLFW_PRESS)
     {
-        pointlight1.turnSpecularOff();
-        pointlight2.turnSpecularOff();
-        pointlight3.turnSpecularOff();
-        pointlight4.turnSpecularOff();
+        for (PointLight& light : lights.getPointLights())
+            light.turnSpecularOff();
     }
     if (glfwGetKey(window, GLFW_KEY_KP_6) == GLFW_PRESS)
     {
-        pointlight1.turnSpecularOn();
-        pointlight2.turnSpecularOn();
-        pointlight3.turnSpecularOn();
-        pointlight4.turnSpecularOn();
+        for (PointLight& light : lights.getPointLights())
+            light.turnSpecularOn();
     }
 
     if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS)
@@ -1839,6 +2159,58 @@ void processInput(GLFWwindow* window)
     {
         fanOn = false;
     }
+
+    if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS && !staticBatching)
+    {
+        staticBatching = true;
+        renderStats().mode = "static batching on";
+        renderStats().restartFrameTimes();
+    }
+    if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS && staticBatching)
+    {
+        staticBatching = false;
+        renderStats().mode = "static batching off";
+        renderStats().restartFrameTimes();
+    }
+
+    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS && !proceduralPrimitives)
+    {
+        proceduralPrimitives = true;
+        renderStats().restartFrameTimes();
+    }
+    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS && proceduralPrimitives)
+    {
+        proceduralPrimitives = false;
+        renderStats().restartFrameTimes();
+    }
+
+    // once per press, not once per frame the key is down
+    static bool pickKeyDown = false;
+    bool pickKey = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+    if (pickKey && !pickKeyDown)
+        pickRequested = true;
+    pickKeyDown = pickKey;
+
+    if (glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS && !frustumCulling)
+    {
+        frustumCulling = true;
+        renderStats().restartFrameTimes();
+    }
+    if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS && frustumCulling)
+    {
+        frustumCulling = false;
+        renderStats().restartFrameTimes();
+    }
+    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS && !occlusionCulling)
+    {
+        occlusionCulling = true;
+        renderStats().restartFrameTimes();
+    }
+    if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS && occlusionCulling)
+    {
+        occlusionCulling = false;
+        renderStats().restartFrameTimes();
+    }
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -1941,11 +2313,11 @@ unsigned int loadTexture(char const* path, GLenum textureWrappingModeS, GLenum t
         else if (nrComponents == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        glState().bindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        glState().bindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -1954,6 +2326,7 @@ unsigned int loadTexture(char const* path, GLenum textureWrappingModeS, GLenum t
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, textureFilteringModeMin);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, textureFilteringModeMax);
 
+        textureArrays().add(textureID, path, data, width, height, nrComponents);
         stbi_image_free(data);
     }
     else
@@ -1962,5 +2335,8 @@ unsigned int loadTexture(char const* path, GLenum textureWrappingModeS, GLenum t
         stbi_image_free(data);
     }
 
+    // shaders are still compiling in the background; note the ones that are done
+    shaderBuildQueue().poll();
+
     return textureID;
 }
\ No newline at end of file
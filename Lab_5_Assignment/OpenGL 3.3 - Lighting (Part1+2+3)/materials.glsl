@@ -0,0 +1,19 @@
+// every material of the scene, filled by MaterialRegistry; std140 layout
+// must match MaterialData in materials.h
+struct MaterialData {
+    vec4 ambient;   // w is the texture array layer of the diffuse map
+    vec4 diffuse;   // w is the texture array layer of the specular map
+    vec4 specular;  // w is the shininess
+};
+
+// capacity only, MaterialRegistry adds entries as primitives ask for them
+#define MAX_MATERIALS 256
+
+layout (std140) uniform Materials
+{
+    MaterialData materials[MAX_MATERIALS];
+};
+
+// row of the table the current draw uses; instanced draws read it per
+// instance instead, see vertexShaderForPhongShading.vs
+uniform int materialIndex;
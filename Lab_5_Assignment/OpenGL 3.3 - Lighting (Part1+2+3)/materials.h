@@ -0,0 +1,189 @@
+//
+//  materials.h
+//  test
+//
+//  Every material of the scene in one table, mirrored into the Materials
+//  uniform block. Primitives only keep an index into the table and the Phong
+//  shaders look the colours up by that index, so a draw sets one int instead
+//  of four material uniforms and editing a material is one buffer write.
+//  Primitives with the same material values share an entry.
+//
+
+#ifndef materials_h
+#define materials_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <iostream>
+
+#include "uniformBlocks.h"
+#include "renderStats.h"
+#include "textureArrays.h"
+
+// capacity of the materials array in the Materials block; 256 entries of
+// 48 bytes stay well below the 16 KB every GL 3.3 driver allows for a block
+#define MAX_MATERIALS 256
+
+// entry 0 is a plain grey, used when the table is full
+const unsigned int DEFAULT_MATERIAL = 0;
+
+struct MaterialDescription {
+    glm::vec3 ambient = glm::vec3(0.0f);
+    glm::vec3 diffuse = glm::vec3(0.0f);
+    glm::vec3 specular = glm::vec3(0.0f);
+    float shininess = 0.0f;
+    // texture maps can't live in a GL 3.3 buffer; they are still bound per
+    // draw (or their texture arrays are, see textureArrays.h) and tell
+    // materials with the same colours apart
+    unsigned int diffuseMap = 0;
+    unsigned int specularMap = 0;
+
+    bool operator==(const MaterialDescription& other) const
+    {
+        return ambient == other.ambient && diffuse == other.diffuse && specular == other.specular
+            && shininess == other.shininess && diffuseMap == other.diffuseMap && specularMap == other.specularMap;
+    }
+};
+
+// std140 mirror of MaterialData in materials.glsl; shininess rides in
+// specular.w, the texture array layers of the maps in ambient.w and diffuse.w
+struct MaterialData {
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+};
+
+static_assert(sizeof(MaterialData) == 48, "MaterialData must match std140");
+
+class MaterialRegistry {
+public:
+    MaterialRegistry()
+    {
+        MaterialDescription grey;
+        grey.ambient = glm::vec3(0.2f);
+        grey.diffuse = glm::vec3(0.8f);
+        grey.specular = glm::vec3(0.5f);
+        grey.shininess = 32.0f;
+        add(grey);
+    }
+    MaterialRegistry(const MaterialRegistry&) = delete;
+    MaterialRegistry& operator=(const MaterialRegistry&) = delete;
+
+    // index of a material with these values, adding it the first time they
+    // are seen; a scene only has a handful, so a linear search will do
+    unsigned int add(const MaterialDescription& material)
+    {
+        for (size_t i = 0; i < descriptions.size(); ++i)
+        {
+            if (descriptions[i] == material)
+                return (unsigned int)i;
+        }
+        if (descriptions.size() >= MAX_MATERIALS)
+        {
+            std::cout << "WARNING::MATERIAL_REGISTRY::TOO_MANY_MATERIALS" << std::endl;
+            return DEFAULT_MATERIAL;
+        }
+        descriptions.push_back(material);
+        markDirty(descriptions.size() - 1);
+        return (unsigned int)descriptions.size() - 1;
+    }
+
+    // change a material in place; every primitive using it follows
+    void set(unsigned int index, const MaterialDescription& material)
+    {
+        if (descriptions[index] == material)
+            return;
+        descriptions[index] = material;
+        markDirty(index);
+    }
+
+    const MaterialDescription& get(unsigned int index) const { return descriptions[index]; }
+    size_t size() const { return descriptions.size(); }
+
+    // write the entries added or changed since the last call as one range;
+    // call once a frame before drawing
+    void upload()
+    {
+        if (!buffer)
+        {
+            // created lazily so the registry can fill up before the GL context exists
+            buffer.reset(new UniformBuffer(MATERIALS_BLOCK_BINDING, MAX_MATERIALS * sizeof(MaterialData)));
+            dirtyBegin = 0;
+            dirtyEnd = descriptions.size();
+        }
+        if (dirtyBegin >= dirtyEnd)
+            return;
+
+        staging.resize(dirtyEnd - dirtyBegin);
+        for (size_t i = dirtyBegin; i < dirtyEnd; ++i)
+        {
+            const MaterialDescription& material = descriptions[i];
+            MaterialData& data = staging[i - dirtyBegin];
+            data.ambient = glm::vec4(material.ambient, (float)layerOf(material.diffuseMap));
+            data.diffuse = glm::vec4(material.diffuse, (float)layerOf(material.specularMap));
+            data.specular = glm::vec4(material.specular, material.shininess);
+        }
+        buffer->update(dirtyBegin * sizeof(MaterialData), staging.size() * sizeof(MaterialData), staging.data());
+        dirtyBegin = dirtyEnd = 0;
+        renderStats().materialBufferUploads++;
+    }
+
+    // drop the buffer while the context is still alive
+    void releaseBuffer()
+    {
+        buffer.reset();
+    }
+
+private:
+    std::vector<MaterialDescription> descriptions;
+    std::vector<MaterialData> staging;
+    std::unique_ptr<UniformBuffer> buffer;
+    // entries [dirtyBegin, dirtyEnd) differ from the buffer
+    size_t dirtyBegin = 0;
+    size_t dirtyEnd = 0;
+
+    // -1 when the map isn't in a texture array (or there is none)
+    static int layerOf(unsigned int texture)
+    {
+        GLuint array;
+        int layer;
+        return texture != 0 && textureArrays().find(texture, array, layer) ? layer : -1;
+    }
+
+    void markDirty(size_t index)
+    {
+        if (dirtyBegin >= dirtyEnd)
+        {
+            dirtyBegin = index;
+            dirtyEnd = index + 1;
+            return;
+        }
+        dirtyBegin = std::min(dirtyBegin, index);
+        dirtyEnd = std::max(dirtyEnd, index + 1);
+    }
+};
+
+inline MaterialRegistry& materialRegistry()
+{
+    static MaterialRegistry registry;
+    return registry;
+}
+
+// shorthand for the primitives: the table index of a material with these values
+inline unsigned int registerMaterial(glm::vec3 amb, glm::vec3 diff, glm::vec3 spec, float shiny, unsigned int dMap = 0, unsigned int sMap = 0)
+{
+    MaterialDescription material;
+    material.ambient = amb;
+    material.diffuse = diff;
+    material.specular = spec;
+    material.shininess = shiny;
+    material.diffuseMap = dMap;
+    material.specularMap = sMap;
+    return materialRegistry().add(material);
+}
+
+#endif /* materials_h */
@@ -0,0 +1,104 @@
+//
+//  meshBuilder.h
+//  test
+//
+//  Merges meshes that are already in the geometry arena into a new one.
+//  Each appended mesh is read back from the arena and its vertices are
+//  moved by a model matrix on the way, so several objects become one mesh
+//  that draws with a single transform. Used at load time by StaticBatch and
+//  Prefab; reading back from the GPU is far too slow for a frame.
+//
+
+#ifndef meshBuilder_h
+#define meshBuilder_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+#include "geometryArena.h"
+#include "boundingBox.h"
+
+class MeshBuilder {
+public:
+    static const size_t FLOATS_PER_VERTEX = 8;
+
+    // append the first count indices (all of them when count is negative)
+    // of an arena mesh, with positions moved by model and normals by
+    // normalMatrix; false when the mesh isn't LAYOUT_POSITION_NORMAL_TEXCOORD
+    bool append(unsigned int geometry, GLsizei count, const glm::mat4& model, const glm::mat3& normalMatrix)
+    {
+        if (geometryArena().get(geometry).layout != LAYOUT_POSITION_NORMAL_TEXCOORD)
+        {
+            std::cout << "WARNING::MESH_BUILDER::UNSUPPORTED_LAYOUT, only textured meshes can be merged" << std::endl;
+            return false;
+        }
+        if (geometry != cachedGeometry)
+        {
+            geometryArena().read(geometry, meshVertices, meshIndices);
+            cachedGeometry = geometry;
+        }
+        size_t indexCount = count < 0 ? meshIndices.size() : std::min((size_t)count, meshIndices.size());
+
+        unsigned int baseVertex = (unsigned int)getVertexCount();
+        for (size_t i = 0; i < meshVertices.size(); i += FLOATS_PER_VERTEX)
+        {
+            glm::vec3 position = glm::vec3(model * glm::vec4(meshVertices[i], meshVertices[i + 1], meshVertices[i + 2], 1.0f));
+            glm::vec3 normal = normalMatrix * glm::vec3(meshVertices[i + 3], meshVertices[i + 4], meshVertices[i + 5]);
+            float vertex[FLOATS_PER_VERTEX] = {
+                position.x, position.y, position.z,
+                normal.x, normal.y, normal.z,
+                meshVertices[i + 6], meshVertices[i + 7]
+            };
+            vertices.insert(vertices.end(), vertex, vertex + FLOATS_PER_VERTEX);
+        }
+        for (size_t i = 0; i < indexCount; ++i)
+            indices.push_back(baseVertex + meshIndices[i]);
+        return true;
+    }
+
+    size_t getVertexCount() const { return vertices.size() / FLOATS_PER_VERTEX; }
+
+    // a sphere around everything appended so far: the centre of the box
+    // around the vertices, the radius to the farthest one
+    void boundingSphere(glm::vec3& centre, float& radius) const
+    {
+        centre = glm::vec3(0.0f);
+        radius = 0.0f;
+        if (vertices.empty())
+            return;
+        centre = bounds().centre();
+        for (size_t i = 0; i < vertices.size(); i += FLOATS_PER_VERTEX)
+            radius = std::max(radius, glm::length(glm::vec3(vertices[i], vertices[i + 1], vertices[i + 2]) - centre));
+    }
+    size_t getIndexCount() const { return indices.size(); }
+
+    // the box around everything appended so far
+    BoundingBox bounds() const
+    {
+        return BoundingBox::ofPositions(vertices.data(), getVertexCount(), FLOATS_PER_VERTEX);
+    }
+
+    // copy what was appended into the arena and start over; returns the arena id
+    unsigned int upload()
+    {
+        unsigned int geometry = geometryArena().add(LAYOUT_POSITION_NORMAL_TEXCOORD, vertices.data(), (GLsizei)getVertexCount(),
+            indices.data(), (GLsizei)indices.size());
+        vertices.clear();
+        indices.clear();
+        return geometry;
+    }
+
+private:
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    // the last mesh read back, kept because the same part is usually appended many times in a row
+    unsigned int cachedGeometry = ~0u;
+    std::vector<float> meshVertices;
+    std::vector<unsigned int> meshIndices;
+};
+
+#endif /* meshBuilder_h */
@@ -0,0 +1,350 @@
+//
+//  meshOptimizer.h
+//  test
+//
+//  Reorders the triangles and vertices of a mesh before it is uploaded.
+//  The generators emit their triangles row by row (spheres, cylinders) or
+//  as long fans around one vertex (caps, cones), which keeps only a few of
+//  the vertices a triangle needs in the post-transform cache. Three passes,
+//  in this order:
+//
+//    vertex cache   Tom Forsyth's "Linear-Speed Vertex Cache Optimisation":
+//                   greedily emit the triangle whose vertices score best,
+//                   the score favouring vertices still in a simulated LRU
+//                   cache and vertices with few triangles left
+//    overdraw       split that order into clusters where the cache starts
+//                   cold anyway and draw the clusters facing away from the
+//                   mesh centre first (Sander, Nehab and Barczak, "Fast
+//                   Triangle Reordering for Vertex Locality and Reduced
+//                   Overdraw"), so the near side of a closed shape hides
+//                   the far side
+//    vertex fetch   renumber the vertices in the order the indices first
+//                   use them, so the vertex buffer is read front to back
+//
+//  The average cache miss ratio (ACMR, vertices transformed per triangle
+//  with a FIFO cache) of every mesh before and after is summed into the
+//  startup report.
+//
+
+#ifndef meshOptimizer_h
+#define meshOptimizer_h
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "renderStats.h"
+
+class MeshOptimizer {
+public:
+    // off: meshes are uploaded in the order they were generated
+    bool enabled = true;
+    bool reorderForOverdraw = true;
+    // entries of the FIFO the ACMR is measured with, about what a GL 3.3
+    // class GPU keeps of transformed vertices
+    unsigned int fifoCacheSize = 16;
+
+    MeshOptimizer() = default;
+    MeshOptimizer(const MeshOptimizer&) = delete;
+    MeshOptimizer& operator=(const MeshOptimizer&) = delete;
+
+    // every pass on a mesh of interleaved float vertices with the position
+    // in the first three floats; vertices the indices don't use are dropped
+    void optimize(std::vector<float>& vertices, size_t floatsPerVertex, std::vector<unsigned int>& indices)
+    {
+        size_t vertexCount = vertices.size() / floatsPerVertex;
+        size_t before = cacheMisses(indices, vertexCount);
+        if (enabled)
+        {
+            optimizeVertexCache(indices, vertexCount);
+            if (reorderForOverdraw)
+                optimizeOverdraw(indices, vertices, floatsPerVertex);
+            optimizeVertexFetch(vertices, floatsPerVertex, indices);
+        }
+        record(before, cacheMisses(indices, vertices.size() / floatsPerVertex), indices.size() / 3);
+    }
+
+    // only the triangle order, for index buffers over vertices that other
+    // meshes share too (the lamp shapes in main.cpp)
+    void optimizeIndices(std::vector<unsigned int>& indices, size_t vertexCount)
+    {
+        size_t before = cacheMisses(indices, vertexCount);
+        if (enabled)
+            optimizeVertexCache(indices, vertexCount);
+        record(before, cacheMisses(indices, vertexCount), indices.size() / 3);
+    }
+
+    // vertices transformed for these indices with a FIFO post-transform cache
+    size_t cacheMisses(const std::vector<unsigned int>& indices, size_t vertexCount) const
+    {
+        // the time each vertex entered the FIFO; it is still in it while
+        // fewer than fifoCacheSize vertices entered after it
+        std::vector<size_t> entered(vertexCount, 0);
+        size_t clock = fifoCacheSize + 1, misses = 0;
+        for (unsigned int index : indices)
+        {
+            if (index >= vertexCount)
+                continue;
+            if (clock - entered[index] > fifoCacheSize)
+            {
+                entered[index] = clock++;
+                ++misses;
+            }
+        }
+        return misses;
+    }
+
+    void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount) const;
+    void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<float>& vertices, size_t floatsPerVertex) const;
+    void optimizeVertexFetch(std::vector<float>& vertices, size_t floatsPerVertex, std::vector<unsigned int>& indices) const;
+
+private:
+    // size of the LRU cache Forsyth's scores simulate
+    static const int FORSYTH_CACHE_SIZE = 32;
+
+    void record(size_t missesBefore, size_t missesAfter, size_t triangles)
+    {
+        renderStats().meshesOptimized++;
+        renderStats().optimizedTriangles += (unsigned int)triangles;
+        renderStats().cacheMissesBefore += (unsigned int)missesBefore;
+        renderStats().cacheMissesAfter += (unsigned int)missesAfter;
+    }
+
+    // how much a vertex wants its triangles drawn next; cachePosition is
+    // -1 when it isn't in the cache
+    static float vertexScore(int cachePosition, unsigned int trianglesLeft)
+    {
+        if (trianglesLeft == 0)
+            return -1.0f;
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            // the last triangle's vertices are scored alike, so the order
+            // inside it doesn't decide the next one
+            if (cachePosition < 3)
+                score = 0.75f;
+            else
+                score = std::pow(1.0f - (float)(cachePosition - 3) / (FORSYTH_CACHE_SIZE - 3), 1.5f);
+        }
+        // finish off vertices with few triangles left so they leave the cache for good
+        return score + 2.0f / std::sqrt((float)trianglesLeft);
+    }
+};
+
+inline void MeshOptimizer::optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount) const
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // triangles of every vertex, as offsets into one list
+    std::vector<unsigned int> trianglesLeft(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+        trianglesLeft[indices[i]]++;
+    std::vector<size_t> firstTriangle(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v)
+        firstTriangle[v + 1] = firstTriangle[v] + trianglesLeft[v];
+    std::vector<unsigned int> vertexTriangles(triangleCount * 3);
+    std::vector<size_t> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t t = 0; t < triangleCount; ++t)
+        for (int corner = 0; corner < 3; ++corner)
+            vertexTriangles[filled[indices[t * 3 + corner]]++] = (unsigned int)t;
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+        score[v] = vertexScore(-1, trianglesLeft[v]);
+    std::vector<bool> emitted(triangleCount, false);
+
+    std::vector<unsigned int> result;
+    result.reserve(triangleCount * 3);
+    // three more slots than the cache so the triangle just added always fits
+    std::vector<unsigned int> cache, nextCache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    nextCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+    size_t scanFrom = 0;
+    long best = 0;
+    while (best >= 0)
+    {
+        unsigned int triangle = (unsigned int)best;
+        emitted[triangle] = true;
+        nextCache.clear();
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            unsigned int vertex = indices[triangle * 3 + corner];
+            result.push_back(vertex);
+            nextCache.push_back(vertex);
+            // take the triangle out of the vertex's list
+            size_t begin = firstTriangle[vertex], end = begin + trianglesLeft[vertex];
+            for (size_t i = begin; i < end; ++i)
+            {
+                if (vertexTriangles[i] == triangle)
+                {
+                    std::swap(vertexTriangles[i], vertexTriangles[end - 1]);
+                    break;
+                }
+            }
+            trianglesLeft[vertex]--;
+        }
+        for (unsigned int vertex : cache)
+        {
+            if (vertex != nextCache[0] && vertex != nextCache[1] && vertex != nextCache[2])
+                nextCache.push_back(vertex);
+        }
+        // whatever fell off the end is out of the cache
+        for (size_t i = FORSYTH_CACHE_SIZE; i < nextCache.size(); ++i)
+        {
+            cachePosition[nextCache[i]] = -1;
+            score[nextCache[i]] = vertexScore(-1, trianglesLeft[nextCache[i]]);
+        }
+        if (nextCache.size() > (size_t)FORSYTH_CACHE_SIZE)
+            nextCache.resize(FORSYTH_CACHE_SIZE);
+        cache.swap(nextCache);
+
+        // rescore the cached vertices and their triangles, keeping the best
+        for (size_t i = 0; i < cache.size(); ++i)
+        {
+            cachePosition[cache[i]] = (int)i;
+            score[cache[i]] = vertexScore((int)i, trianglesLeft[cache[i]]);
+        }
+        best = -1;
+        float bestScore = -1.0f;
+        for (unsigned int vertex : cache)
+        {
+            size_t begin = firstTriangle[vertex], end = begin + trianglesLeft[vertex];
+            for (size_t i = begin; i < end; ++i)
+            {
+                unsigned int candidate = vertexTriangles[i];
+                float candidateScore = score[indices[candidate * 3]] + score[indices[candidate * 3 + 1]] + score[indices[candidate * 3 + 2]];
+                if (candidateScore > bestScore)
+                {
+                    bestScore = candidateScore;
+                    best = candidate;
+                }
+            }
+        }
+        // nothing left next to the cache: start over at the next triangle not drawn yet
+        if (best < 0)
+        {
+            while (scanFrom < triangleCount && emitted[scanFrom])
+                ++scanFrom;
+            if (scanFrom < triangleCount)
+                best = (long)scanFrom;
+        }
+    }
+    indices.swap(result);
+}
+
+inline void MeshOptimizer::optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<float>& vertices, size_t floatsPerVertex) const
+{
+    size_t triangleCount = indices.size() / 3;
+    size_t vertexCount = vertices.size() / floatsPerVertex;
+    if (triangleCount < 2)
+        return;
+    auto position = [&](unsigned int vertex) {
+        const float* p = &vertices[(size_t)vertex * floatsPerVertex];
+        return glm::vec3(p[0], p[1], p[2]);
+    };
+
+    // a cluster starts where a triangle misses the FIFO on all three
+    // vertices; moving it costs the cache nothing it had
+    std::vector<size_t> clusterStart;
+    std::vector<size_t> entered(vertexCount, 0);
+    size_t clock = fifoCacheSize + 1;
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        int misses = 0;
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            unsigned int vertex = indices[t * 3 + corner];
+            if (clock - entered[vertex] > fifoCacheSize)
+            {
+                entered[vertex] = clock++;
+                ++misses;
+            }
+        }
+        if (t == 0 || misses == 3)
+            clusterStart.push_back(t);
+    }
+    if (clusterStart.size() < 2)
+        return;
+    clusterStart.push_back(triangleCount);
+
+    // area weighted centres and normals
+    glm::vec3 meshCentre(0.0f);
+    float meshArea = 0.0f;
+    std::vector<glm::vec3> clusterCentre(clusterStart.size() - 1, glm::vec3(0.0f));
+    std::vector<glm::vec3> clusterNormal(clusterStart.size() - 1, glm::vec3(0.0f));
+    std::vector<float> clusterArea(clusterStart.size() - 1, 0.0f);
+    for (size_t c = 0; c + 1 < clusterStart.size(); ++c)
+    {
+        for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; ++t)
+        {
+            glm::vec3 a = position(indices[t * 3]), b = position(indices[t * 3 + 1]), d = position(indices[t * 3 + 2]);
+            glm::vec3 normal = glm::cross(b - a, d - a);
+            float area = glm::length(normal);
+            glm::vec3 centre = (a + b + d) / 3.0f;
+            clusterCentre[c] += centre * area;
+            clusterNormal[c] += normal;
+            clusterArea[c] += area;
+        }
+        meshCentre += clusterCentre[c];
+        meshArea += clusterArea[c];
+    }
+    if (meshArea <= 0.0f)
+        return;
+    meshCentre /= meshArea;
+
+    // how far a cluster faces away from the middle of the mesh; the most
+    // outward ones go first
+    std::vector<float> outward(clusterArea.size(), 0.0f);
+    std::vector<size_t> order(clusterArea.size());
+    for (size_t c = 0; c < order.size(); ++c)
+    {
+        order[c] = c;
+        if (clusterArea[c] > 0.0f)
+        {
+            float normalLength = glm::length(clusterNormal[c]);
+            if (normalLength > 0.0f)
+                outward[c] = glm::dot(clusterCentre[c] / clusterArea[c] - meshCentre, clusterNormal[c] / normalLength);
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return outward[a] > outward[b]; });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (size_t c : order)
+        result.insert(result.end(), indices.begin() + clusterStart[c] * 3, indices.begin() + clusterStart[c + 1] * 3);
+    indices.swap(result);
+}
+
+inline void MeshOptimizer::optimizeVertexFetch(std::vector<float>& vertices, size_t floatsPerVertex, std::vector<unsigned int>& indices) const
+{
+    size_t vertexCount = vertices.size() / floatsPerVertex;
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> remap(vertexCount, unused);
+    std::vector<float> result;
+    result.reserve(vertices.size());
+    unsigned int next = 0;
+    for (unsigned int& index : indices)
+    {
+        if (remap[index] == unused)
+        {
+            remap[index] = next++;
+            result.insert(result.end(), vertices.begin() + (size_t)index * floatsPerVertex, vertices.begin() + ((size_t)index + 1) * floatsPerVertex);
+        }
+        index = remap[index];
+    }
+    vertices.swap(result);
+}
+
+inline MeshOptimizer& meshOptimizer()
+{
+    static MeshOptimizer optimizer;
+    return optimizer;
+}
+
+#endif /* meshOptimizer_h */
@@ -0,0 +1,145 @@
+//
+//  meshRegistry.h
+//  test
+//
+//  Geometry of the generated primitives, shared between every primitive
+//  built with the same generator parameters. The six cylinders of the room
+//  differ only in their textures, so they now hold one mesh between them
+//  instead of six copies of the same vertices. Materials stay on the
+//  primitive (see materials.h); a mesh is only a range of the geometry arena.
+//
+
+#ifndef meshRegistry_h
+#define meshRegistry_h
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+
+#include "glState.h"
+#include "geometryArena.h"
+#include "meshOptimizer.h"
+#include "renderStats.h"
+#include "boundingBox.h"
+
+// a range of the geometry arena (see geometryArena.h) holding the vertices
+// and indices of one generated shape
+struct Mesh {
+    unsigned int geometry = 0;
+    bool uploaded = false;
+    GLsizei vertexCount = 0;
+    GLsizei indexCount = 0;
+    // box around the positions, in the mesh's own space
+    BoundingBox bounds;
+
+    Mesh() = default;
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+    ~Mesh()
+    {
+        if (uploaded)
+            geometryArena().remove(geometry);
+    }
+
+    // reorder the geometry for the caches (see meshOptimizer.h) and copy it
+    // into the arena; called once from the build function
+    void setData(VertexLayout layout, const float* vertices, GLsizei count, const unsigned int* indices, GLsizei indexTotal)
+    {
+        size_t floats = (size_t)floatsPerVertex(layout);
+        std::vector<float> optimizedVertices(vertices, vertices + (size_t)count * floats);
+        std::vector<unsigned int> optimizedIndices(indices, indices + indexTotal);
+        meshOptimizer().optimize(optimizedVertices, floats, optimizedIndices);
+
+        vertexCount = (GLsizei)(optimizedVertices.size() / floats);
+        indexCount = indexTotal;
+        bounds = BoundingBox::ofPositions(optimizedVertices.data(), (size_t)vertexCount, floats);
+        geometry = geometryArena().add(layout, optimizedVertices.data(), vertexCount, optimizedIndices.data(), indexCount);
+        uploaded = true;
+    }
+
+    // draw the first count indices, or all of them
+    void draw(GLsizei count = -1) const
+    {
+        geometryArena().draw(geometry, count);
+    }
+};
+
+// ref-counted; the mesh goes away with the last primitive that holds it
+typedef std::shared_ptr<const Mesh> MeshHandle;
+
+// generator name followed by the raw bytes of every parameter that changes
+// the generated vertices
+class MeshKey {
+public:
+    explicit MeshKey(const char* generator) : key(generator)
+    {
+        key.push_back('\0');
+    }
+
+    MeshKey& operator<<(float value) { return append(&value, sizeof(value)); }
+    MeshKey& operator<<(int value) { return append(&value, sizeof(value)); }
+
+    const std::string& str() const { return key; }
+
+private:
+    std::string key;
+
+    MeshKey& append(const void* value, size_t bytes)
+    {
+        key.append((const char*)value, bytes);
+        return *this;
+    }
+};
+
+class MeshRegistry {
+public:
+    // the mesh for these parameters; build fills a fresh mesh the first time
+    // they are asked for, later requests share it while anyone still holds it
+    MeshHandle acquire(const MeshKey& key, const std::function<void(Mesh&)>& build)
+    {
+        auto it = meshes.find(key.str());
+        if (it != meshes.end())
+        {
+            MeshHandle mesh = it->second.lock();
+            if (mesh)
+            {
+                renderStats().meshesShared++;
+                return mesh;
+            }
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+        build(*mesh);
+        renderStats().meshesBuilt++;
+        renderStats().meshBuildSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        meshes[key.str()] = mesh;
+        return mesh;
+    }
+
+    // meshes still held by at least one primitive
+    size_t size() const
+    {
+        size_t count = 0;
+        for (const auto& entry : meshes)
+            count += entry.second.expired() ? 0 : 1;
+        return count;
+    }
+
+private:
+    std::unordered_map<std::string, std::weak_ptr<const Mesh>> meshes;
+};
+
+inline MeshRegistry& meshRegistry()
+{
+    static MeshRegistry registry;
+    return registry;
+}
+
+#endif /* meshRegistry_h */
@@ -0,0 +1,471 @@
+//
+//  occlusionCulling.h
+//  test
+//
+//  Hides objects that big things in front of them cover. The walls, the
+//  besin counters and the row of boxes are registered as occluders: boxes
+//  placed by a scene graph node, exactly the shape of their cube meshes.
+//  Every frame the ones in view that cover most of the screen are drawn,
+//  depth only, into a small depth buffer on the CPU. It is split into
+//  horizontal bands, one per thread, so the threads never write the same
+//  pixel, and each band fills four pixels at a time with SSE2 where it is
+//  available. A pyramid of the farthest depth in every 2x2 block is built
+//  on top, so an object's box only needs comparing with a texel or four at
+//  the level where its screen rectangle is about two texels wide: it is
+//  hidden when its nearest point is behind the farthest occluder there.
+//
+//  The occluders are only rasterized where a pixel centre is inside them,
+//  and an object crossing the near plane is never hidden, so the test
+//  errs on the side of drawing.
+//
+
+#ifndef occlusionCulling_h
+#define occlusionCulling_h
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cmath>
+#include <cfloat>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_CULLING_SSE
+#endif
+
+#include "boundingBox.h"
+#include "sceneGraph.h"
+#include "frustumCulling.h"
+#include "renderStats.h"
+
+class OcclusionCuller {
+public:
+    // size of the depth buffer; the width has to be a multiple of four
+    static const int WIDTH = 256;
+    static const int HEIGHT = 128;
+
+    // off: nothing is hidden
+    bool enabled = true;
+    // off: the scalar rasterizer, to compare against
+    bool useSimd = true;
+    // most occluders drawn in a frame, the ones covering the most screen
+    unsigned int maxOccluders = 24;
+    // occluders covering less of the depth buffer than this are skipped
+    float minOccluderArea = 0.002f;
+
+    OcclusionCuller()
+    {
+        for (int width = WIDTH, height = HEIGHT; ; width = std::max(width / 2, 1), height = std::max(height / 2, 1))
+        {
+            levels.push_back(Level{ width, height, std::vector<float>((size_t)width * height, 1.0f) });
+            if (width == 1 && height == 1)
+                break;
+        }
+    }
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+    ~OcclusionCuller() { stopThreads(); }
+
+    // rasterize with threads more threads besides the caller's; call once
+    // before the first cull()
+    void startThreads(unsigned int threads)
+    {
+        stopThreads();
+        stopping = false;
+        bands = threads + 1;
+        for (unsigned int band = 1; band < bands; ++band)
+            workers.push_back(std::thread(&OcclusionCuller::work, this, band));
+    }
+
+    // a box occluder with the local box local, placed by node, whose own
+    // box in culler is object; it is only drawn when object is in view
+    void addOccluder(const BoundingBox& local, unsigned int node, unsigned int object)
+    {
+        occluders.push_back(Occluder{ local, node, object });
+        selected.reserve(occluders.size());
+        triangles.reserve(occluders.size() * 24);
+    }
+
+    // draw this frame's occluders and hide what they cover from culler's
+    // visible objects
+    void cull(const SceneGraph& scene, FrustumCuller& culler, const glm::mat4& viewProjection)
+    {
+        if (!enabled || occluders.empty())
+            return;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        selectOccluders(culler, viewProjection);
+        setUpTriangles(scene, viewProjection);
+        rasterize();
+        buildPyramid();
+        std::chrono::steady_clock::time_point rasterized = std::chrono::steady_clock::now();
+        renderStats().occlusionRasterSeconds += std::chrono::duration<double>(rasterized - start).count();
+
+        // an occluder drawn this frame is as deep as itself, and rounding may
+        // put its nearest corner just behind its own faces, so it isn't tested
+        drawnObjects.assign(culler.size(), 0);
+        for (const std::pair<float, unsigned int>& choice : selected)
+            drawnObjects[occluders[choice.second].object] = 1;
+        for (unsigned int object = 0; object < culler.size(); ++object)
+        {
+            if (!culler.isVisible(object) || drawnObjects[object])
+                continue;
+            renderStats().objectsOcclusionTested++;
+            if (isOccluded(culler.worldBounds(object), viewProjection))
+            {
+                culler.hide(object);
+                renderStats().objectsOccluded++;
+            }
+        }
+        renderStats().occlusionTestSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - rasterized).count();
+    }
+
+    // whether a box (world space) is behind what was drawn this frame
+    bool isOccluded(const BoundingBox& box, const glm::mat4& viewProjection) const
+    {
+        float nearest = FLT_MAX;
+        glm::vec2 low(FLT_MAX), high(-FLT_MAX);
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            glm::vec4 clip = viewProjection * glm::vec4(corner & 1 ? box.high.x : box.low.x, corner & 2 ? box.high.y : box.low.y, corner & 4 ? box.high.z : box.low.z, 1.0f);
+            if (clip.w <= NEAR_W)
+                return false;
+            glm::vec2 screen = toScreen(clip);
+            low = glm::min(low, screen);
+            high = glm::max(high, screen);
+            nearest = std::min(nearest, clip.z / clip.w);
+        }
+        int x0 = std::max(0, (int)low.x), y0 = std::max(0, (int)low.y);
+        int x1 = std::min(WIDTH - 1, (int)high.x), y1 = std::min(HEIGHT - 1, (int)high.y);
+        if (x0 > x1 || y0 > y1)
+            return false;
+
+        // the level where the rectangle is at most two texels across
+        size_t level = 0;
+        while (level + 1 < levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+            ++level;
+        const Level& depths = levels[level];
+        float farthest = 0.0f;
+        for (int y = y0 >> level; y <= std::min(y1 >> level, depths.height - 1); ++y)
+            for (int x = x0 >> level; x <= std::min(x1 >> level, depths.width - 1); ++x)
+                farthest = std::max(farthest, depths.values[(size_t)y * depths.width + x]);
+        return nearest > farthest;
+    }
+
+    size_t occluderCount() const { return occluders.size(); }
+    unsigned int threadCount() const { return bands; }
+
+private:
+    // clip w below which a point counts as at or behind the camera
+    static constexpr float NEAR_W = 1e-4f;
+
+    struct Occluder {
+        BoundingBox bounds;
+        unsigned int node;
+        unsigned int object;
+    };
+
+    // a triangle in depth buffer pixels, with depth as a plane over x and y
+    struct Triangle {
+        float x[3], y[3];
+        float depthAtOrigin, depthPerX, depthPerY;
+        int top, bottom;
+    };
+
+    struct Level {
+        int width, height;
+        std::vector<float> values;
+    };
+
+    std::vector<Occluder> occluders;
+    // indices into occluders, with the screen area each covers
+    std::vector<std::pair<float, unsigned int>> selected;
+    std::vector<Triangle> triangles;
+    // 1 for culler's objects that are among this frame's occluders
+    std::vector<unsigned char> drawnObjects;
+    // level 0 is the depth buffer, each next one the farthest of 2x2 of the last
+    std::vector<Level> levels;
+
+    // one band of rows per thread; band 0 is the caller's
+    unsigned int bands = 1;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    unsigned long long generation = 0;
+    unsigned int pendingBands = 0;
+    bool stopping = false;
+
+    static glm::vec2 toScreen(const glm::vec4& clip)
+    {
+        return glm::vec2((clip.x / clip.w * 0.5f + 0.5f) * WIDTH, (clip.y / clip.w * 0.5f + 0.5f) * HEIGHT);
+    }
+
+    // the occluders in view covering the most screen, by their box's rectangle
+    void selectOccluders(const FrustumCuller& culler, const glm::mat4& viewProjection)
+    {
+        selected.clear();
+        for (unsigned int i = 0; i < occluders.size(); ++i)
+        {
+            if (!culler.isVisible(occluders[i].object))
+                continue;
+            BoundingBox box = culler.worldBounds(occluders[i].object);
+            glm::vec2 low(FLT_MAX), high(-FLT_MAX);
+            bool nearPlane = false;
+            for (int corner = 0; corner < 8 && !nearPlane; ++corner)
+            {
+                glm::vec4 clip = viewProjection * glm::vec4(corner & 1 ? box.high.x : box.low.x, corner & 2 ? box.high.y : box.low.y, corner & 4 ? box.high.z : box.low.z, 1.0f);
+                nearPlane = clip.w <= NEAR_W;
+                if (!nearPlane)
+                {
+                    low = glm::min(low, toScreen(clip));
+                    high = glm::max(high, toScreen(clip));
+                }
+            }
+            // one reaching past the camera covers as good as the whole screen
+            low = nearPlane ? glm::vec2(0.0f) : glm::max(low, glm::vec2(0.0f));
+            high = nearPlane ? glm::vec2((float)WIDTH, (float)HEIGHT) : glm::min(high, glm::vec2((float)WIDTH, (float)HEIGHT));
+            float area = std::max(0.0f, high.x - low.x) * std::max(0.0f, high.y - low.y) / (WIDTH * HEIGHT);
+            if (area >= minOccluderArea)
+                selected.push_back(std::make_pair(area, i));
+        }
+        if (selected.size() > maxOccluders)
+        {
+            std::partial_sort(selected.begin(), selected.begin() + maxOccluders, selected.end(),
+                [](const std::pair<float, unsigned int>& a, const std::pair<float, unsigned int>& b) { return a.first > b.first; });
+            selected.resize(maxOccluders);
+        }
+        renderStats().occludersSelected += (unsigned int)selected.size();
+        renderStats().occluderCandidates += (unsigned int)occluders.size();
+    }
+
+    // the twelve triangles of every selected occluder, cut at the near plane
+    void setUpTriangles(const SceneGraph& scene, const glm::mat4& viewProjection)
+    {
+        static const int faces[6][4] = { { 0, 2, 3, 1 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 4, 6, 2 }, { 1, 3, 7, 5 } };
+        triangles.clear();
+        for (const std::pair<float, unsigned int>& choice : selected)
+        {
+            const Occluder& occluder = occluders[choice.second];
+            glm::mat4 transform = viewProjection * scene.world(occluder.node);
+            glm::vec4 corners[8];
+            for (int corner = 0; corner < 8; ++corner)
+                corners[corner] = transform * glm::vec4(corner & 1 ? occluder.bounds.high.x : occluder.bounds.low.x,
+                    corner & 2 ? occluder.bounds.high.y : occluder.bounds.low.y, corner & 4 ? occluder.bounds.high.z : occluder.bounds.low.z, 1.0f);
+            for (const int (&face)[4] : faces)
+            {
+                addTriangle(corners[face[0]], corners[face[1]], corners[face[2]]);
+                addTriangle(corners[face[0]], corners[face[2]], corners[face[3]]);
+            }
+        }
+        renderStats().occluderTriangles += (unsigned int)triangles.size();
+    }
+
+    // clip a to c against the near plane (z >= -w) and keep what is left
+    void addTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+    {
+        const glm::vec4 in[3] = { a, b, c };
+        glm::vec4 out[4];
+        int count = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            const glm::vec4& from = in[i];
+            const glm::vec4& to = in[(i + 1) % 3];
+            float fromDistance = from.z + from.w, toDistance = to.z + to.w;
+            if (fromDistance >= 0.0f)
+                out[count++] = from;
+            if ((fromDistance >= 0.0f) != (toDistance >= 0.0f))
+                out[count++] = from + (to - from) * (fromDistance / (fromDistance - toDistance));
+        }
+        for (int i = 2; i < count; ++i)
+            addScreenTriangle(out[0], out[i - 1], out[i]);
+    }
+
+    void addScreenTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+    {
+        if (a.w <= NEAR_W || b.w <= NEAR_W || c.w <= NEAR_W)
+            return;
+        glm::vec2 p[3] = { toScreen(a), toScreen(b), toScreen(c) };
+        float z[3] = { a.z / a.w, b.z / b.w, c.z / c.w };
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+        if (std::fabs(area) < 1e-6f)
+            return;
+        if (area < 0.0f)
+        {
+            // wound the other way round, so the edge tests below are all >= 0 inside
+            std::swap(p[1], p[2]);
+            std::swap(z[1], z[2]);
+            area = -area;
+        }
+        Triangle triangle;
+        for (int i = 0; i < 3; ++i)
+        {
+            triangle.x[i] = p[i].x;
+            triangle.y[i] = p[i].y;
+        }
+        // depth is affine in screen space after the divide
+        triangle.depthPerX = ((z[1] - z[0]) * (p[2].y - p[0].y) - (z[2] - z[0]) * (p[1].y - p[0].y)) / area;
+        triangle.depthPerY = ((z[2] - z[0]) * (p[1].x - p[0].x) - (z[1] - z[0]) * (p[2].x - p[0].x)) / area;
+        triangle.depthAtOrigin = z[0] - triangle.depthPerX * p[0].x - triangle.depthPerY * p[0].y;
+        triangle.top = std::max(0, (int)std::floor(std::min(p[0].y, std::min(p[1].y, p[2].y))));
+        triangle.bottom = std::min(HEIGHT - 1, (int)std::ceil(std::max(p[0].y, std::max(p[1].y, p[2].y))));
+        if (triangle.top <= triangle.bottom)
+            triangles.push_back(triangle);
+    }
+
+    void rasterize()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pendingBands = bands - 1;
+            ++generation;
+        }
+        wake.notify_all();
+        rasterizeBand(0);
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this] { return pendingBands == 0; });
+    }
+
+    void work(unsigned int band)
+    {
+        unsigned long long seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+            rasterizeBand(band);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pendingBands == 0)
+                finished.notify_one();
+        }
+    }
+
+    void stopThreads()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+        workers.clear();
+        bands = 1;
+    }
+
+    // clear the band's rows and draw every triangle reaching into them
+    void rasterizeBand(unsigned int band)
+    {
+        int first = HEIGHT * band / bands, last = HEIGHT * (band + 1) / bands;
+        std::vector<float>& depth = levels[0].values;
+        std::fill(depth.begin() + (size_t)first * WIDTH, depth.begin() + (size_t)last * WIDTH, 1.0f);
+
+        for (const Triangle& triangle : triangles)
+        {
+            int top = std::max(first, triangle.top), bottom = std::min(last - 1, triangle.bottom);
+            if (top > bottom)
+                continue;
+            float left = std::min(triangle.x[0], std::min(triangle.x[1], triangle.x[2]));
+            float right = std::max(triangle.x[0], std::max(triangle.x[1], triangle.x[2]));
+            // start at a multiple of four so the SIMD rows stay within the buffer
+            int x0 = std::max(0, (int)std::floor(left)) & ~3;
+            int x1 = std::min(WIDTH - 1, (int)std::ceil(right));
+            if (x0 > x1)
+                continue;
+
+            // edge i is >= 0 on the inside of the edge from vertex i to i + 1
+            float edgeX[3], edgeY[3], edgeConstant[3];
+            for (int i = 0; i < 3; ++i)
+            {
+                int j = (i + 1) % 3;
+                edgeX[i] = triangle.y[i] - triangle.y[j];
+                edgeY[i] = triangle.x[j] - triangle.x[i];
+                edgeConstant[i] = triangle.x[i] * triangle.y[j] - triangle.x[j] * triangle.y[i];
+            }
+            for (int y = top; y <= bottom; ++y)
+            {
+                float centreY = y + 0.5f;
+                float* row = depth.data() + (size_t)y * WIDTH;
+#if defined(OCCLUSION_CULLING_SSE)
+                if (useSimd)
+                {
+                    rasterizeRowSse(triangle, edgeX, edgeY, edgeConstant, row, x0, x1, centreY);
+                    continue;
+                }
+#endif
+                for (int x = x0; x <= x1; ++x)
+                {
+                    float centreX = x + 0.5f;
+                    bool inside = true;
+                    for (int i = 0; i < 3; ++i)
+                        inside = inside && edgeX[i] * centreX + edgeY[i] * centreY + edgeConstant[i] >= 0.0f;
+                    if (inside)
+                        row[x] = std::min(row[x], triangle.depthAtOrigin + triangle.depthPerX * centreX + triangle.depthPerY * centreY);
+                }
+            }
+        }
+    }
+
+#if defined(OCCLUSION_CULLING_SSE)
+    // four pixels of a row at a time from x0, a multiple of four
+    static void rasterizeRowSse(const Triangle& triangle, const float* edgeX, const float* edgeY, const float* edgeConstant,
+        float* row, int x0, int x1, float centreY)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        __m128 centreX = _mm_add_ps(_mm_set1_ps(x0 + 0.5f), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+        __m128 edges[3], edgeSteps[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            edges[i] = _mm_add_ps(_mm_mul_ps(centreX, _mm_set1_ps(edgeX[i])), _mm_set1_ps(edgeY[i] * centreY + edgeConstant[i]));
+            edgeSteps[i] = _mm_set1_ps(edgeX[i] * 4.0f);
+        }
+        __m128 depth = _mm_add_ps(_mm_mul_ps(centreX, _mm_set1_ps(triangle.depthPerX)), _mm_set1_ps(triangle.depthAtOrigin + triangle.depthPerY * centreY));
+        __m128 depthStep = _mm_set1_ps(triangle.depthPerX * 4.0f);
+        for (int x = x0; x <= x1; x += 4)
+        {
+            __m128 inside = _mm_cmpge_ps(_mm_min_ps(edges[0], _mm_min_ps(edges[1], edges[2])), zero);
+            if (_mm_movemask_ps(inside) != 0)
+            {
+                __m128 old = _mm_loadu_ps(row + x);
+                __m128 nearer = _mm_min_ps(old, depth);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+            }
+            for (int i = 0; i < 3; ++i)
+                edges[i] = _mm_add_ps(edges[i], edgeSteps[i]);
+            depth = _mm_add_ps(depth, depthStep);
+        }
+    }
+#endif
+
+    void buildPyramid()
+    {
+        for (size_t level = 1; level < levels.size(); ++level)
+        {
+            const Level& finer = levels[level - 1];
+            Level& coarser = levels[level];
+            for (int y = 0; y < coarser.height; ++y)
+                for (int x = 0; x < coarser.width; ++x)
+                {
+                    // an odd last row or column of the finer level folds into the last texel
+                    int fx0 = x * 2, fy0 = y * 2;
+                    int fx1 = x == coarser.width - 1 ? finer.width - 1 : fx0 + 1;
+                    int fy1 = y == coarser.height - 1 ? finer.height - 1 : fy0 + 1;
+                    float farthest = 0.0f;
+                    for (int fy = fy0; fy <= fy1; ++fy)
+                        for (int fx = fx0; fx <= fx1; ++fx)
+                            farthest = std::max(farthest, finer.values[(size_t)fy * finer.width + fx]);
+                    coarser.values[(size_t)y * coarser.width + x] = farthest;
+                }
+        }
+    }
+};
+
+#endif /* occlusionCulling_h */
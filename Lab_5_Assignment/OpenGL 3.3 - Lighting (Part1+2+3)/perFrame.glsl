@@ -0,0 +1,7 @@
+// camera data shared by every program, filled by CameraUniformBuffer
+layout (std140) uniform PerFrame
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
@@ -0,0 +1,104 @@
+// Phong terms of every light type. A program built as a lighting variant
+// (LIGHTING_VARIANT defined) has the light set baked in through
+// POINT_LIGHT_COUNT, DIRECTIONAL_LIGHT and SPOT_LIGHT; otherwise the light
+// set is read from the Lights block at run time.
+
+#include "lightsBlock.glsl"
+
+// material colours at the fragment, after any texture lookups
+struct Surface {
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+};
+
+// calculates the color when using a point light.
+vec3 CalcPointLight(Surface surface, PointLight light, vec3 N, vec3 fragPos, vec3 V)
+{
+    vec3 L = normalize(light.position - fragPos);
+    vec3 R = reflect(-L, N);
+    
+    // attenuation
+    float d = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.k_c + light.k_l * d + light.k_q * (d * d));
+    
+    vec3 ambient = surface.ambient * light.ambient;
+    vec3 diffuse = surface.diffuse * max(dot(N, L), 0.0) * light.diffuse;
+    vec3 specular = surface.specular * pow(max(dot(V, R), 0.0), surface.shininess) * light.specular;
+    
+    ambient *= attenuation;
+    diffuse *= attenuation;
+    specular *= attenuation;
+    
+    return (ambient + diffuse + specular);
+}
+
+vec3 CalcDirectionalLight(Surface surface, DiectionalLight light, vec3 N, vec3 V)
+{
+    vec3 L = normalize(-light.direction);
+    vec3 R = reflect(-L, N);
+    
+    vec3 ambient = surface.ambient * light.ambient;
+    vec3 diffuse = surface.diffuse * max(dot(N, L), 0.0) * light.diffuse;
+    vec3 specular = surface.specular * pow(max(dot(V, R), 0.0), surface.shininess) * light.specular;
+    
+    return (ambient + diffuse + specular);
+}
+
+vec3 CalcSpotLight(Surface surface, SpotLight light, vec3 N, vec3 fragPos, vec3 V)
+{
+    vec3 L = normalize(light.position - fragPos);
+    vec3 R = reflect(-L, N);
+    
+    // attenuation
+    float d = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.k_c + light.k_l * d + light.k_q * (d * d));
+    
+    vec3 ambient = surface.ambient * light.ambient;
+    vec3 diffuse = surface.diffuse * max(dot(N, L), 0.0) * light.diffuse;
+    vec3 specular = surface.specular * pow(max(dot(V, R), 0.0), surface.shininess) * light.specular;
+
+    float cos_alpha = dot(L, normalize(-light.direction));
+    float intensity;
+    if(cos_alpha<light.cos_theta)
+    {
+        intensity = 0.0;
+    }
+    else
+    {
+        intensity = cos_alpha;
+    }
+    
+    ambient *= attenuation * intensity;
+    diffuse *= attenuation * intensity;
+    specular *= attenuation * intensity;
+    
+    return (ambient + diffuse + specular);
+}
+
+// sum of all lights that are on
+vec3 CalcLighting(Surface surface, vec3 N, vec3 fragPos, vec3 V)
+{
+    vec3 result = vec3(0.0);
+#ifdef LIGHTING_VARIANT
+    // point lights
+    for(int i = 0; i < POINT_LIGHT_COUNT; i++)
+        result += CalcPointLight(surface, pointLights[i], N, fragPos, V);
+#ifdef DIRECTIONAL_LIGHT
+    result += CalcDirectionalLight(surface, diectionalLight, N, V);
+#endif
+#ifdef SPOT_LIGHT
+    result += CalcSpotLight(surface, spotlight, N, fragPos, V);
+#endif
+#else
+    // point lights
+    for(int i = 0; i < pointLightCount; i++)
+        result += CalcPointLight(surface, pointLights[i], N, fragPos, V);
+    if(dlighton)
+        result += CalcDirectionalLight(surface, diectionalLight, N, V);
+    if(spotlighton)
+        result += CalcSpotLight(surface, spotlight, N, fragPos, V);
+#endif
+    return result;
+}
@@ -10,7 +10,6 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
-#include "shader.h"
 
 class PointLight {
 public:
@@ -34,51 +33,13 @@ public:
         k_q = quadratic;
         lightNumber = num;
     }
-    void setUpPointLight(Shader& lightingShader)
-    {
-        lightingShader.use();
-
-        if (lightNumber == 1) {
-            lightingShader.setVec3("pointLights[0].position", position);
-            lightingShader.setVec3("pointLights[0].ambient", ambientOn * ambient);
-            lightingShader.setVec3("pointLights[0].diffuse", diffuseOn * diffuse);
-            lightingShader.setVec3("pointLights[0].specular", specularOn * specular);
-            lightingShader.setFloat("pointLights[0].k_c", k_c);
-            lightingShader.setFloat("pointLights[0].k_l", k_l);
-            lightingShader.setFloat("pointLights[0].k_q", k_q);
-        }
+    // colours as the shaders see them, with the on/off switches applied
+    glm::vec3 getAmbient() const { return ambientOn * ambient; }
+    glm::vec3 getDiffuse() const { return diffuseOn * diffuse; }
+    glm::vec3 getSpecular() const { return specularOn * specular; }
+    // a light with every term switched off contributes nothing
+    bool isOn() const { return ambientOn != 0.0f || diffuseOn != 0.0f || specularOn != 0.0f; }
 
-        else if (lightNumber == 2)
-        {
-            lightingShader.setVec3("pointLights[1].position", position);
-            lightingShader.setVec3("pointLights[1].ambient", ambientOn * ambient);
-            lightingShader.setVec3("pointLights[1].diffuse", diffuseOn * diffuse);
-            lightingShader.setVec3("pointLights[1].specular", specularOn * specular);
-            lightingShader.setFloat("pointLights[1].k_c", k_c);
-            lightingShader.setFloat("pointLights[1].k_l", k_l);
-            lightingShader.setFloat("pointLights[1].k_q", k_q);
-        }
-        else if (lightNumber == 3)
-        {
-            lightingShader.setVec3("pointLights[2].position", position);
-            lightingShader.setVec3("pointLights[2].ambient", ambientOn * ambient);
-            lightingShader.setVec3("pointLights[2].diffuse", diffuseOn * diffuse);
-            lightingShader.setVec3("pointLights[2].specular", specularOn * specular);
-            lightingShader.setFloat("pointLights[2].k_c", k_c);
-            lightingShader.setFloat("pointLights[2].k_l", k_l);
-            lightingShader.setFloat("pointLights[2].k_q", k_q);
-        }
-        else
-        {
-            lightingShader.setVec3("pointLights[3].position", position);
-            lightingShader.setVec3("pointLights[3].ambient", ambientOn * ambient);
-            lightingShader.setVec3("pointLights[3].diffuse", diffuseOn * diffuse);
-            lightingShader.setVec3("pointLights[3].specular", specularOn * specular);
-            lightingShader.setFloat("pointLights[3].k_c", k_c);
-            lightingShader.setFloat("pointLights[3].k_l", k_l);
-            lightingShader.setFloat("pointLights[3].k_q", k_q);
-        }
-    }
     void turnOff()
     {
         ambientOn = 0.0;
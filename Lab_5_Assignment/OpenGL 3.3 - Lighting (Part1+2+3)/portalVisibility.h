@@ -0,0 +1,239 @@
+//
+//  portalVisibility.h
+//  test
+//
+//  Which rooms of a venue the camera can see into. Each room is a cell,
+//  a box in venue space, and the openings between rooms (doorways) are
+//  portals, quads joining two cells. Every frame update() starts at the
+//  cell the camera is in with the whole screen, and walks through each
+//  portal into the next cell with the screen rectangle narrowed to the
+//  part of the portal still in view; a cell no walk reaches is hidden
+//  behind walls. A cell reached along several paths gets the rectangle
+//  around all of them.
+//
+//  cull() then hides the objects of hidden cells, and the objects of
+//  visible cells that are outside the frustum narrowed to their cell's
+//  rectangle, from a FrustumCuller's result. Objects belong to the cell
+//  their box's centre is in (see cellAt()); an object in no cell, and every
+//  object while the camera is outside all cells, is left as it was.
+//
+
+#ifndef portalVisibility_h
+#define portalVisibility_h
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+
+#include "boundingBox.h"
+#include "frustumCulling.h"
+#include "renderStats.h"
+
+const unsigned int NO_CELL = ~0u;
+
+class PortalVisibility {
+public:
+    // off: every cell is visible
+    bool enabled = true;
+    // how many portals deep a walk goes; a path back into a cell it came
+    // through is never taken anyway
+    int maxDepth = 16;
+
+    PortalVisibility() = default;
+    PortalVisibility(const PortalVisibility&) = delete;
+    PortalVisibility& operator=(const PortalVisibility&) = delete;
+
+    // a room whose floor, walls and ceiling lie within bounds (venue space)
+    unsigned int addCell(const BoundingBox& bounds)
+    {
+        Cell cell;
+        cell.bounds = bounds;
+        cells.push_back(cell);
+        return (unsigned int)cells.size() - 1;
+    }
+
+    // an opening between cells a and b with corners in order around it
+    void addPortal(unsigned int a, unsigned int b, const glm::vec3 (&corners)[4])
+    {
+        Portal portal;
+        portal.cells[0] = a;
+        portal.cells[1] = b;
+        std::copy(corners, corners + 4, portal.corners);
+        portals.push_back(portal);
+        cells[a].portals.push_back((unsigned int)portals.size() - 1);
+        cells[b].portals.push_back((unsigned int)portals.size() - 1);
+    }
+
+    // the cell point (venue space) is in, NO_CELL if none
+    unsigned int cellAt(const glm::vec3& point) const
+    {
+        for (size_t cell = 0; cell < cells.size(); ++cell)
+        {
+            const BoundingBox& bounds = cells[cell].bounds;
+            if (point.x >= bounds.low.x && point.x <= bounds.high.x && point.y >= bounds.low.y && point.y <= bounds.high.y
+                && point.z >= bounds.low.z && point.z <= bounds.high.z)
+                return (unsigned int)cell;
+        }
+        return NO_CELL;
+    }
+
+    // find the visible cells for a camera at eye (world space) looking
+    // through viewProjection, with the venue placed by venue
+    void update(const glm::mat4& viewProjection, const glm::mat4& venue, const glm::vec3& eye)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        // the portals are in venue space, so look at them through venue too;
+        // the rectangles are on screen and don't care which space they came from
+        venueViewProjection = viewProjection * venue;
+        eyeCell = enabled ? cellAt(glm::vec3(glm::inverse(venue) * glm::vec4(eye, 1.0f))) : NO_CELL;
+
+        bool everything = eyeCell == NO_CELL;
+        for (Cell& cell : cells)
+        {
+            cell.visible = everything;
+            cell.low = glm::vec2(-1.0f);
+            cell.high = glm::vec2(1.0f);
+        }
+        if (!everything)
+        {
+            path.assign(cells.size(), 0);
+            visit(eyeCell, glm::vec2(-1.0f), glm::vec2(1.0f), 0);
+            for (Cell& cell : cells)
+                if (cell.visible)
+                    cell.frustum = Frustum::fromMatrix(viewProjection, cell.low, cell.high);
+        }
+
+        for (const Cell& cell : cells)
+            renderStats().cellsVisible += cell.visible;
+        renderStats().cellsTotal += (unsigned int)cells.size();
+        renderStats().portalSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool isVisible(unsigned int cell) const { return cell == NO_CELL || cells[cell].visible; }
+
+    // whether an object of cell with box worldBox can be seen, i.e. its cell
+    // is visible and the box is within the frustum through its portals
+    bool admits(unsigned int cell, const BoundingBox& worldBox) const
+    {
+        if (cell == NO_CELL || eyeCell == NO_CELL)
+            return true;
+        const Cell& target = cells[cell];
+        if (!target.visible)
+            return false;
+        return cell == eyeCell || !target.frustum.excludes(worldBox);
+    }
+
+    // hide what update() found can't be seen from culler's visible objects;
+    // objectCells[object] is the cell of each of culler's objects
+    void cull(FrustumCuller& culler, const std::vector<unsigned int>& objectCells) const
+    {
+        if (eyeCell == NO_CELL)
+            return;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (unsigned int object = 0; object < culler.size(); ++object)
+            if (culler.isVisible(object) && !admits(objectCells[object], culler.worldBounds(object)))
+            {
+                culler.hide(object);
+                renderStats().objectsBehindPortals++;
+            }
+        renderStats().portalSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    size_t cellCount() const { return cells.size(); }
+    size_t portalCount() const { return portals.size(); }
+
+private:
+    struct Cell {
+        BoundingBox bounds;
+        std::vector<unsigned int> portals;
+        bool visible = false;
+        // the screen rectangle (normalized device coordinates) it is seen
+        // through, and the view frustum narrowed to it
+        glm::vec2 low = glm::vec2(-1.0f), high = glm::vec2(1.0f);
+        Frustum frustum;
+    };
+
+    struct Portal {
+        unsigned int cells[2];
+        glm::vec3 corners[4];
+    };
+
+    std::vector<Cell> cells;
+    std::vector<Portal> portals;
+    unsigned int eyeCell = NO_CELL;
+    glm::mat4 venueViewProjection = glm::mat4(1.0f);
+    // 1 for the cells on the walk so far
+    std::vector<unsigned char> path;
+
+    void visit(unsigned int cell, const glm::vec2& low, const glm::vec2& high, int depth)
+    {
+        Cell& target = cells[cell];
+        if (!target.visible)
+        {
+            target.visible = true;
+            target.low = low;
+            target.high = high;
+        }
+        else
+        {
+            target.low = glm::min(target.low, low);
+            target.high = glm::max(target.high, high);
+        }
+        if (depth >= maxDepth)
+            return;
+
+        path[cell] = 1;
+        for (unsigned int p : target.portals)
+        {
+            const Portal& portal = portals[p];
+            unsigned int next = portal.cells[0] == cell ? portal.cells[1] : portal.cells[0];
+            if (path[next])
+                continue;
+            glm::vec2 portalLow, portalHigh;
+            int cornersBehind = project(portal, portalLow, portalHigh);
+            if (cornersBehind == 4)
+                continue;
+            if (cornersBehind > 0)
+            {
+                // the camera is in or right next to the doorway, so all of
+                // what is seen so far may be through it
+                portalLow = low;
+                portalHigh = high;
+            }
+            glm::vec2 narrowedLow = glm::max(low, portalLow), narrowedHigh = glm::min(high, portalHigh);
+            if (narrowedLow.x < narrowedHigh.x && narrowedLow.y < narrowedHigh.y)
+            {
+                renderStats().portalsTraversed++;
+                visit(next, narrowedLow, narrowedHigh, depth + 1);
+            }
+        }
+        path[cell] = 0;
+    }
+
+    // the screen rectangle around portal's corners in front of the camera;
+    // returns how many are at or behind it, where they can't be projected
+    int project(const Portal& portal, glm::vec2& low, glm::vec2& high) const
+    {
+        low = glm::vec2(FLT_MAX);
+        high = glm::vec2(-FLT_MAX);
+        int behind = 0;
+        for (const glm::vec3& corner : portal.corners)
+        {
+            glm::vec4 clip = venueViewProjection * glm::vec4(corner, 1.0f);
+            if (clip.w <= 1e-4f)
+            {
+                ++behind;
+                continue;
+            }
+            glm::vec2 screen(clip.x / clip.w, clip.y / clip.w);
+            low = glm::min(low, screen);
+            high = glm::max(high, screen);
+        }
+        return behind;
+    }
+};
+
+#endif /* portalVisibility_h */
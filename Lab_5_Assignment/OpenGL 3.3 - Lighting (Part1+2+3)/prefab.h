@@ -0,0 +1,181 @@
+//
+//  prefab.h
+//  test
+//
+//  A piece of furniture described once as primitives placed relative to
+//  the piece, then compiled at load time into one mesh whose parts are
+//  sorted by material. The compiled prefab keeps a table of index ranges,
+//  one per material, so placing a chair is one model matrix and at most
+//  one (instanced) draw per material instead of a draw per part.
+//
+//  Parts with a level of detail chain (cylinders, see levelOfDetail.h) make
+//  the prefab compile once per level, and each placement picks the level
+//  from the prefab's size on screen.
+//
+
+#ifndef prefab_h
+#define prefab_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+#include "geometryArena.h"
+#include "meshBuilder.h"
+#include "instanceQueue.h"
+#include "levelOfDetail.h"
+
+class Prefab {
+public:
+    // the part of the compiled mesh that uses one material
+    struct MaterialRange {
+        unsigned int materialID;
+        GLuint diffuseMap;
+        GLuint specularMap;
+        GLsizei firstIndex;
+        GLsizei indexCount;
+    };
+
+    explicit Prefab(const char* name) : name(name) {}
+    Prefab(const Prefab&) = delete;
+    Prefab& operator=(const Prefab&) = delete;
+    ~Prefab() { release(); }
+
+    // add a primitive (Cube, CylinderWithTexture, ...) at local, relative
+    // to the prefab's origin; only before compile()
+    template <typename Primitive>
+    Prefab& add(const Primitive& primitive, const glm::mat4& local)
+    {
+        Part part;
+        for (int level = 0; level < LOD_COUNT; ++level)
+            part.geometry[level] = primitive.getMesh(level).geometry;
+        part.materialID = primitive.materialID;
+        part.diffuseMap = primitive.diffuseMap;
+        part.specularMap = primitive.specularMap;
+        part.local = local;
+        parts.push_back(part);
+        return *this;
+    }
+
+    // merge the parts into one arena mesh per level of detail, grouped by
+    // material; levels stop where no part gets any coarser
+    void compile()
+    {
+        release();
+        std::stable_sort(parts.begin(), parts.end(), [](const Part& a, const Part& b) {
+            if (a.materialID != b.materialID)
+                return a.materialID < b.materialID;
+            if (a.diffuseMap != b.diffuseMap)
+                return a.diffuseMap < b.diffuseMap;
+            return a.specularMap < b.specularMap;
+        });
+
+        MeshBuilder builder;
+        std::cout << "prefab " << name << ": " << parts.size() << " parts";
+        for (int level = 0; level < LOD_COUNT; ++level)
+        {
+            if (level > 0 && !coarserThan(level - 1, level))
+                break;
+            std::vector<MaterialRange>& levelRanges = ranges[level];
+            for (const Part& part : parts)
+            {
+                if (levelRanges.empty() || !sameMaterial(levelRanges.back(), part))
+                    levelRanges.push_back(MaterialRange{ part.materialID, part.diffuseMap, part.specularMap, (GLsizei)builder.getIndexCount(), 0 });
+                builder.append(part.geometry[level], -1, part.local, glm::mat3(glm::transpose(glm::inverse(part.local))));
+                levelRanges.back().indexCount = (GLsizei)builder.getIndexCount() - levelRanges.back().firstIndex;
+            }
+            if (level == 0)
+            {
+                builder.boundingSphere(boundingCentre, boundingRadius);
+                bounds = builder.bounds();
+                std::cout << ", " << levelRanges.size() << " materials, vertices";
+            }
+            std::cout << (level > 0 ? "/" : " ") << builder.getVertexCount();
+            geometry[level] = builder.upload();
+            levels = level + 1;
+        }
+        std::cout << " (" << levels << " levels of detail)" << std::endl;
+        parts.clear();
+    }
+
+    // queue one copy of the prefab placed by model, at the level of detail
+    // its size on screen asks for
+    void draw(InstanceQueue& queue, const glm::mat4& model) const
+    {
+        draw(queue, model, glm::mat3(glm::transpose(glm::inverse(model))));
+    }
+
+    // same, with the normal matrix cached by the scene graph (see sceneGraph.h)
+    // for object id, which keeps its level of detail between frames
+    void draw(InstanceQueue& queue, const glm::mat4& model, const glm::mat3& normalMatrix, unsigned int id = NO_DRAW_ID) const
+    {
+        int level = selector.select(id, model, boundingCentre, boundingRadius, levels);
+        InstanceData instance;
+        instance.model = model;
+        instance.normalMatrix = normalMatrix;
+        for (const MaterialRange& range : ranges[level])
+        {
+            instance.materialIndex = range.materialID;
+            queue.add(InstanceQueue::keyFor(geometry[level], range.firstIndex, range.indexCount, range.diffuseMap, range.specularMap), instance);
+        }
+    }
+
+    const std::vector<MaterialRange>& getMaterialRanges(int level = 0) const { return ranges[level]; }
+
+    // box around the full-detail mesh, relative to the prefab's origin
+    const BoundingBox& getBounds() const { return bounds; }
+
+    // give the compiled meshes back to the arena
+    void release()
+    {
+        for (int level = 0; level < levels; ++level)
+        {
+            geometryArena().remove(geometry[level]);
+            ranges[level].clear();
+        }
+        levels = 0;
+    }
+
+private:
+    struct Part {
+        // the primitive's mesh at each level of detail
+        unsigned int geometry[LOD_COUNT];
+        unsigned int materialID;
+        GLuint diffuseMap;
+        GLuint specularMap;
+        glm::mat4 local;
+    };
+
+    std::string name;
+    std::vector<Part> parts;
+    // per level of detail; levels is how many were compiled
+    std::vector<MaterialRange> ranges[LOD_COUNT];
+    unsigned int geometry[LOD_COUNT] = {};
+    int levels = 0;
+    glm::vec3 boundingCentre = glm::vec3(0.0f);
+    float boundingRadius = 0.0f;
+    BoundingBox bounds;
+    LodSelector selector;
+
+    // whether any part has a different mesh at level than at finer
+    bool coarserThan(int finer, int level) const
+    {
+        for (const Part& part : parts)
+        {
+            if (part.geometry[level] != part.geometry[finer])
+                return true;
+        }
+        return false;
+    }
+
+    static bool sameMaterial(const MaterialRange& range, const Part& part)
+    {
+        return range.materialID == part.materialID && range.diffuseMap == part.diffuseMap && range.specularMap == part.specularMap;
+    }
+};
+
+#endif /* prefab_h */
@@ -0,0 +1,324 @@
+//
+//  proceduralPrimitives.h
+//  test
+//
+//  A second way to draw the parametric primitives: instead of a mesh in the
+//  geometry arena, an instance is a small parameter block (shape, radii,
+//  height, sectors, stacks, texture rectangle) and the PROCEDURAL variant
+//  of the Phong vertex shader makes its vertices from gl_VertexID (see
+//  proceduralShapes.glsl). No vertex or index buffer is read and nothing is
+//  built on the CPU, so a differently tessellated copy costs one parameter
+//  block.
+//
+//  Instances that come out at the same vertex count with the same textures
+//  are one glDrawArraysInstanced, whatever their shape. Cylinders, cones,
+//  spheres and hexagons have a draw overload taking a ProceduralQueue next
+//  to the InstanceQueue one, so the path is picked draw by draw.
+//
+
+#ifndef proceduralPrimitives_h
+#define proceduralPrimitives_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+
+#include "shader.h"
+#include "glState.h"
+#include "renderStats.h"
+#include "instanceQueue.h"
+
+// must match the PROCEDURAL_* constants in proceduralShapes.glsl
+enum ProceduralShapeType {
+    PROCEDURAL_FRUSTUM = 0,
+    PROCEDURAL_SPHERE = 1,
+    PROCEDURAL_POLYGON = 2
+};
+
+// what the vertex shader needs to make one shape
+struct ProceduralShape {
+    unsigned int type = PROCEDURAL_FRUSTUM;
+    unsigned int sectors = 3;
+    unsigned int stacks = 1;
+    // (base radius, top radius, height, y of the base) for a frustum, the
+    // radius in x otherwise
+    glm::vec4 dimensions = glm::vec4(0.0f);
+    // texture coordinates are mapped into (xmin, ymin, xmax, ymax)
+    glm::vec4 uvRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+
+    // a cylinder, or a cone when topRadius is 0, standing on y = baseY
+    static ProceduralShape frustum(float baseRadius, float topRadius, float height, float baseY, int sectors, int stacks)
+    {
+        ProceduralShape shape;
+        shape.type = PROCEDURAL_FRUSTUM;
+        shape.sectors = (unsigned int)std::max(sectors, 3);
+        shape.stacks = (unsigned int)std::max(stacks, 1);
+        shape.dimensions = glm::vec4(baseRadius, topRadius, height, baseY);
+        return shape;
+    }
+
+    static ProceduralShape sphere(float radius, int sectors, int stacks)
+    {
+        ProceduralShape shape;
+        shape.type = PROCEDURAL_SPHERE;
+        shape.sectors = (unsigned int)std::max(sectors, 3);
+        shape.stacks = (unsigned int)std::max(stacks, 2);
+        shape.dimensions = glm::vec4(radius, 0.0f, 0.0f, 0.0f);
+        return shape;
+    }
+
+    // a regular polygon of unit normal +z in the xy plane
+    static ProceduralShape polygon(float radius, int sides)
+    {
+        ProceduralShape shape;
+        shape.type = PROCEDURAL_POLYGON;
+        shape.sectors = (unsigned int)std::max(sides, 3);
+        shape.dimensions = glm::vec4(radius, 0.0f, 0.0f, 0.0f);
+        return shape;
+    }
+
+    ProceduralShape& textureRect(float xmin, float ymin, float xmax, float ymax)
+    {
+        uvRect = glm::vec4(xmin, ymin, xmax, ymax);
+        return *this;
+    }
+
+    // vertices of the triangle list; a frustum always has both caps, a
+    // cap of radius 0 is degenerate and never rasterised
+    GLsizei vertexCount() const
+    {
+        switch (type)
+        {
+        case PROCEDURAL_SPHERE:
+            return (GLsizei)(6 * sectors * stacks);
+        case PROCEDURAL_POLYGON:
+            return (GLsizei)(3 * sectors);
+        default:
+            return (GLsizei)(6 * sectors * stacks + 6 * sectors);
+        }
+    }
+};
+
+// one instance as the PROCEDURAL vertex shader reads it; model, normal
+// matrix and material are where InstanceData has them
+struct ProceduralInstance {
+    glm::mat4 model;
+    glm::mat3 normalMatrix;
+    unsigned int materialIndex;
+    // type, sectors, stacks
+    unsigned int shape[3];
+    glm::vec4 dimensions;
+    glm::vec4 uvRect;
+};
+
+static_assert(sizeof(ProceduralInstance) == 37 * sizeof(float), "ProceduralInstance must be tightly packed");
+
+class ProceduralQueue {
+public:
+    ProceduralQueue() = default;
+    ProceduralQueue(const ProceduralQueue&) = delete;
+    ProceduralQueue& operator=(const ProceduralQueue&) = delete;
+
+    // queue one textured copy of shape; the maps go through the texture
+    // arrays like the instance queue's
+    void add(const ProceduralShape& shape, unsigned int materialID, GLuint diffuseMap, GLuint specularMap, const glm::mat4& model)
+    {
+        add(shape, materialID, diffuseMap, specularMap, model, glm::mat3(glm::transpose(glm::inverse(model))));
+    }
+
+    // same, with the normal matrix already known (see sceneGraph.h)
+    void add(const ProceduralShape& shape, unsigned int materialID, GLuint diffuseMap, GLuint specularMap,
+        const glm::mat4& model, const glm::mat3& normalMatrix)
+    {
+        InstanceQueue::BatchKey textures = InstanceQueue::keyFor(0, 0, -1, diffuseMap, specularMap);
+        findBatch(BatchKey{ shape.vertexCount(), textures.textureTarget, textures.diffuseMap, textures.specularMap })
+            .instances.push_back(instanceFor(shape, materialID, model, normalMatrix));
+    }
+
+    // queue one copy of shape lit with the material's colours
+    void add(const ProceduralShape& shape, unsigned int materialID, const glm::mat4& model)
+    {
+        findBatch(BatchKey{ shape.vertexCount(), GL_NONE, 0, 0 })
+            .instances.push_back(instanceFor(shape, materialID, model, glm::mat3(glm::transpose(glm::inverse(model)))));
+    }
+
+    // draw everything queued since the last flush and empty the queue.
+    // shaderFor(textured) returns the PROCEDURAL Phong variant to use, so
+    // the untextured one is only built when something untextured was queued
+    template <typename ShaderFor>
+    void flush(ShaderFor shaderFor)
+    {
+        size_t total = 0;
+        for (const Batch& batch : batches)
+            total += batch.instances.size();
+        if (total == 0)
+            return;
+
+        reserve((GLsizeiptr)(total * sizeof(ProceduralInstance)));
+
+        GLintptr offset = 0;
+        for (Batch& batch : batches)
+        {
+            if (batch.instances.empty())
+                continue;
+            GLsizeiptr bytes = (GLsizeiptr)(batch.instances.size() * sizeof(ProceduralInstance));
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, batch.instances.data());
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            bool textured = batch.key.textureTarget != GL_NONE;
+            Shader& shader = shaderFor(textured);
+            shader.use();
+            if (textured)
+            {
+                InstanceQueue::setTextureUnits(shader);
+                glState().bindTextureToUnit(0, batch.key.textureTarget, batch.key.diffuseMap);
+                glState().bindTextureToUnit(1, batch.key.textureTarget, batch.key.specularMap);
+            }
+
+            // GL 3.3 has no base instance, so every batch re-points the attributes
+            glState().bindVertexArray(vertexArray);
+            pointInstanceAttributes(offset);
+            GLsizei instanceCount = (GLsizei)batch.instances.size();
+            glDrawArraysInstanced(GL_TRIANGLES, 0, batch.key.vertexCount, instanceCount);
+            renderStats().drawCalls++;
+            renderStats().instancesDrawn += (unsigned int)instanceCount;
+            renderStats().proceduralInstancesDrawn += (unsigned int)instanceCount;
+            renderStats().trianglesDrawn += (unsigned int)(batch.key.vertexCount / 3 * instanceCount);
+
+            offset += bytes;
+            batch.instances.clear();
+        }
+    }
+
+    // drop everything queued without drawing it
+    void clear()
+    {
+        for (Batch& batch : batches)
+            batch.instances.clear();
+    }
+
+    // delete the vertex array and instance buffer while the context is still alive
+    void release()
+    {
+        if (vertexArray != 0)
+            glState().deleteVertexArrays(1, &vertexArray);
+        if (buffer != 0)
+            glDeleteBuffers(1, &buffer);
+        vertexArray = 0;
+        buffer = 0;
+        capacity = 0;
+        batches.clear();
+    }
+
+private:
+    // what a batch has in common; textureTarget is GL_NONE for untextured shapes
+    struct BatchKey {
+        GLsizei vertexCount;
+        GLenum textureTarget;
+        GLuint diffuseMap;
+        GLuint specularMap;
+
+        bool operator==(const BatchKey& other) const
+        {
+            return vertexCount == other.vertexCount && textureTarget == other.textureTarget
+                && diffuseMap == other.diffuseMap && specularMap == other.specularMap;
+        }
+    };
+    struct Batch {
+        BatchKey key;
+        std::vector<ProceduralInstance> instances;
+    };
+
+    std::vector<Batch> batches;
+    size_t lastBatch = 0;
+    // no vertex arrays, only the instance attributes
+    GLuint vertexArray = 0;
+    GLuint buffer = 0;
+    GLsizeiptr capacity = 0;
+
+    static ProceduralInstance instanceFor(const ProceduralShape& shape, unsigned int materialID, const glm::mat4& model, const glm::mat3& normalMatrix)
+    {
+        ProceduralInstance instance;
+        instance.model = model;
+        instance.normalMatrix = normalMatrix;
+        instance.materialIndex = materialID;
+        instance.shape[0] = shape.type;
+        instance.shape[1] = shape.sectors;
+        instance.shape[2] = shape.stacks;
+        instance.dimensions = shape.dimensions;
+        instance.uvRect = shape.uvRect;
+        return instance;
+    }
+
+    // same search as the instance queue's: runs of the same shape hit the last batch
+    Batch& findBatch(const BatchKey& key)
+    {
+        if (lastBatch < batches.size() && batches[lastBatch].key == key)
+            return batches[lastBatch];
+        for (size_t i = 0; i < batches.size(); ++i)
+        {
+            if (batches[i].key == key)
+            {
+                lastBatch = i;
+                return batches[i];
+            }
+        }
+        batches.push_back(Batch{ key, std::vector<ProceduralInstance>() });
+        lastBatch = batches.size() - 1;
+        return batches.back();
+    }
+
+    // orphan the instance buffer so this frame's writes don't wait for the
+    // draws of the last one, growing it when the frame has more instances
+    void reserve(GLsizeiptr bytes)
+    {
+        if (buffer == 0)
+        {
+            glGenBuffers(1, &buffer);
+            glGenVertexArrays(1, &vertexArray);
+        }
+        while (capacity < bytes)
+            capacity = capacity == 0 ? 1024 * (GLsizeiptr)sizeof(ProceduralInstance) : capacity * 2;
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // expects the vertex array to be bound. Locations 3 to 10 are the
+    // instance queue's; the shape takes 0 to 2, which no vertex array feeds here
+    void pointInstanceAttributes(GLintptr offset)
+    {
+        GLsizei stride = sizeof(ProceduralInstance);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        // model matrix, one column per location
+        for (GLuint column = 0; column < 4; ++column)
+            pointFloats(3 + column, 4, offset + column * 4 * sizeof(float));
+        // normal matrix
+        for (GLuint column = 0; column < 3; ++column)
+            pointFloats(7 + column, 3, offset + (16 + column * 3) * sizeof(float));
+        // material table row, then type, sectors and stacks
+        glVertexAttribIPointer(10, 1, GL_UNSIGNED_INT, stride, (void*)(offset + 25 * sizeof(float)));
+        glVertexAttribIPointer(0, 3, GL_UNSIGNED_INT, stride, (void*)(offset + 26 * sizeof(float)));
+        for (GLuint location : { 10u, 0u })
+        {
+            glEnableVertexAttribArray(location);
+            glVertexAttribDivisor(location, 1);
+        }
+        // dimensions, texture rectangle
+        pointFloats(1, 4, offset + 29 * sizeof(float));
+        pointFloats(2, 4, offset + 33 * sizeof(float));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    static void pointFloats(GLuint location, GLint components, GLintptr offset)
+    {
+        glVertexAttribPointer(location, components, GL_FLOAT, GL_FALSE, sizeof(ProceduralInstance), (void*)offset);
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
+};
+
+#endif /* proceduralPrimitives_h */
@@ -0,0 +1,88 @@
+// Vertices of the parametric primitives made from gl_VertexID alone, see
+// proceduralPrimitives.h. shape is (type, sectors, stacks); dimensions is
+// (base radius, top radius, height, y of the base) for a frustum and has
+// the radius in x for a sphere or a polygon. Each shape is a triangle list
+// in the order the CPU-built meshes index their vertices.
+const uint PROCEDURAL_FRUSTUM = 0u;
+const uint PROCEDURAL_SPHERE = 1u;
+const uint PROCEDURAL_POLYGON = 2u;
+
+const float PROCEDURAL_TWO_PI = 6.28318530718;
+
+// (stack, sector) offsets of the six vertices of a quad
+const ivec2 proceduralQuadCorners[6] = ivec2[6](ivec2(0, 0), ivec2(1, 0), ivec2(0, 1), ivec2(0, 1), ivec2(1, 0), ivec2(1, 1));
+
+// the last sector of a ring is the first one again, exactly, so there is no seam
+vec2 proceduralRing(int sector, int sectors)
+{
+    float angle = PROCEDURAL_TWO_PI * float(sector == sectors ? 0 : sector) / float(sectors);
+    return vec2(cos(angle), sin(angle));
+}
+
+void proceduralVertex(int vertex, uvec3 shape, vec4 dimensions, out vec3 position, out vec3 normal, out vec2 uv)
+{
+    int sectors = int(shape.y);
+    int stacks = int(shape.z);
+
+    if (shape.x == PROCEDURAL_POLYGON)
+    {
+        // a fan around the centre in the xy plane, facing +z (the hexagons)
+        int corner = vertex % 3;
+        normal = vec3(0.0, 0.0, 1.0);
+        if (corner == 0)
+        {
+            position = vec3(0.0);
+            uv = vec2(0.5);
+            return;
+        }
+        vec2 ring = proceduralRing(vertex / 3 + corner - 1, sectors);
+        position = vec3(ring * dimensions.x, 0.0);
+        uv = (ring + 1.0) * 0.5;
+        return;
+    }
+
+    int sideVertices = 6 * sectors * stacks;
+    if (vertex < sideVertices)
+    {
+        int quad = vertex / 6;
+        ivec2 corner = proceduralQuadCorners[vertex % 6];
+        int stack = quad / sectors + corner.x;
+        int sector = quad % sectors + corner.y;
+        vec2 ring = proceduralRing(sector, sectors);
+        float t = float(stack) / float(stacks);
+        uv = vec2(float(sector) / float(sectors), t);
+
+        if (shape.x == PROCEDURAL_SPHERE)
+        {
+            // stacks run from the north pole down
+            float stackAngle = PROCEDURAL_TWO_PI * (0.25 - 0.5 * t);
+            normal = vec3(cos(stackAngle) * ring.x, sin(stackAngle), cos(stackAngle) * ring.y);
+            position = normal * dimensions.x;
+            return;
+        }
+
+        float radius = mix(dimensions.x, dimensions.y, t);
+        position = vec3(ring.x * radius, dimensions.w + dimensions.z * t, ring.y * radius);
+        // tilted by the slope of the side, so a cone is lit along its length
+        normal = normalize(vec3(ring.x, (dimensions.x - dimensions.y) / dimensions.z, ring.y));
+        return;
+    }
+
+    // frustum caps: the top fan, then the bottom one wound the other way
+    int capVertex = vertex - sideVertices;
+    bool top = capVertex < 3 * sectors;
+    capVertex = capVertex % (3 * sectors);
+    int corner = capVertex % 3;
+    float y = dimensions.w + (top ? dimensions.z : 0.0);
+    normal = vec3(0.0, top ? 1.0 : -1.0, 0.0);
+    if (corner == 0)
+    {
+        position = vec3(0.0, y, 0.0);
+        uv = vec2(0.5);
+        return;
+    }
+    vec2 ring = proceduralRing(capVertex / 3 + (top ? corner - 1 : 2 - corner), sectors);
+    float radius = top ? dimensions.y : dimensions.x;
+    position = vec3(ring.x * radius, y, ring.y * radius);
+    uv = (ring + 1.0) * 0.5;
+}
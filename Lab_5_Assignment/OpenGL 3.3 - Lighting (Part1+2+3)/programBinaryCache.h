@@ -0,0 +1,199 @@
+//
+//  programBinaryCache.h
+//  test
+//
+//  On-disk cache of linked program binaries. A program is stored under a
+//  hash of its sources, its defines and the driver that built it, so a new
+//  driver or an edited shader simply misses and gets compiled from source.
+//
+
+#ifndef programBinaryCache_h
+#define programBinaryCache_h
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "glExtensions.h"
+
+class ProgramBinaryCache {
+public:
+    // folder the binaries are written to, relative to the working directory
+    std::string directory = "shader_cache";
+    // cleared by --no-shader-cache to force a cold start
+    bool enabled = true;
+
+    // fetch the entry points; call once after glad is loaded
+    void init(GLADloadproc loader)
+    {
+        supported = false;
+        if (!glVersionAtLeast(4, 1) && !hasGLExtension("GL_ARB_get_program_binary"))
+            return;
+
+        getProgramBinary = (GetProgramBinaryProc)loader("glGetProgramBinary");
+        programBinary = (ProgramBinaryProc)loader("glProgramBinary");
+        programParameteri = (ProgramParameteriProc)loader("glProgramParameteri");
+
+        // a driver may support the extension but offer no binary formats
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        supported = getProgramBinary && programBinary && programParameteri && formats > 0;
+
+        if (supported)
+        {
+            const char* vendor = (const char*)glGetString(GL_VENDOR);
+            const char* renderer = (const char*)glGetString(GL_RENDERER);
+            const char* version = (const char*)glGetString(GL_VERSION);
+            driver = std::string(vendor ? vendor : "") + "|" + (renderer ? renderer : "") + "|" + (version ? version : "");
+#ifdef _WIN32
+            _mkdir(directory.c_str());
+#else
+            mkdir(directory.c_str(), 0755);
+#endif
+        }
+    }
+
+    bool isActive() const { return enabled && supported; }
+
+    // 64 bit FNV-1a over everything that changes the compiled program
+    unsigned long long makeKey(const std::vector<const std::string*>& sources, const std::string& defines) const
+    {
+        unsigned long long hash = 14695981039346656037ull;
+        for (const std::string* source : sources)
+            hash = hashBytes(hash, *source);
+        hash = hashBytes(hash, defines);
+        hash = hashBytes(hash, driver);
+        return hash;
+    }
+
+    // ask the driver to keep the binary around; must be done before linking
+    void prepare(GLuint program) const
+    {
+        if (isActive())
+            programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // try to link the program from the cache; false means compile from source
+    bool load(GLuint program, unsigned long long key)
+    {
+        if (!isActive())
+            return false;
+
+        std::ifstream file(pathOf(key), std::ios::binary);
+        if (!file)
+            return false;
+
+        Header header;
+        file.read((char*)&header, sizeof(header));
+        std::vector<char> binary;
+        if (file && header.magic == MAGIC && header.key == key && header.length > 0)
+        {
+            binary.resize(header.length);
+            file.read(binary.data(), header.length);
+        }
+        file.close();
+
+        if (binary.empty() || !file)
+        {
+            discard(key);
+            return false;
+        }
+
+        programBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            // the driver is free to reject a binary at any time, e.g. after an update
+            std::cout << "WARNING::PROGRAM_BINARY_CACHE::BINARY_REJECTED: " << pathOf(key) << std::endl;
+            discard(key);
+            return false;
+        }
+
+        return true;
+    }
+
+    // write the binary of a successfully linked program
+    void store(GLuint program, unsigned long long key) const
+    {
+        if (!isActive())
+            return;
+
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+
+        std::vector<char> binary(length);
+        Header header;
+        header.magic = MAGIC;
+        header.key = key;
+        GLsizei written = 0;
+        getProgramBinary(program, length, &written, &header.format, binary.data());
+        header.length = (unsigned int)written;
+
+        std::ofstream file(pathOf(key), std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            std::cout << "WARNING::PROGRAM_BINARY_CACHE::CANNOT_WRITE: " << pathOf(key) << std::endl;
+            return;
+        }
+        file.write((const char*)&header, sizeof(header));
+        file.write(binary.data(), written);
+    }
+
+private:
+    static const unsigned int MAGIC = 0x42504C47; // "GLPB"
+
+    struct Header {
+        unsigned int magic = 0;
+        GLenum format = 0;
+        unsigned long long key = 0;
+        unsigned int length = 0;
+        unsigned int padding = 0;
+    };
+
+    bool supported = false;
+    std::string driver;
+    GetProgramBinaryProc getProgramBinary = nullptr;
+    ProgramBinaryProc programBinary = nullptr;
+    ProgramParameteriProc programParameteri = nullptr;
+
+    static unsigned long long hashBytes(unsigned long long hash, const std::string& bytes)
+    {
+        for (unsigned char c : bytes)
+            hash = (hash ^ c) * 1099511628211ull;
+        // separator, so ("ab", "c") and ("a", "bc") hash differently
+        return (hash ^ 0xFF) * 1099511628211ull;
+    }
+
+    std::string pathOf(unsigned long long key) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", key);
+        return directory + "/" + name;
+    }
+
+    void discard(unsigned long long key)
+    {
+        std::remove(pathOf(key).c_str());
+    }
+};
+
+inline ProgramBinaryCache& programBinaryCache()
+{
+    static ProgramBinaryCache cache;
+    return cache;
+}
+
+#endif /* programBinaryCache_h */
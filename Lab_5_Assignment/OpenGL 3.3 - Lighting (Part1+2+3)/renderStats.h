@@ -0,0 +1,214 @@
+//
+//  renderStats.h
+//  test
+//
+//  Per-frame counters for the render loop. Everything that wants to prove
+//  a cost went away (driver lookups, heap allocations, ...) bumps a counter
+//  here and endFrame() prints the totals of a frame now and then.
+//
+
+#ifndef renderStats_h
+#define renderStats_h
+
+#include <atomic>
+#include <iostream>
+
+class RenderStats {
+public:
+    // counters of the frame in flight, cleared by endFrame()
+    unsigned int uniformLocationLookups = 0;
+    unsigned int lightBufferUploads = 0;
+    unsigned int shaderVariantsBuilt = 0;
+    unsigned int uniformUploads = 0;
+    unsigned int uniformUploadsSkipped = 0;
+    unsigned int materialBufferUploads = 0;
+    unsigned int glStateCallsIssued = 0;
+    unsigned int glStateCallsSkipped = 0;
+    unsigned int drawCalls = 0;
+    unsigned int instancesDrawn = 0;
+    // instances whose vertices the shader made, see proceduralPrimitives.h
+    unsigned int proceduralInstancesDrawn = 0;
+    // bytes of vertices and indices the mesh draws read, and what they would
+    // as floats and 32-bit indices; see GeometryArena::countFetch()
+    unsigned int vertexBytesFetched = 0;
+    unsigned int unpackedVertexBytesFetched = 0;
+    unsigned int trianglesDrawn = 0;
+    // draws that picked each level of detail (LOD_COUNT in levelOfDetail.h)
+    unsigned int lodDraws[4] = { 0, 0, 0, 0 };
+    // scene graph nodes whose world matrix was recomputed, see sceneGraph.h
+    unsigned int transformsUpdated = 0;
+    // objects the frustum test kept and dropped, and what it cost; see frustumCulling.h
+    unsigned int objectsVisible = 0;
+    unsigned int objectsCulled = 0;
+    double cullSeconds = 0.0;
+    // refits of the scene's bounding volume hierarchy, see boundingVolumeHierarchy.h
+    unsigned int hierarchyRefits = 0;
+    double hierarchyRefitSeconds = 0.0;
+    // rooms seen through their doorways, and what that hid; see portalVisibility.h
+    unsigned int cellsVisible = 0;
+    unsigned int cellsTotal = 0;
+    unsigned int portalsTraversed = 0;
+    unsigned int objectsBehindPortals = 0;
+    double portalSeconds = 0.0;
+    // occluders drawn into the CPU depth buffer, and what they hid; see occlusionCulling.h
+    unsigned int occludersSelected = 0;
+    unsigned int occluderCandidates = 0;
+    unsigned int occluderTriangles = 0;
+    double occlusionRasterSeconds = 0.0;
+    unsigned int objectsOcclusionTested = 0;
+    unsigned int objectsOccluded = 0;
+    double occlusionTestSeconds = 0.0;
+    std::atomic<unsigned int> allocations{ 0 };
+
+    // startup counters, kept for the whole run
+    unsigned int programsFromBinary = 0;
+    unsigned int programsFromSource = 0;
+    unsigned int meshesBuilt = 0;
+    unsigned int meshesShared = 0;
+    unsigned int meshBuffersCreated = 0;
+    unsigned int geometryRepacks = 0;
+    double meshBuildSeconds = 0.0;
+    // summed over the meshes MeshOptimizer saw; ACMR is misses per triangle
+    unsigned int meshesOptimized = 0;
+    unsigned int optimizedTriangles = 0;
+    unsigned int cacheMissesBefore = 0;
+    unsigned int cacheMissesAfter = 0;
+    // building the scene's bounding volume hierarchy
+    unsigned int hierarchyNodes = 0;
+    double hierarchyBuildSeconds = 0.0;
+
+    // seconds between two printed reports
+    double reportInterval = 2.0;
+    // printed with every report so runs with different render paths can be
+    // told apart, e.g. "static batching off"
+    const char* mode = nullptr;
+
+    // print how long it took from process start to the first finished frame
+    void reportStartup(double seconds) const
+    {
+        std::cout << "startup: " << seconds * 1000.0 << " ms to first frame"
+            << ", programs loaded from binary cache " << programsFromBinary
+            << ", compiled from source " << programsFromSource
+            << ", meshes built " << meshesBuilt << " (" << meshBuildSeconds * 1000.0 << " ms)"
+            << ", shared " << meshesShared
+            << ", geometry buffers " << meshBuffersCreated
+            << " (repacked " << geometryRepacks << " times)";
+        if (hierarchyNodes > 0)
+            std::cout << ", BVH nodes " << hierarchyNodes << " (" << hierarchyBuildSeconds * 1000.0 << " ms)";
+        if (optimizedTriangles > 0)
+            std::cout << ", ACMR of " << meshesOptimized << " meshes " << (double)cacheMissesBefore / optimizedTriangles
+                << " -> " << (double)cacheMissesAfter / optimizedTriangles;
+        std::cout << std::endl;
+    }
+
+    // forget the frame times so far, e.g. right after switching render paths
+    void restartFrameTimes()
+    {
+        frameTimeTotal = 0.0;
+        framesTimed = 0;
+    }
+
+    void endFrame(double currentTime)
+    {
+        ++frameCount;
+        if (lastFrameTime > 0.0)
+        {
+            frameTimeTotal += currentTime - lastFrameTime;
+            ++framesTimed;
+        }
+        lastFrameTime = currentTime;
+
+        // always show the first two frames so the warm-up cost is visible next to the steady state
+        if (frameCount <= 2 || currentTime - lastReportTime >= reportInterval)
+        {
+            std::cout << "frame " << frameCount;
+            if (mode != nullptr)
+                std::cout << " [" << mode << "]";
+            if (framesTimed > 0)
+                std::cout << ", average frame time " << frameTimeTotal * 1000.0 / framesTimed << " ms";
+            std::cout << ": uniform location lookups " << uniformLocationLookups
+                << ", allocations " << allocations.load()
+                << ", light buffer uploads " << lightBufferUploads
+                << ", shader variants built " << shaderVariantsBuilt
+                << ", uniform uploads " << uniformUploads
+                << ", skipped " << uniformUploadsSkipped
+                << ", material buffer uploads " << materialBufferUploads
+                << ", state calls issued " << glStateCallsIssued
+                << ", skipped " << glStateCallsSkipped
+                << ", mesh draw calls " << drawCalls
+                << " (instances " << instancesDrawn << ", procedural " << proceduralInstancesDrawn << ")"
+                << ", vertex fetch " << vertexBytesFetched / 1024 << " KB"
+                << " (" << unpackedVertexBytesFetched / 1024 << " KB unpacked)"
+                << ", triangles " << trianglesDrawn
+                << ", LOD draws " << lodDraws[0] << "/" << lodDraws[1] << "/" << lodDraws[2] << "/" << lodDraws[3]
+                << ", transforms updated " << transformsUpdated
+                << ", culled " << objectsCulled << " of " << objectsVisible + objectsCulled
+                << " in " << cullSeconds * 1000000.0 << " us"
+                << ", BVH refits " << hierarchyRefits << " (" << hierarchyRefitSeconds * 1000000.0 << " us)"
+                << ", rooms visible " << cellsVisible << " of " << cellsTotal
+                << " (portals " << portalsTraversed << ", objects hidden " << objectsBehindPortals
+                << ", " << portalSeconds * 1000000.0 << " us)"
+                << ", occluders " << occludersSelected << " of " << occluderCandidates
+                << " (" << occluderTriangles << " triangles, " << occlusionRasterSeconds * 1000000.0 << " us)"
+                << ", occluded " << objectsOccluded << " of " << objectsOcclusionTested
+                << " (" << (objectsOcclusionTested ? objectsOccluded * 100.0 / objectsOcclusionTested : 0.0) << "%, "
+                << occlusionTestSeconds * 1000000.0 << " us)"
+                << std::endl;
+            lastReportTime = currentTime;
+            restartFrameTimes();
+        }
+
+        uniformLocationLookups = 0;
+        lightBufferUploads = 0;
+        shaderVariantsBuilt = 0;
+        uniformUploads = 0;
+        uniformUploadsSkipped = 0;
+        materialBufferUploads = 0;
+        glStateCallsIssued = 0;
+        glStateCallsSkipped = 0;
+        drawCalls = 0;
+        instancesDrawn = 0;
+        proceduralInstancesDrawn = 0;
+        vertexBytesFetched = 0;
+        unpackedVertexBytesFetched = 0;
+        trianglesDrawn = 0;
+        for (unsigned int& draws : lodDraws)
+            draws = 0;
+        transformsUpdated = 0;
+        objectsVisible = 0;
+        objectsCulled = 0;
+        cullSeconds = 0.0;
+        hierarchyRefits = 0;
+        hierarchyRefitSeconds = 0.0;
+        cellsVisible = 0;
+        cellsTotal = 0;
+        portalsTraversed = 0;
+        objectsBehindPortals = 0;
+        portalSeconds = 0.0;
+        occludersSelected = 0;
+        occluderCandidates = 0;
+        occluderTriangles = 0;
+        occlusionRasterSeconds = 0.0;
+        objectsOcclusionTested = 0;
+        objectsOccluded = 0;
+        occlusionTestSeconds = 0.0;
+        allocations = 0;
+    }
+
+    unsigned long long getFrameCount() const { return frameCount; }
+
+private:
+    unsigned long long frameCount = 0;
+    double lastReportTime = 0.0;
+    double lastFrameTime = 0.0;
+    double frameTimeTotal = 0.0;
+    unsigned int framesTimed = 0;
+};
+
+inline RenderStats& renderStats()
+{
+    static RenderStats stats;
+    return stats;
+}
+
+#endif /* renderStats_h */
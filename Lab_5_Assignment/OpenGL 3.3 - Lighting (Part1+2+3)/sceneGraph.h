@@ -0,0 +1,137 @@
+//
+//  sceneGraph.h
+//  test
+//
+//  Placement of everything in the room as a tree of nodes, each with a
+//  local translation, rotation and scale and a cached world matrix and
+//  normal matrix. Changing a node only marks it; update() then recomputes
+//  that node and everything under it and nothing else, so moving the
+//  global transform with the arrow or rotate keys touches the room node
+//  and its subtree, and a frame where nothing moved does no matrix math.
+//
+//  Nodes are kept in creation order, and a parent always exists before its
+//  children, so one pass in order sees every parent before its children.
+//
+
+#ifndef sceneGraph_h
+#define sceneGraph_h
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+#include <algorithm>
+
+#include "renderStats.h"
+
+const unsigned int NO_PARENT = ~0u;
+
+class SceneGraph {
+public:
+    SceneGraph() = default;
+    SceneGraph(const SceneGraph&) = delete;
+    SceneGraph& operator=(const SceneGraph&) = delete;
+
+    // a node under parent (NO_PARENT for a root); rotation is pitch, yaw and
+    // roll in degrees, applied about x, then y, then z, before the scale
+    unsigned int createNode(unsigned int parent, const glm::vec3& translation = glm::vec3(0.0f),
+        const glm::vec3& rotation = glm::vec3(0.0f), const glm::vec3& scale = glm::vec3(1.0f))
+    {
+        Node node;
+        node.parent = parent;
+        node.translation = translation;
+        node.rotation = rotation;
+        node.scale = scale;
+        nodes.push_back(node);
+        worlds.push_back(glm::mat4(1.0f));
+        normalMatrices.push_back(glm::mat3(1.0f));
+        unsigned int id = (unsigned int)nodes.size() - 1;
+        markDirty(id);
+        return id;
+    }
+
+    // a new transform for node; nothing is marked when it is the same as before
+    void setTransform(unsigned int node, const glm::vec3& translation, const glm::vec3& rotation, const glm::vec3& scale = glm::vec3(1.0f))
+    {
+        Node& target = nodes[node];
+        if (target.translation == translation && target.rotation == rotation && target.scale == scale)
+            return;
+        target.translation = translation;
+        target.rotation = rotation;
+        target.scale = scale;
+        markDirty(node);
+    }
+
+    // recompute the world and normal matrices of every marked node and of
+    // everything under one; call before reading them
+    void update()
+    {
+        ++updateCount;
+        if (firstDirty >= nodes.size())
+            return;
+        for (size_t i = firstDirty; i < nodes.size(); ++i)
+        {
+            Node& node = nodes[i];
+            bool parentChanged = node.parent != NO_PARENT && nodes[node.parent].updated == updateCount;
+            if (!node.dirty && !parentChanged)
+                continue;
+            glm::mat4 local = localMatrix(node);
+            worlds[i] = node.parent == NO_PARENT ? local : worlds[node.parent] * local;
+            normalMatrices[i] = glm::transpose(glm::inverse(glm::mat3(worlds[i])));
+            node.dirty = false;
+            node.updated = updateCount;
+            renderStats().transformsUpdated++;
+        }
+        firstDirty = nodes.size();
+    }
+
+    const glm::mat4& world(unsigned int node) const { return worlds[node]; }
+    const glm::mat3& normalMatrix(unsigned int node) const { return normalMatrices[node]; }
+
+    // whether the last update() recomputed node, i.e. whatever was derived
+    // from its world matrix (a culling box, ...) is stale
+    bool wasUpdated(unsigned int node) const { return nodes[node].updated == updateCount; }
+
+    size_t size() const { return nodes.size(); }
+
+private:
+    struct Node {
+        unsigned int parent;
+        glm::vec3 translation;
+        glm::vec3 rotation;
+        glm::vec3 scale;
+        bool dirty = false;
+        // updateCount of the last update() that recomputed the node
+        unsigned int updated = 0;
+    };
+
+    // the matrices are apart from the nodes so the draw loops read them packed
+    std::vector<Node> nodes;
+    std::vector<glm::mat4> worlds;
+    std::vector<glm::mat3> normalMatrices;
+    // nodes before this one are clean, and so are their children's parents
+    size_t firstDirty = 0;
+    unsigned int updateCount = 0;
+
+    void markDirty(unsigned int node)
+    {
+        nodes[node].dirty = true;
+        firstDirty = std::min(firstDirty, (size_t)node);
+    }
+
+    // the same chain the draw code used to build by hand: translate, rotate
+    // about x, y and z, scale
+    static glm::mat4 localMatrix(const Node& node)
+    {
+        glm::mat4 local = glm::translate(glm::mat4(1.0f), node.translation);
+        if (node.rotation.x != 0.0f)
+            local = glm::rotate(local, glm::radians(node.rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+        if (node.rotation.y != 0.0f)
+            local = glm::rotate(local, glm::radians(node.rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+        if (node.rotation.z != 0.0f)
+            local = glm::rotate(local, glm::radians(node.rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+        return glm::scale(local, node.scale);
+    }
+};
+
+#endif /* sceneGraph_h */
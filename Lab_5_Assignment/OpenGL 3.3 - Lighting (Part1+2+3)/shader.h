@@ -6,165 +6,786 @@
 
 #include <string>
 #include <fstream>
-#include <sstream>
 #include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+#include <memory>
+#include <atomic>
+
+#include "renderStats.h"
+#include "uniformBlocks.h"
+#include "programBinaryCache.h"
+#include "shaderBuildQueue.h"
+#include "shaderFileWatcher.h"
+#include "shaderCompileThread.h"
+#include "glState.h"
+
+// FNV-1a hash of a uniform name. constexpr so keys built from string literals
+// can be folded at compile time.
+constexpr unsigned int uniformNameHash(const char* name, unsigned int hash = 2166136261u)
+{
+    return *name ? uniformNameHash(name + 1, (hash ^ (unsigned char)*name) * 16777619u) : hash;
+}
+
+// pre-hashed uniform name, e.g. static constexpr UniformKey MODEL("model");
+struct UniformKey
+{
+    unsigned int hash;
+    constexpr explicit UniformKey(const char* name) : hash(uniformNameHash(name)) {}
+};
+
+// pre-resolved uniform, returned by Shader::getUniform(); -1 means inactive
+struct UniformHandle
+{
+    int slot = -1;
+};
+
+// #define lines put in front of a shader's source, e.g.
+//     ShaderDefines().set("TEXTURED").set("POINT_LIGHT_COUNT", 4)
+// they are part of the program binary cache key, so every set of defines
+// gets its own cached binary
+class ShaderDefines
+{
+public:
+    ShaderDefines& set(const std::string& name, const std::string& value = "")
+    {
+        source += "#define " + name + (value.empty() ? "" : " " + value) + "\n";
+        label += (label.empty() ? "" : " ") + name + (value.empty() ? "" : "=" + value);
+        return *this;
+    }
+    ShaderDefines& set(const std::string& name, int value)
+    {
+        return set(name, std::to_string(value));
+    }
+    const std::string& getSource() const { return source; }
+    const std::string& getLabel() const { return label; }
+    bool empty() const { return source.empty(); }
+
+private:
+    std::string source;
+    std::string label;
+};
+
+// append a shader file to out, replacing every  #include "file"  line with
+// that file (looked up next to the including file). #line directives keep
+// compiler messages pointing at the right line; the second number is the
+// include's position in the order files were opened
+// ------------------------------------------------------------------------
+inline bool appendShaderFile(const std::string& path, std::string& out, int& filesOpened, std::vector<std::string>* files = nullptr, int depth = 0)
+{
+    if (depth > 16)
+    {
+        std::cout << "ERROR::SHADER::INCLUDE_TOO_DEEP (include cycle?): " << path << std::endl;
+        return false;
+    }
+
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+        return false;
+    }
+    int fileNumber = filesOpened++;
+    if (files != nullptr)
+        files->push_back(path);
+    std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+
+    bool ok = true;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        ++lineNumber;
+        size_t start = line.find_first_not_of(" \t");
+        if (start != std::string::npos && line.compare(start, 8, "#include") == 0)
+        {
+            size_t open = line.find('"', start + 8);
+            size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+            if (close == std::string::npos)
+            {
+                std::cout << "ERROR::SHADER::BAD_INCLUDE: " << path << "(" << lineNumber << "): " << line << std::endl;
+                ok = false;
+                continue;
+            }
+            out += "#line 1 " + std::to_string(filesOpened) + "\n";
+            ok = appendShaderFile(directory + line.substr(open + 1, close - open - 1), out, filesOpened, files, depth + 1) && ok;
+            out += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileNumber) + "\n";
+            continue;
+        }
+        out += line;
+        out += '\n';
+    }
+    return ok;
+}
+
+// read a shader with its includes resolved and the defines placed right after
+// #version; every file that was read is added to files when it's given
+// ------------------------------------------------------------------------
+inline std::string preprocessShader(const std::string& path, const ShaderDefines& defines, std::vector<std::string>* files = nullptr)
+{
+    std::string code;
+    int filesOpened = 0;
+    appendShaderFile(path, code, filesOpened, files);
+    if (defines.empty())
+        return code;
+
+    // #version has to stay the first line; the defines go right below it
+    size_t version = code.find("#version");
+    size_t insertAt = version == std::string::npos ? 0 : code.find('\n', version);
+    insertAt = insertAt == std::string::npos ? code.size() : insertAt + 1;
+    int nextLine = version == std::string::npos ? 1 : 2;
+    code.insert(insertAt, defines.getSource() + "#line " + std::to_string(nextLine) + " 0\n");
+    return code;
+}
 
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor hands the shader to the driver; compile and link results
+    // are checked the first time the program is used
     // ------------------------------------------------------------------------
     Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+        : Shader(vertexPath, fragmentPath, ShaderDefines(), geometryPath)
+    {
+    }
+    Shader(const char* vertexPath, const char* fragmentPath, const ShaderDefines& defines, const char* geometryPath = nullptr)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), geometryPath(geometryPath != nullptr ? geometryPath : ""), defines(defines)
+    {
+        std::chrono::steady_clock::time_point submitStart = std::chrono::steady_clock::now();
+        build = submitBuild();
+        ID = build.program;
+
+        std::string name = this->vertexPath + " + " + this->fragmentPath;
+        if (!defines.empty())
+            name += " [" + defines.getLabel() + "]";
+        buildTicket = shaderBuildQueue().submit(name, ID, submitStart, build.fromBinary);
+
+        // every file that went into the program is watched for hot reload
+        for (const std::string& file : sourceFiles)
+            shaderFileWatcher().watch(file);
+        registry().push_back(this);
+    }
+    ~Shader()
+    {
+        std::vector<Shader*>& shaders = registry();
+        shaders.erase(std::remove(shaders.begin(), shaders.end(), this), shaders.end());
+    }
+    // the location table refers to this program only, so a Shader can't be copied
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
+    // activate the shader
+    // ------------------------------------------------------------------------
+    void use()
+    {
+        ensureBuilt();
+        glState().useProgram(ID);
+    }
+    // check the build now rather than at first use, e.g. before the render
+    // loop so that no frame waits for it
+    // ------------------------------------------------------------------------
+    void finish() const
+    {
+        ensureBuilt();
+    }
+    // false until the driver is done; never blocks, and without parallel
+    // compile support it stays false until the program has been used
+    // ------------------------------------------------------------------------
+    bool isReady() const
+    {
+        return built || shaderBuildQueue().isComplete(ID);
+    }
+    // material of the next draws, an index into the Materials block (see
+    // materials.h); one int per draw, and none when it didn't change
+    // ------------------------------------------------------------------------
+    void setMaterial(unsigned int materialIndex) const
+    {
+        setInt("materialIndex", (int)materialIndex);
+    }
+    // model matrix of the next draws with the matching normal matrix, so the
+    // lit programs don't invert the model matrix for every vertex; pass the
+    // normal matrix when it is cached already (see sceneGraph.h)
+    // ------------------------------------------------------------------------
+    void setModel(const glm::mat4& model, const glm::mat3& normalMatrix) const
+    {
+        setMat4("model", model);
+        setMat3("normalMatrix", normalMatrix);
+    }
+    void setModel(const glm::mat4& model) const
+    {
+        setModel(model, glm::transpose(glm::inverse(glm::mat3(model))));
+    }
+    // hot reload: rebuild every shader whose files were saved and swap the
+    // new program in once it has linked; call once a frame. A program that
+    // fails to build is thrown away and the old one keeps rendering
+    // ------------------------------------------------------------------------
+    static void updateHotReload()
+    {
+        static std::vector<std::string> changed;
+        shaderFileWatcher().poll(changed);
+        for (Shader* shader : registry())
+        {
+            if (!changed.empty() && shader->dependsOn(changed))
+                shader->startReload();
+            if (shader->reload.program != 0)
+                shader->finishReload();
+        }
+    }
+    // resolve a uniform once and keep the handle around for the hot path
+    // ------------------------------------------------------------------------
+    UniformHandle getUniform(UniformKey key) const
+    {
+        UniformHandle handle;
+        handle.slot = findSlot(key.hash);
+        return handle;
+    }
+    UniformHandle getUniform(const char* name) const
+    {
+        UniformHandle handle;
+        handle.slot = findSlot(uniformNameHash(name), name);
+        return handle;
+    }
+    // utility uniform functions
+    // every setter comes in four flavours: pre-resolved handle, pre-hashed key,
+    // C string (hashed on the fly, no allocation) and std::string. The last
+    // value sent to each uniform is kept, and sending the same value again
+    // costs a compare instead of a GL call
+    // ------------------------------------------------------------------------
+    void setBool(UniformHandle handle, bool value) const
+    {
+        int v = (int)value;
+        if (changed(handle, &v, sizeof(v)))
+            glUniform1i(locationOf(handle), v);
+    }
+    void setBool(UniformKey key, bool value) const { setBool(getUniform(key), value); }
+    void setBool(const char* name, bool value) const { setBool(getUniform(name), value); }
+    void setBool(const std::string& name, bool value) const { setBool(name.c_str(), value); }
+    // ------------------------------------------------------------------------
+    void setInt(UniformHandle handle, int value) const
+    {
+        if (changed(handle, &value, sizeof(value)))
+            glUniform1i(locationOf(handle), value);
+    }
+    void setInt(UniformKey key, int value) const { setInt(getUniform(key), value); }
+    void setInt(const char* name, int value) const { setInt(getUniform(name), value); }
+    void setInt(const std::string& name, int value) const { setInt(name.c_str(), value); }
+    // ------------------------------------------------------------------------
+    void setFloat(UniformHandle handle, float value) const
+    {
+        if (changed(handle, &value, sizeof(value)))
+            glUniform1f(locationOf(handle), value);
+    }
+    void setFloat(UniformKey key, float value) const { setFloat(getUniform(key), value); }
+    void setFloat(const char* name, float value) const { setFloat(getUniform(name), value); }
+    void setFloat(const std::string& name, float value) const { setFloat(name.c_str(), value); }
+    // ------------------------------------------------------------------------
+    void setVec2(UniformHandle handle, const glm::vec2& value) const
+    {
+        if (changed(handle, &value[0], 2 * sizeof(float)))
+            glUniform2fv(locationOf(handle), 1, &value[0]);
+    }
+    void setVec2(UniformKey key, const glm::vec2& value) const { setVec2(getUniform(key), value); }
+    void setVec2(const char* name, const glm::vec2& value) const { setVec2(getUniform(name), value); }
+    void setVec2(const std::string& name, const glm::vec2& value) const { setVec2(name.c_str(), value); }
+    void setVec2(const char* name, float x, float y) const { setVec2(getUniform(name), glm::vec2(x, y)); }
+    void setVec2(const std::string& name, float x, float y) const { setVec2(name.c_str(), glm::vec2(x, y)); }
+    // ------------------------------------------------------------------------
+    void setVec3(UniformHandle handle, const glm::vec3& value) const
+    {
+        if (changed(handle, &value[0], 3 * sizeof(float)))
+            glUniform3fv(locationOf(handle), 1, &value[0]);
+    }
+    void setVec3(UniformKey key, const glm::vec3& value) const { setVec3(getUniform(key), value); }
+    void setVec3(const char* name, const glm::vec3& value) const { setVec3(getUniform(name), value); }
+    void setVec3(const std::string& name, const glm::vec3& value) const { setVec3(name.c_str(), value); }
+    void setVec3(const char* name, float x, float y, float z) const { setVec3(getUniform(name), glm::vec3(x, y, z)); }
+    void setVec3(const std::string& name, float x, float y, float z) const { setVec3(name.c_str(), glm::vec3(x, y, z)); }
+    // ------------------------------------------------------------------------
+    void setVec4(UniformHandle handle, const glm::vec4& value) const
+    {
+        if (changed(handle, &value[0], 4 * sizeof(float)))
+            glUniform4fv(locationOf(handle), 1, &value[0]);
+    }
+    void setVec4(UniformKey key, const glm::vec4& value) const { setVec4(getUniform(key), value); }
+    void setVec4(const char* name, const glm::vec4& value) const { setVec4(getUniform(name), value); }
+    void setVec4(const std::string& name, const glm::vec4& value) const { setVec4(name.c_str(), value); }
+    void setVec4(const char* name, float x, float y, float z, float w) const { setVec4(getUniform(name), glm::vec4(x, y, z, w)); }
+    void setVec4(const std::string& name, float x, float y, float z, float w) const { setVec4(name.c_str(), glm::vec4(x, y, z, w)); }
+    // ------------------------------------------------------------------------
+    void setMat2(UniformHandle handle, const glm::mat2& mat) const
+    {
+        if (changed(handle, &mat[0][0], 4 * sizeof(float)))
+            glUniformMatrix2fv(locationOf(handle), 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat2(UniformKey key, const glm::mat2& mat) const { setMat2(getUniform(key), mat); }
+    void setMat2(const char* name, const glm::mat2& mat) const { setMat2(getUniform(name), mat); }
+    void setMat2(const std::string& name, const glm::mat2& mat) const { setMat2(name.c_str(), mat); }
+    // ------------------------------------------------------------------------
+    void setMat3(UniformHandle handle, const glm::mat3& mat) const
+    {
+        if (changed(handle, &mat[0][0], 9 * sizeof(float)))
+            glUniformMatrix3fv(locationOf(handle), 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat3(UniformKey key, const glm::mat3& mat) const { setMat3(getUniform(key), mat); }
+    void setMat3(const char* name, const glm::mat3& mat) const { setMat3(getUniform(name), mat); }
+    void setMat3(const std::string& name, const glm::mat3& mat) const { setMat3(name.c_str(), mat); }
+    // ------------------------------------------------------------------------
+    void setMat4(UniformHandle handle, const glm::mat4& mat) const
+    {
+        if (changed(handle, &mat[0][0], 16 * sizeof(float)))
+            glUniformMatrix4fv(locationOf(handle), 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat4(UniformKey key, const glm::mat4& mat) const { setMat4(getUniform(key), mat); }
+    void setMat4(const char* name, const glm::mat4& mat) const { setMat4(getUniform(name), mat); }
+    void setMat4(const std::string& name, const glm::mat4& mat) const { setMat4(name.c_str(), mat); }
+
+
+private:
+    // a program on its way from source (or the binary cache) to linked
+    struct ProgramBuild
     {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
+        GLuint program = 0;
+        GLuint stages[3] = { 0, 0, 0 };
+        unsigned long long cacheKey = 0;
+        bool fromBinary = false;
+        // set by the compile thread once it has linked the program, for a
+        // reload built there; null otherwise
+        std::shared_ptr<std::atomic<bool>> compiled;
+    };
+
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::string geometryPath;
+    ShaderDefines defines;
+    // the stage files and everything they include
+    std::vector<std::string> sourceFiles;
+
+    // build state between the constructor and first use
+    mutable ProgramBuild build;
+    mutable bool built = false;
+    int buildTicket = -1;
+    // replacement program being compiled after a source file changed
+    ProgramBuild reload;
+    int reloadFramesWaited = 0;
+    // saved again while the compile thread had the reload
+    bool reloadAgain = false;
+
+    // location table filled once at link time; names the program doesn't have
+    // are remembered as -1 the first time they are asked for. A slot keeps
+    // its index across hot reloads, so handles stay valid
+    mutable std::vector<GLint> uniformLocations;
+    mutable std::vector<std::string> uniformNames;
+    mutable std::unordered_map<unsigned int, int> uniformSlots;
+
+    // last value sent through each slot, big enough for a mat4
+    struct UniformValue
+    {
+        float data[16];
+        bool valid = false;
+    };
+    mutable std::vector<UniformValue> uniformValues;
+
+    static std::vector<Shader*>& registry()
+    {
+        static std::vector<Shader*> shaders;
+        return shaders;
+    }
+
+    // 1. retrieve the vertex/fragment source code from filePath, with includes
+    // resolved and the defines injected; 2. reuse the binary of an earlier run
+    // when sources and driver are unchanged; 3. otherwise compile and link,
+    // on the compile thread when onCompileThread is set
+    // ------------------------------------------------------------------------
+    ProgramBuild submitBuild(bool onCompileThread = false)
+    {
+        sourceFiles.clear();
+        std::string vertexCode = preprocessShader(vertexPath, defines, &sourceFiles);
+        std::string fragmentCode = preprocessShader(fragmentPath, defines, &sourceFiles);
         std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        try
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
-            // if geometry shader path is present, also load a geometry shader
-            if (geometryPath != nullptr)
+        // if geometry shader path is present, also load a geometry shader
+        if (!geometryPath.empty())
+            geometryCode = preprocessShader(geometryPath, defines, &sourceFiles);
+
+        ProgramBuild result;
+        result.program = glCreateProgram();
+        result.cacheKey = programBinaryCache().makeKey({ &vertexCode, &fragmentCode, &geometryCode }, defines.getSource());
+        result.fromBinary = programBinaryCache().load(result.program, result.cacheKey);
+        if (result.fromBinary)
+            renderStats().programsFromBinary++;
+        else
+        {
+            createStages(result, !geometryPath.empty());
+            if (onCompileThread)
             {
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
+                // the thread reads the link status, which is what waits for the driver
+                GLuint program = result.program;
+                GLuint stages[3] = { result.stages[0], result.stages[1], result.stages[2] };
+                result.compiled = std::make_shared<std::atomic<bool>>(false);
+                shaderCompileThread().run([program, stages, vertexCode, fragmentCode, geometryCode] {
+                    compileStages(program, stages, vertexCode, fragmentCode, stages[2] != 0 ? &geometryCode : nullptr);
+                    GLint linked = GL_FALSE;
+                    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+                }, result.compiled);
             }
+            else
+                compileStages(result.program, result.stages, vertexCode, fragmentCode, geometryPath.empty() ? nullptr : &geometryCode);
+            renderStats().programsFromSource++;
         }
-        catch (std::ifstream::failure& e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
-        }
+        return result;
+    }
+    static void createStages(ProgramBuild& result, bool geometry)
+    {
+        result.stages[0] = glCreateShader(GL_VERTEX_SHADER);
+        result.stages[1] = glCreateShader(GL_FRAGMENT_SHADER);
+        if (geometry)
+            result.stages[2] = glCreateShader(GL_GEOMETRY_SHADER);
+        programBinaryCache().prepare(result.program);
+    }
+    // issue compile and link without reading any status back
+    // ------------------------------------------------------------------------
+    static void compileStages(GLuint program, const GLuint (&stages)[3], const std::string& vertexCode, const std::string& fragmentCode, const std::string* geometryCode)
+    {
         const char* vShaderCode = vertexCode.c_str();
         const char* fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
         // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
+        glShaderSource(stages[0], 1, &vShaderCode, NULL);
+        glCompileShader(stages[0]);
         // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
+        glShaderSource(stages[1], 1, &fShaderCode, NULL);
+        glCompileShader(stages[1]);
         // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
-        if (geometryPath != nullptr)
+        if (geometryCode != nullptr)
         {
-            const char* gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
+            const char* gShaderCode = geometryCode->c_str();
+            glShaderSource(stages[2], 1, &gShaderCode, NULL);
+            glCompileShader(stages[2]);
         }
         // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if (geometryPath != nullptr)
-            glAttachShader(ID, geometry);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if (geometryPath != nullptr)
-            glDeleteShader(geometry);
-
+        for (GLuint stage : stages)
+        {
+            if (stage != 0)
+                glAttachShader(program, stage);
+        }
+        glLinkProgram(program);
     }
-    // activate the shader
+    // read the compile and link status (this is where a driver without
+    // parallel compile blocks) and store the binary of a good program
     // ------------------------------------------------------------------------
-    void use()
+    static bool completeBuild(ProgramBuild& result)
     {
-        glUseProgram(ID);
+        if (result.fromBinary)
+            return checkUniformHashes(result.program);
+
+        bool linked = true;
+        static const char* stageTypes[3] = { "VERTEX", "FRAGMENT", "GEOMETRY" };
+        for (int i = 0; i < 3; ++i)
+        {
+            if (result.stages[i] != 0 && !checkCompileErrors(result.stages[i], stageTypes[i]))
+                linked = false;
+        }
+        if (!checkCompileErrors(result.program, "PROGRAM") || !checkUniformHashes(result.program))
+            linked = false;
+        if (linked)
+            programBinaryCache().store(result.program, result.cacheKey);
+        // delete the shaders as they're linked into our program now and no longer necessary
+        for (GLuint& stage : result.stages)
+        {
+            if (stage != 0)
+                glDeleteShader(stage);
+            stage = 0;
+        }
+        return linked;
     }
-    // utility uniform functions
-    // ------------------------------------------------------------------------
-    void setBool(const std::string& name, bool value) const
+
+    static void discardBuild(ProgramBuild& result)
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        for (GLuint stage : result.stages)
+        {
+            if (stage != 0)
+                glDeleteShader(stage);
+        }
+        glState().deleteProgram(result.program);
+        result = ProgramBuild();
     }
-    // ------------------------------------------------------------------------
-    void setInt(const std::string& name, int value) const
+
+    void ensureBuilt() const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        if (!built)
+            finishBuild();
     }
+    // first use: check the build, fill the location table
     // ------------------------------------------------------------------------
-    void setFloat(const std::string& name, float value) const
+    void finishBuild() const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        std::chrono::steady_clock::time_point waitStart = std::chrono::steady_clock::now();
+        built = true;
+
+        bool linked = completeBuild(build);
+        bindSharedUniformBlocks(ID);
+        reflectUniforms();
+
+        double waitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waitStart).count();
+        shaderBuildQueue().finish(buildTicket, waitMs, linked);
     }
-    // ------------------------------------------------------------------------
-    void setVec2(const std::string& name, const glm::vec2& value) const
+
+    bool dependsOn(const std::vector<std::string>& files) const
+    {
+        for (const std::string& file : files)
+        {
+            if (std::find(sourceFiles.begin(), sourceFiles.end(), file) != sourceFiles.end())
+                return true;
+        }
+        return false;
+    }
+    void startReload()
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        // a save during a reload supersedes it; one the compile thread is
+        // working on is let finish first, it still owns the objects
+        if (reload.compiled && !reload.compiled->load())
+        {
+            reloadAgain = true;
+            return;
+        }
+        if (reload.program != 0)
+            discardBuild(reload);
+        std::vector<std::string> previousFiles = sourceFiles;
+        reload = submitBuild(shaderCompileThread().isRunning());
+        reloadFramesWaited = 0;
+        reloadAgain = false;
+        for (const std::string& file : sourceFiles)
+            shaderFileWatcher().watch(file);
+        // keep watching files the broken source may have lost an include of
+        for (const std::string& file : previousFiles)
+        {
+            if (std::find(sourceFiles.begin(), sourceFiles.end(), file) == sourceFiles.end())
+                sourceFiles.push_back(file);
+        }
     }
-    void setVec2(const std::string& name, float x, float y) const
+    // swap in the reloaded program as soon as the driver is done with it.
+    // With parallel compile the completion query never blocks, and a build
+    // on the compile thread is waited for there. With neither, reading the
+    // status blocks the render thread until the driver is done; that is
+    // left for the frame after submitting and reported when it happens
+    // ------------------------------------------------------------------------
+    void finishReload()
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        bool stalls = !reload.fromBinary && !reload.compiled && !shaderBuildQueue().isParallel();
+        bool complete = reload.fromBinary || shaderBuildQueue().isComplete(reload.program)
+            || (reload.compiled && reload.compiled->load()) || (stalls && reloadFramesWaited > 0);
+        if (!complete)
+        {
+            ++reloadFramesWaited;
+            return;
+        }
+        if (reloadAgain)
+        {
+            startReload();
+            return;
+        }
+
+        std::string name = vertexPath + " + " + fragmentPath + (defines.empty() ? "" : " [" + defines.getLabel() + "]");
+        std::chrono::steady_clock::time_point checkStart = std::chrono::steady_clock::now();
+        bool linked = completeBuild(reload);
+        if (stalls)
+            std::cout << "shader reload blocked the render thread for "
+                << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - checkStart).count()
+                << " ms (no parallel compile and no compile thread): " << name << std::endl;
+        if (!linked)
+        {
+            std::cout << "ERROR::SHADER::RELOAD_FAILED, keeping the old program: " << name << std::endl;
+            discardBuild(reload);
+            return;
+        }
+
+        ensureBuilt();
+        GLuint old = ID;
+        ID = reload.program;
+        build = reload;
+        reload = ProgramBuild();
+        bindSharedUniformBlocks(ID);
+        relocateUniforms();
+        glState().deleteProgram(old);
+        std::cout << "shader reloaded: " << name << std::endl;
     }
+
+    // read every active uniform of the linked program into the location table
     // ------------------------------------------------------------------------
-    void setVec3(const std::string& name, const glm::vec3& value) const
+    void reflectUniforms() const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> name(maxLength + 16);
+
+        for (GLint i = 0; i < count; ++i)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(ID, (GLuint)i, maxLength, &length, &size, &type, name.data());
+            GLint location = glGetUniformLocation(ID, name.data());
+            renderStats().uniformLocationLookups++;
+            // uniforms inside a uniform block have no location
+            if (location < 0)
+                continue;
+
+            addSlot(name.data(), location);
+
+            // arrays are reported as "name[0]"; also register "name" and every
+            // element, each at its own location (GL doesn't promise they follow on)
+            if (size > 1 && length > 3 && std::string(name.data() + length - 3) == "[0]")
+            {
+                std::string base(name.data(), length - 3);
+                addSlot(base.c_str(), location);
+                for (GLint element = 1; element < size; ++element)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    GLint elementLocation = glGetUniformLocation(ID, elementName.c_str());
+                    renderStats().uniformLocationLookups++;
+                    if (elementLocation >= 0)
+                        addSlot(elementName.c_str(), elementLocation);
+                }
+            }
+        }
     }
-    void setVec3(const std::string& name, float x, float y, float z) const
+    void addSlot(const char* name, GLint location) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        unsigned int hash = uniformNameHash(name);
+        auto it = uniformSlots.find(hash);
+        if (it != uniformSlots.end())
+        {
+            // checkUniformHashes() turned down programs where this could be another name
+            assert(it->second < 0 || uniformNames[it->second] == name);
+            return;
+        }
+        uniformSlots[hash] = (int)uniformLocations.size();
+        uniformLocations.push_back(location);
+        uniformNames.push_back(name);
+        uniformValues.push_back(UniformValue());
     }
+    // after a hot reload: look every known slot up in the new program, forget
+    // the remembered misses and pick up uniforms the new source added
     // ------------------------------------------------------------------------
-    void setVec4(const std::string& name, const glm::vec4& value) const
+    void relocateUniforms() const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        // the new program starts with its own default values
+        for (size_t slot = 0; slot < uniformLocations.size(); ++slot)
+        {
+            uniformLocations[slot] = glGetUniformLocation(ID, uniformNames[slot].c_str());
+            renderStats().uniformLocationLookups++;
+            uniformValues[slot].valid = false;
+        }
+        for (auto it = uniformSlots.begin(); it != uniformSlots.end();)
+        {
+            if (it->second < 0)
+                it = uniformSlots.erase(it);
+            else
+                ++it;
+        }
+        reflectUniforms();
     }
-    void setVec4(const std::string& name, float x, float y, float z, float w)
+    // find the slot of a hashed name; a name that wasn't reflected is asked
+    // from the driver once and cached, so the miss only costs on first use
+    // ------------------------------------------------------------------------
+    int findSlot(unsigned int hash, const char* name = nullptr) const
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        ensureBuilt();
+        auto it = uniformSlots.find(hash);
+        if (it != uniformSlots.end())
+        {
+            // a name the program doesn't have that hashes like one it has
+            assert(name == nullptr || it->second < 0 || uniformNames[it->second] == name);
+            return it->second;
+        }
+
+        GLint location = -1;
+        if (name != nullptr)
+        {
+            location = glGetUniformLocation(ID, name);
+            renderStats().uniformLocationLookups++;
+        }
+        int slot = -1;
+        if (location >= 0)
+        {
+            slot = (int)uniformLocations.size();
+            uniformLocations.push_back(location);
+            uniformNames.push_back(name);
+            uniformValues.push_back(UniformValue());
+        }
+        uniformSlots[hash] = slot;
+        return slot;
     }
-    // ------------------------------------------------------------------------
-    void setMat2(const std::string& name, const glm::mat2& mat) const
+    GLint locationOf(UniformHandle handle) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        return handle.slot < 0 ? -1 : uniformLocations[handle.slot];
     }
-    // ------------------------------------------------------------------------
-    void setMat3(const std::string& name, const glm::mat3& mat) const
+    // compare against the value the slot was last given and remember the new
+    // one; false means the GL call can be skipped (inactive uniforms included)
+    bool changed(UniformHandle handle, const void* value, size_t bytes) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        if (handle.slot < 0)
+            return false;
+        UniformValue& last = uniformValues[handle.slot];
+        if (last.valid && std::memcmp(last.data, value, bytes) == 0)
+        {
+            renderStats().uniformUploadsSkipped++;
+            return false;
+        }
+        std::memcpy(last.data, value, bytes);
+        last.valid = true;
+        renderStats().uniformUploads++;
+        return true;
     }
+
+    // two names of the program's uniforms with the same hash would share a
+    // slot, and setting one would set the other. The hashes are constants, so
+    // such a program is turned down like one that failed to link, until one
+    // of the uniforms is renamed
     // ------------------------------------------------------------------------
-    void setMat4(const std::string& name, const glm::mat4& mat) const
+    static bool checkUniformHashes(GLuint program)
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> name(maxLength + 16);
+        std::unordered_map<unsigned int, std::string> names;
+        bool unique = true;
+        auto add = [&](const std::string& uniform) {
+            auto inserted = names.insert(std::make_pair(uniformNameHash(uniform.c_str()), uniform));
+            if (!inserted.second && inserted.first->second != uniform)
+            {
+                std::cout << "ERROR::SHADER::UNIFORM_HASH_COLLISION: " << inserted.first->second << " and " << uniform << std::endl;
+                unique = false;
+            }
+        };
+
+        for (GLint i = 0; i < count; ++i)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(program, (GLuint)i, maxLength, &length, &size, &type, name.data());
+            add(std::string(name.data(), length));
+            // the same extra names reflectUniforms() registers for arrays
+            if (size > 1 && length > 3 && std::string(name.data() + length - 3) == "[0]")
+            {
+                std::string base(name.data(), length - 3);
+                add(base);
+                for (GLint element = 1; element < size; ++element)
+                    add(base + "[" + std::to_string(element) + "]");
+            }
+        }
+        return unique;
     }
 
-private:
     // utility function for checking shader compilation/linking errors.
+    // returns false when compiling or linking failed
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    static bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -186,6 +807,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success != 0;
     }
 };
 #endif
@@ -0,0 +1,144 @@
+//
+//  shaderBuildQueue.h
+//  test
+//
+//  Book-keeping for programs that were handed to the driver but not checked
+//  yet. Shader submits its compile and link without asking for the result;
+//  the status is only read when the program is first used, so the driver can
+//  build every program at once while the CPU goes on decoding textures.
+//
+
+#ifndef shaderBuildQueue_h
+#define shaderBuildQueue_h
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <iostream>
+
+#include "glExtensions.h"
+
+class ShaderBuildQueue {
+public:
+    // turn on driver side parallel compile if there is any; call once after glad is loaded
+    void init(GLADloadproc loader)
+    {
+        MaxShaderCompilerThreadsProc maxShaderCompilerThreads = nullptr;
+        if (hasGLExtension("GL_KHR_parallel_shader_compile"))
+            maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)loader("glMaxShaderCompilerThreadsKHR");
+        else if (hasGLExtension("GL_ARB_parallel_shader_compile"))
+            maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)loader("glMaxShaderCompilerThreadsARB");
+
+        parallel = maxShaderCompilerThreads != nullptr;
+        if (parallel)
+            // 0xFFFFFFFF lets the driver pick the number of threads
+            maxShaderCompilerThreads(0xFFFFFFFF);
+    }
+
+    bool isParallel() const { return parallel; }
+
+    // record a program whose compile and link were just issued; returns its ticket
+    int submit(const std::string& name, GLuint program, std::chrono::steady_clock::time_point start, bool fromBinary)
+    {
+        Build build;
+        build.name = name;
+        build.program = program;
+        build.start = start;
+        build.submitMs = millisecondsSince(start);
+        build.fromBinary = fromBinary;
+        builds.push_back(build);
+        return (int)builds.size() - 1;
+    }
+
+    // non-blocking; without the parallel compile extension there is no way
+    // to ask, so a program only counts as done once it has been checked
+    bool isComplete(GLuint program) const
+    {
+        if (!parallel)
+            return false;
+        GLint complete = GL_FALSE;
+        glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &complete);
+        return complete == GL_TRUE;
+    }
+
+    // note the time of every program the driver has finished in the meantime;
+    // cheap, so it can be sprinkled between other startup work
+    void poll()
+    {
+        for (Build& build : builds)
+        {
+            if (!build.checked && build.readyMs < 0.0 && isComplete(build.program))
+                build.readyMs = millisecondsSince(build.start);
+        }
+    }
+
+    // the program was checked at first use; waitMs is how long that blocked
+    void finish(int ticket, double waitMs, bool linked)
+    {
+        Build& build = builds[ticket];
+        build.checked = true;
+        build.linked = linked;
+        build.waitMs = waitMs;
+        if (build.readyMs < 0.0)
+            build.readyMs = millisecondsSince(build.start);
+
+        for (const Build& other : builds)
+        {
+            if (!other.checked)
+                return;
+        }
+        report();
+    }
+
+private:
+    struct Build {
+        std::string name;
+        GLuint program = 0;
+        std::chrono::steady_clock::time_point start;
+        double submitMs = 0.0;
+        // time from submit until the program was seen complete, -1 while unknown
+        double readyMs = -1.0;
+        double waitMs = 0.0;
+        bool fromBinary = false;
+        bool checked = false;
+        bool linked = false;
+        bool reported = false;
+    };
+
+    bool parallel = false;
+    std::vector<Build> builds;
+
+    static double millisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // print every program that finished since the last report
+    void report()
+    {
+        for (Build& build : builds)
+        {
+            if (build.reported)
+                continue;
+            std::cout << "shader build: " << build.name
+                << (build.fromBinary ? " (binary cache)" : " (source)")
+                << (build.linked ? "" : " FAILED")
+                << ": submit " << build.submitMs << " ms"
+                << ", ready after " << build.readyMs << " ms"
+                << ", blocked at first use " << build.waitMs << " ms"
+                << (parallel ? "" : " [no parallel compile]")
+                << std::endl;
+            build.reported = true;
+        }
+    }
+};
+
+inline ShaderBuildQueue& shaderBuildQueue()
+{
+    static ShaderBuildQueue queue;
+    return queue;
+}
+
+#endif /* shaderBuildQueue_h */
@@ -0,0 +1,117 @@
+//
+//  shaderCompileThread.h
+//  test
+//
+//  A thread with a GL context of its own, sharing objects with the window's,
+//  for hot reloads on drivers without parallel compile. There, reading the
+//  link status of a program blocks until the driver has compiled it, so a
+//  reload checked on the render thread stalls a frame, and saving a shared
+//  include stalls it for every variant at once. Here the compile, link and
+//  status read happen on the other context; the render thread only looks at
+//  a flag and swaps the program in once it is set, when reading its status
+//  no longer waits for anything.
+//
+
+#ifndef shaderCompileThread_h
+#define shaderCompileThread_h
+
+#include <glad/glad.h>
+
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+class ShaderCompileThread {
+public:
+    ShaderCompileThread() = default;
+    ShaderCompileThread(const ShaderCompileThread&) = delete;
+    ShaderCompileThread& operator=(const ShaderCompileThread&) = delete;
+    ~ShaderCompileThread() { stop(); }
+
+    // start the thread; it calls makeCurrent first, to make the shared
+    // context current there, and release before it ends
+    void start(std::function<void()> makeCurrent, std::function<void()> release)
+    {
+        stop();
+        stopping = false;
+        running = true;
+        worker = std::thread([this, makeCurrent, release] {
+            makeCurrent();
+            work();
+            release();
+        });
+    }
+
+    // finish the jobs already handed in and end the thread; call before the
+    // shared context goes away
+    void stop()
+    {
+        if (!running)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+        running = false;
+    }
+
+    bool isRunning() const { return running; }
+
+    // run job on the thread; done is set once it has returned, and whatever
+    // it did to shared objects is finished by then
+    void run(std::function<void()> job, std::shared_ptr<std::atomic<bool>> done)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(Job{ std::move(job), std::move(done) });
+        }
+        wake.notify_one();
+    }
+
+private:
+    struct Job {
+        std::function<void()> run;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+
+    std::thread worker;
+    bool running = false;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Job> jobs;
+    bool stopping = false;
+
+    void work()
+    {
+        for (;;)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job.run();
+            // the render thread's context sees the changes once they are done
+            glFinish();
+            job.done->store(true);
+        }
+    }
+};
+
+inline ShaderCompileThread& shaderCompileThread()
+{
+    static ShaderCompileThread thread;
+    return thread;
+}
+
+#endif /* shaderCompileThread_h */
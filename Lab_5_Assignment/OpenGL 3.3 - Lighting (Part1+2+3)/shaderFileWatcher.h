@@ -0,0 +1,162 @@
+//
+//  shaderFileWatcher.h
+//  test
+//
+//  Tells Shader which of its source files were saved since the last frame.
+//  On Linux this is inotify on the folders the files live in (editors that
+//  save through a temp file and rename are caught too); elsewhere, or when
+//  inotify isn't available, the modification times are polled twice a second.
+//
+
+#ifndef shaderFileWatcher_h
+#define shaderFileWatcher_h
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+class ShaderFileWatcher {
+public:
+    // seconds between two modification time checks when there's no inotify
+    double pollInterval = 0.5;
+
+    ShaderFileWatcher()
+    {
+#ifdef __linux__
+        inotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyFD < 0)
+            std::cout << "WARNING::SHADER_FILE_WATCHER::NO_INOTIFY, polling file times instead" << std::endl;
+#endif
+    }
+    ~ShaderFileWatcher()
+    {
+#ifdef __linux__
+        if (inotifyFD >= 0)
+            close(inotifyFD);
+#endif
+    }
+    ShaderFileWatcher(const ShaderFileWatcher&) = delete;
+    ShaderFileWatcher& operator=(const ShaderFileWatcher&) = delete;
+
+    void watch(const std::string& path)
+    {
+        for (const WatchedFile& file : files)
+        {
+            if (file.path == path)
+                return;
+        }
+        WatchedFile file;
+        file.path = path;
+        file.modified = modificationTime(path);
+        files.push_back(file);
+
+#ifdef __linux__
+        if (inotifyFD >= 0)
+        {
+            std::string directory = path.substr(0, path.find_last_of('/') + 1);
+            int wd = inotify_add_watch(inotifyFD, directory.empty() ? "." : directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+            if (wd >= 0 && std::find(watchedDirectories.begin(), watchedDirectories.end(), WatchedDirectory{ wd, directory }) == watchedDirectories.end())
+                watchedDirectories.push_back(WatchedDirectory{ wd, directory });
+        }
+#endif
+    }
+
+    // fill changed with the watched files saved since the last call; never blocks
+    void poll(std::vector<std::string>& changed)
+    {
+        changed.clear();
+#ifdef __linux__
+        if (inotifyFD >= 0)
+        {
+            readEvents(changed);
+            return;
+        }
+#endif
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (std::chrono::duration<double>(now - lastPoll).count() < pollInterval)
+            return;
+        lastPoll = now;
+
+        for (WatchedFile& file : files)
+        {
+            time_t modified = modificationTime(file.path);
+            if (modified != file.modified)
+            {
+                file.modified = modified;
+                changed.push_back(file.path);
+            }
+        }
+    }
+
+private:
+    struct WatchedFile {
+        std::string path;
+        time_t modified = 0;
+    };
+    std::vector<WatchedFile> files;
+    std::chrono::steady_clock::time_point lastPoll;
+
+    static time_t modificationTime(const std::string& path)
+    {
+        struct stat info;
+        return stat(path.c_str(), &info) == 0 ? info.st_mtime : 0;
+    }
+
+#ifdef __linux__
+    struct WatchedDirectory {
+        int wd;
+        std::string prefix;
+        bool operator==(const WatchedDirectory& other) const { return wd == other.wd; }
+    };
+    int inotifyFD = -1;
+    std::vector<WatchedDirectory> watchedDirectories;
+
+    void readEvents(std::vector<std::string>& changed)
+    {
+        alignas(struct inotify_event) char buffer[4096];
+        for (;;)
+        {
+            ssize_t length = read(inotifyFD, buffer, sizeof(buffer));
+            if (length <= 0)
+                return;
+
+            for (char* at = buffer; at < buffer + length; at += sizeof(struct inotify_event) + ((struct inotify_event*)at)->len)
+            {
+                const struct inotify_event* event = (const struct inotify_event*)at;
+                if (event->len == 0)
+                    continue;
+                for (const WatchedDirectory& directory : watchedDirectories)
+                {
+                    if (directory.wd != event->wd)
+                        continue;
+                    std::string path = directory.prefix + event->name;
+                    bool watched = false;
+                    for (const WatchedFile& file : files)
+                        watched = watched || file.path == path;
+                    if (watched && std::find(changed.begin(), changed.end(), path) == changed.end())
+                        changed.push_back(path);
+                }
+            }
+        }
+    }
+#endif
+};
+
+inline ShaderFileWatcher& shaderFileWatcher()
+{
+    static ShaderFileWatcher watcher;
+    return watcher;
+}
+
+#endif /* shaderFileWatcher_h */
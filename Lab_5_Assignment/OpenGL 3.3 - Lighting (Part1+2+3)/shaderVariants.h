@@ -0,0 +1,112 @@
+//
+//  shaderVariants.h
+//  test
+//
+//  Specialised builds of the Phong program. Each variant has the active
+//  light set compiled in (number of point lights, directional on/off, spot
+//  on/off, textured or not, instanced or not, 2D textures or texture
+//  arrays, packed, float or procedural vertices), so toggling lights swaps
+//  to a program without the dead branches instead of testing them for
+//  every pixel.
+//
+
+#ifndef shaderVariants_h
+#define shaderVariants_h
+
+#include <string>
+#include <memory>
+#include <unordered_map>
+
+#include "shader.h"
+#include "renderStats.h"
+
+struct LightingVariant {
+    int pointLights = 0;
+    bool directional = false;
+    bool spot = false;
+    bool textured = false;
+    // model and normal matrices come from instance attributes, see instanceQueue.h
+    bool instanced = false;
+    // maps are sampled from texture arrays by the layers in the material, see textureArrays.h
+    bool textureArray = false;
+    // positions and normals come packed, see vertexPacking.h
+    bool compactVertices = false;
+    // vertices are made from gl_VertexID, see proceduralPrimitives.h; implies instanced
+    bool procedural = false;
+
+    // pointLights fits in the low 8 bits, MAX_POINT_LIGHTS is 128
+    unsigned int key() const
+    {
+        return (unsigned int)pointLights | (directional ? 1u << 8 : 0u) | (spot ? 1u << 9 : 0u) | (textured ? 1u << 10 : 0u)
+            | (instanced ? 1u << 11 : 0u) | (textureArray ? 1u << 12 : 0u)
+            | (compactVertices ? 1u << 13 : 0u) | (procedural ? 1u << 14 : 0u);
+    }
+
+    ShaderDefines defines() const
+    {
+        ShaderDefines result;
+        result.set("LIGHTING_VARIANT");
+        result.set("POINT_LIGHT_COUNT", pointLights);
+        if (directional)
+            result.set("DIRECTIONAL_LIGHT");
+        if (spot)
+            result.set("SPOT_LIGHT");
+        if (textured)
+            result.set("TEXTURED");
+        if (instanced)
+            result.set("INSTANCED");
+        if (textureArray)
+            result.set("TEXTURE_ARRAY");
+        if (compactVertices)
+            result.set("COMPACT_VERTICES");
+        if (procedural)
+            result.set("PROCEDURAL");
+        return result;
+    }
+};
+
+class LightingShaderVariants {
+public:
+    LightingShaderVariants(const char* vertexPath, const char* fragmentPath)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath)
+    {
+    }
+    LightingShaderVariants(const LightingShaderVariants&) = delete;
+    LightingShaderVariants& operator=(const LightingShaderVariants&) = delete;
+
+    // the program for this light set; built the first time it is asked for,
+    // a plain lookup after that
+    Shader& select(const LightingVariant& variant)
+    {
+        auto it = variants.find(variant.key());
+        if (it != variants.end())
+            return *it->second;
+
+        renderStats().shaderVariantsBuilt++;
+        Shader* shader = new Shader(vertexPath.c_str(), fragmentPath.c_str(), variant.defines());
+        variants[variant.key()].reset(shader);
+        return *shader;
+    }
+
+    // submit a variant ahead of time so its first frame doesn't wait on the compiler
+    void prewarm(const LightingVariant& variant)
+    {
+        select(variant);
+    }
+
+    // check every submitted variant; blocks until the driver is done with them
+    void finishAll()
+    {
+        for (auto& variant : variants)
+            variant.second->finish();
+    }
+
+    size_t size() const { return variants.size(); }
+
+private:
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::unordered_map<unsigned int, std::unique_ptr<Shader>> variants;
+};
+
+#endif /* shaderVariants_h */
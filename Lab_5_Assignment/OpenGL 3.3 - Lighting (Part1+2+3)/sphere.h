@@ -14,6 +14,11 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "shader.h"
+#include "glState.h"
+#include "materials.h"
+#include "meshRegistry.h"
+#include "levelOfDetail.h"
+#include "proceduralPrimitives.h"
 
 # define PI 3.1416
 
@@ -30,6 +35,10 @@ public:
     glm::vec3 specular;
     float shininess;
 
+    // row of the material table, shared with every primitive that has the
+    // same values; see materials.h
+    unsigned int materialID = DEFAULT_MATERIAL;
+
     // Constructor/Destructor
     Sphere(float radius = 1.0f, int sectorCount = 20, int stackCount = 18,
         glm::vec3 amb = glm::vec3(0.24725f, 0.2245f, 0.0645f),
@@ -39,43 +48,7 @@ public:
         : verticesStride(24)
     {
         set(radius, sectorCount, stackCount, amb, diff, spec, shiny);
-        buildCoordinatesAndIndices();
-        buildVertices();
-
-        glGenVertexArrays(1, &sphereVAO);
-        glBindVertexArray(sphereVAO);
-
-        // Create VBO to copy vertex data
-        unsigned int sphereVBO;
-        glGenBuffers(1, &sphereVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
-        glBufferData(GL_ARRAY_BUFFER,
-            this->getVertexSize(),
-            this->getVertices(),
-            GL_STATIC_DRAW);
-
-        // Create EBO to copy index data
-        unsigned int sphereEBO;
-        glGenBuffers(1, &sphereEBO);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereEBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-            this->getIndexSize(),
-            this->getIndices(),
-            GL_STATIC_DRAW);
-
-        // Activate attribute arrays
-        glEnableVertexAttribArray(0); // Position
-        glEnableVertexAttribArray(1); // Normal
-
-        // Set attribute arrays with stride and offset
-        int stride = this->getVerticesStride();
-        glVertexAttribPointer(0, 3, GL_FLOAT, false, stride, (void*)0);
-        glVertexAttribPointer(1, 3, GL_FLOAT, false, stride, (void*)(sizeof(float) * 3));
-
-        // Unbind VAO and buffers
-        glBindVertexArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        acquireLods();
     }
     ~Sphere() {}
 
@@ -89,9 +62,12 @@ public:
         this->diffuse = diff;
         this->specular = spec;
         this->shininess = shiny;
+        this->materialID = registerMaterial(amb, diff, spec, shiny);
     }
 
-    // Getters for interleaved vertices
+    // Getters for interleaved vertices; the arrays are only filled while the
+    // first sphere of this shape builds the shared meshes, and hold the
+    // last level that was built
     unsigned int getVertexCount() const { return (unsigned int)coordinates.size() / 3; }
     unsigned int getVertexSize() const { return (unsigned int)vertices.size() * sizeof(float); }
     int getVerticesStride() const { return verticesStride; }
@@ -105,27 +81,51 @@ public:
     {
         lightingShader.use();
 
-        // Set material properties
-        lightingShader.setVec3("material.ambient", this->ambient);
-        lightingShader.setVec3("material.diffuse", this->diffuse);
-        lightingShader.setVec3("material.specular", this->specular);
-        lightingShader.setFloat("material.shininess", this->shininess);
-
-        lightingShader.setMat4("model", model);
-
-        // Draw the sphere
-        glBindVertexArray(sphereVAO);
-        glDrawElements(GL_TRIANGLES,
-            this->getIndexCount(),
-            GL_UNSIGNED_INT,
-            (void*)0);
-        glBindVertexArray(0);
+        // Select the material's row of the Materials block
+        lightingShader.setMaterial(materialID);
+
+        lightingShader.setModel(model);
+
+        // Draw the sphere at the level of detail its size on screen asks for
+        lods.select(model).draw();
+    }
+
+    // Queue the sphere to be made in the vertex shader, at the sectors and
+    // stacks of the level of detail it would have drawn; see proceduralPrimitives.h
+    void drawSphere(ProceduralQueue& queue, const glm::mat4& model) const
+    {
+        int level = lods.selectLevel(model);
+        queue.add(ProceduralShape::sphere(radius, lodSectorCount(sectorCount, level, MIN_SECTOR_COUNT),
+            lodSectorCount(stackCount, level, MIN_STACK_COUNT)), materialID, model);
     }
 
 private:
     // Helper functions
+    // the full mesh and LOD_COUNT - 1 coarser ones with half the sectors and stacks each
+    void acquireLods()
+    {
+        int fullSectorCount = sectorCount, fullStackCount = stackCount;
+        for (int level = 0; level < LOD_COUNT; ++level)
+        {
+            sectorCount = lodSectorCount(fullSectorCount, level, MIN_SECTOR_COUNT);
+            stackCount = lodSectorCount(fullStackCount, level, MIN_STACK_COUNT);
+            lods.meshes[level] = meshRegistry().acquire(MeshKey("sphere") << this->radius << this->sectorCount << this->stackCount,
+                [this](Mesh& sphereMesh) {
+                    buildCoordinatesAndIndices();
+                    buildVertices();
+                    setUpMesh(sphereMesh);
+                });
+        }
+        sectorCount = fullSectorCount;
+        stackCount = fullStackCount;
+        lods.boundingRadius = radius;
+    }
+
     void buildCoordinatesAndIndices()
     {
+        coordinates.clear();
+        normals.clear();
+        indices.clear();
         float x, y, z, xz;
         float nx, ny, nz, lengthInv = 1.0f / radius;
         float sectorStep = 2 * PI / sectorCount;
@@ -178,8 +178,16 @@ private:
         }
     }
 
+    void setUpMesh(Mesh& sphereMesh)
+    {
+        // Copy vertex and index data into the geometry arena
+        sphereMesh.setData(LAYOUT_POSITION_NORMAL, this->getVertices(), (GLsizei)this->getVertexCount(),
+            this->getIndices(), (GLsizei)this->getIndexCount());
+    }
+
     void buildVertices()
     {
+        vertices.clear();
         size_t i, j;
         size_t count = coordinates.size();
         for (i = 0, j = 0; i < count; i += 3, j += 2)
@@ -195,7 +203,8 @@ private:
     }
 
     // Member variables
-    unsigned int sphereVAO;
+    // shared with every sphere of the same shape, one mesh per level of detail
+    LodChain lods;
     float radius;
     int sectorCount;
     int stackCount;
@@ -0,0 +1,126 @@
+//
+//  staticBatch.h
+//  test
+//
+//  Scenery that never moves relative to the rest of the room, baked at
+//  load time into one mesh per material. Every queued object is appended
+//  to the mesh of its material with its own model matrix applied (see
+//  meshBuilder.h), so a frame draws the walls, the floor, the counters and
+//  the wall designs with one draw per material and the global transform as
+//  the only matrix.
+//
+
+#ifndef staticBatch_h
+#define staticBatch_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <iostream>
+
+#include "shader.h"
+#include "glState.h"
+#include "geometryArena.h"
+#include "meshBuilder.h"
+#include "materials.h"
+#include "instanceQueue.h"
+
+class StaticBatch {
+public:
+    StaticBatch() = default;
+    StaticBatch(const StaticBatch&) = delete;
+    StaticBatch& operator=(const StaticBatch&) = delete;
+
+    // merge everything queued in scenery into one mesh per material, with
+    // the vertices already in the space the instance matrices put them in;
+    // the queue is left empty
+    void build(InstanceQueue& scenery)
+    {
+        release();
+
+        std::vector<Merged> merged;
+        size_t objects = 0;
+        scenery.visit([&](const InstanceQueue::BatchKey& key, const std::vector<InstanceData>& instances) {
+            for (const InstanceData& instance : instances)
+            {
+                Merged& target = findMerged(merged, instance.materialIndex);
+                if (target.builder.append(key.geometry, key.count, instance.model, instance.normalMatrix))
+                    ++objects;
+            }
+        });
+        scenery.clear();
+
+        size_t vertexTotal = 0;
+        for (Merged& mesh : merged)
+        {
+            Part part;
+            part.materialID = mesh.materialID;
+            part.vertexCount = (GLsizei)mesh.builder.getVertexCount();
+            part.geometry = mesh.builder.upload();
+            parts.push_back(part);
+            vertexTotal += (size_t)part.vertexCount;
+        }
+        std::cout << "static batch: " << objects << " objects merged into " << parts.size()
+            << " meshes, " << vertexTotal << " vertices" << std::endl;
+    }
+
+    // draw every merged mesh with a non-instanced textured Phong program
+    // that samples 2D maps; model (and its normal matrix) moves the whole batch
+    void draw(Shader& shader, const glm::mat4& model, const glm::mat3& normalMatrix) const
+    {
+        if (parts.empty())
+            return;
+        shader.use();
+        shader.setInt("material.diffuse", 0);
+        shader.setInt("material.specular", 1);
+        shader.setModel(model, normalMatrix);
+        for (const Part& part : parts)
+        {
+            // the queue keys may name texture arrays; the material has the maps themselves
+            const MaterialDescription& material = materialRegistry().get(part.materialID);
+            shader.setMaterial(part.materialID);
+            glState().bindTextureToUnit(0, GL_TEXTURE_2D, material.diffuseMap);
+            glState().bindTextureToUnit(1, GL_TEXTURE_2D, material.specularMap);
+            geometryArena().draw(part.geometry);
+        }
+    }
+
+    size_t size() const { return parts.size(); }
+
+    // give the merged meshes back to the arena
+    void release()
+    {
+        for (const Part& part : parts)
+            geometryArena().remove(part.geometry);
+        parts.clear();
+    }
+
+private:
+    // one per material
+    struct Part {
+        unsigned int materialID = 0;
+        unsigned int geometry = 0;
+        GLsizei vertexCount = 0;
+    };
+    struct Merged {
+        unsigned int materialID;
+        MeshBuilder builder;
+    };
+
+    std::vector<Part> parts;
+
+    // materials are unique per colours and maps, so the index alone tells meshes apart
+    static Merged& findMerged(std::vector<Merged>& merged, unsigned int materialID)
+    {
+        for (Merged& mesh : merged)
+        {
+            if (mesh.materialID == materialID)
+                return mesh;
+        }
+        merged.push_back(Merged{ materialID, MeshBuilder() });
+        return merged.back();
+    }
+};
+
+#endif /* staticBatch_h */
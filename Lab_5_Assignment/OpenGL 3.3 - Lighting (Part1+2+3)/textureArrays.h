@@ -0,0 +1,218 @@
+//
+//  textureArrays.h
+//  test
+//
+//  Packs the scene's 2D textures into GL_TEXTURE_2D_ARRAY layers so draws
+//  that only differ by texture can share one draw call. loadTexture() hands
+//  every image it loads to add(); build() then resamples each one to a
+//  square power-of-two layer, groups the layers by size into one array per
+//  size and uploads them. Materials store the layer of their maps (see
+//  materials.h) and the TEXTURE_ARRAY variant of the Phong shaders samples
+//  by layer, so a draw only has to bind the arrays.
+//
+//  The plain 2D textures stay around for the draw paths that still bind
+//  them one by one.
+//
+
+#ifndef textureArrays_h
+#define textureArrays_h
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <iostream>
+
+#include "glState.h"
+
+class TextureArrayManager {
+public:
+    // off: nothing is packed and find() always fails, so every draw binds
+    // its own 2D textures as before
+    bool enabled = true;
+    // images are resampled to the nearest power of two within these bounds
+    int minLayerSize = 64;
+    int maxLayerSize = 1024;
+
+    TextureArrayManager() = default;
+    TextureArrayManager(const TextureArrayManager&) = delete;
+    TextureArrayManager& operator=(const TextureArrayManager&) = delete;
+
+    // keep a resampled copy of the pixels of a 2D texture for build(); a
+    // path that was added before shares the earlier layer
+    void add(GLuint texture, const char* path, const unsigned char* pixels, int width, int height, int components)
+    {
+        if (!enabled || built || pixels == nullptr)
+            return;
+        auto known = byPath.find(path);
+        if (known != byPath.end())
+        {
+            entries[texture] = known->second;
+            return;
+        }
+
+        int size = layerSize(width, height);
+        size_t group = 0;
+        while (group < groups.size() && groups[group].size != size)
+            ++group;
+        if (group == groups.size())
+        {
+            groups.push_back(Group());
+            groups.back().size = size;
+        }
+
+        std::vector<unsigned char> layer((size_t)size * size * 4);
+        resample(pixels, width, height, components, size, layer.data());
+        groups[group].layers.push_back(std::move(layer));
+
+        Entry entry = { group, (int)groups[group].layers.size() - 1 };
+        entries[texture] = entry;
+        byPath[path] = entry;
+    }
+
+    // create and fill one array per layer size; call once every texture is loaded
+    void build()
+    {
+        if (!enabled || built)
+            return;
+        size_t bytes = 0;
+        for (Group& group : groups)
+        {
+            GLsizei layers = (GLsizei)group.layers.size();
+            glGenTextures(1, &group.array);
+            glState().bindTexture(GL_TEXTURE_2D_ARRAY, group.array);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, group.size, group.size, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            for (GLsizei layer = 0; layer < layers; ++layer)
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, group.size, group.size, 1, GL_RGBA, GL_UNSIGNED_BYTE, group.layers[layer].data());
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+            // the pixels are on the GPU now
+            std::vector<std::vector<unsigned char>>().swap(group.layers);
+            bytes += (size_t)group.size * group.size * 4 * layers * 4 / 3;
+            group.layerCount = layers;
+        }
+        built = true;
+
+        std::cout << "texture arrays: " << byPath.size() << " images in " << groups.size() << " arrays (";
+        for (size_t i = 0; i < groups.size(); ++i)
+            std::cout << (i ? ", " : "") << groups[i].layerCount << " x " << groups[i].size << "px";
+        std::cout << "), " << bytes / 1024 << " KB with mipmaps" << std::endl;
+    }
+
+    bool isBuilt() const { return built; }
+
+    // the array and layer a 2D texture was packed into; false when it wasn't
+    bool find(GLuint texture, GLuint& array, int& layer) const
+    {
+        if (!built)
+            return false;
+        auto it = entries.find(texture);
+        if (it == entries.end())
+            return false;
+        array = groups[it->second.group].array;
+        layer = it->second.layer;
+        return true;
+    }
+
+    // delete the arrays while the context is still alive
+    void release()
+    {
+        for (Group& group : groups)
+        {
+            if (group.array != 0)
+                glState().deleteTextures(1, &group.array);
+        }
+        groups.clear();
+        entries.clear();
+        byPath.clear();
+        built = false;
+    }
+
+private:
+    struct Group {
+        int size = 0;
+        GLuint array = 0;
+        GLsizei layerCount = 0;
+        // RGBA pixels waiting for build()
+        std::vector<std::vector<unsigned char>> layers;
+    };
+    struct Entry {
+        size_t group;
+        int layer;
+    };
+
+    std::vector<Group> groups;
+    std::unordered_map<GLuint, Entry> entries;
+    std::unordered_map<std::string, Entry> byPath;
+    bool built = false;
+
+    // nearest power of two to the longer side, within the bounds
+    int layerSize(int width, int height) const
+    {
+        int longer = std::max(width, height);
+        int size = 1;
+        while (size * 2 <= longer)
+            size *= 2;
+        if (longer - size > size * 2 - longer)
+            size *= 2;
+        return std::min(std::max(size, minLayerSize), maxLayerSize);
+    }
+
+    // channel c (0-3, RGBA) of a pixel with 1 to 4 components
+    static unsigned char channel(const unsigned char* pixel, int components, int c)
+    {
+        switch (components)
+        {
+        case 1: return c < 3 ? pixel[0] : 255;
+        case 2: return c < 3 ? pixel[0] : pixel[1];
+        case 3: return c < 3 ? pixel[c] : 255;
+        default: return pixel[c];
+        }
+    }
+
+    // bilinear resample to size x size RGBA; the mipmaps smooth what this
+    // misses when shrinking a lot
+    static void resample(const unsigned char* source, int width, int height, int components, int size, unsigned char* target)
+    {
+        for (int y = 0; y < size; ++y)
+        {
+            float sy = std::min(std::max((y + 0.5f) * height / size - 0.5f, 0.0f), (float)(height - 1));
+            int y0 = (int)sy;
+            int y1 = std::min(y0 + 1, height - 1);
+            float ty = sy - y0;
+            for (int x = 0; x < size; ++x)
+            {
+                float sx = std::min(std::max((x + 0.5f) * width / size - 0.5f, 0.0f), (float)(width - 1));
+                int x0 = (int)sx;
+                int x1 = std::min(x0 + 1, width - 1);
+                float tx = sx - x0;
+
+                const unsigned char* p00 = source + ((size_t)y0 * width + x0) * components;
+                const unsigned char* p10 = source + ((size_t)y0 * width + x1) * components;
+                const unsigned char* p01 = source + ((size_t)y1 * width + x0) * components;
+                const unsigned char* p11 = source + ((size_t)y1 * width + x1) * components;
+                unsigned char* out = target + ((size_t)y * size + x) * 4;
+                for (int c = 0; c < 4; ++c)
+                {
+                    float top = channel(p00, components, c) * (1.0f - tx) + channel(p10, components, c) * tx;
+                    float bottom = channel(p01, components, c) * (1.0f - tx) + channel(p11, components, c) * tx;
+                    out[c] = (unsigned char)(top * (1.0f - ty) + bottom * ty + 0.5f);
+                }
+            }
+        }
+    }
+};
+
+inline TextureArrayManager& textureArrays()
+{
+    static TextureArrayManager manager;
+    return manager;
+}
+
+#endif /* textureArrays_h */
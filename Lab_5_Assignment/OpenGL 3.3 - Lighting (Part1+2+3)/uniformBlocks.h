@@ -0,0 +1,77 @@
+//
+//  uniformBlocks.h
+//  test
+//
+//  Fixed binding points of the uniform blocks shared by every program and a
+//  small wrapper around the buffer object that backs one of them.
+//
+
+#ifndef uniformBlocks_h
+#define uniformBlocks_h
+
+#include <glad/glad.h>
+
+// binding point of each shared block; GLSL 3.30 can't say layout(binding = N)
+// so Shader assigns these by block name right after linking
+enum UniformBlockBinding {
+    PER_FRAME_BLOCK_BINDING = 0,
+    LIGHTS_BLOCK_BINDING = 1,
+    MATERIALS_BLOCK_BINDING = 2
+};
+
+// hook every shared block the program declares up to its binding point
+inline void bindSharedUniformBlocks(GLuint program)
+{
+    static const struct {
+        const char* name;
+        GLuint binding;
+    } sharedBlocks[] = {
+        { "PerFrame", PER_FRAME_BLOCK_BINDING },
+        { "Lights", LIGHTS_BLOCK_BINDING },
+        { "Materials", MATERIALS_BLOCK_BINDING }
+    };
+
+    for (const auto& block : sharedBlocks)
+    {
+        GLuint index = glGetUniformBlockIndex(program, block.name);
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, index, block.binding);
+    }
+}
+
+class UniformBuffer {
+public:
+    UniformBuffer(GLuint binding, GLsizeiptr size, GLenum usage = GL_DYNAMIC_DRAW)
+        : binding(binding), size(size)
+    {
+        glGenBuffers(1, &ID);
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, size, NULL, usage);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+    }
+    ~UniformBuffer()
+    {
+        glDeleteBuffers(1, &ID);
+    }
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    void update(GLintptr offset, GLsizeiptr bytes, const void* data)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferSubData(GL_UNIFORM_BUFFER, offset, bytes, data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    GLuint getID() const { return ID; }
+    GLuint getBinding() const { return binding; }
+    GLsizeiptr getSize() const { return size; }
+
+private:
+    GLuint ID;
+    GLuint binding;
+    GLsizeiptr size;
+};
+
+#endif /* uniformBlocks_h */
@@ -0,0 +1,12 @@
+// decoding for the compact vertex formats of the geometry arena; must match
+// octahedralEncode() in vertexPacking.h
+
+// a point of the [0, 1] square back to the unit normal it was folded from
+vec3 octahedralDecode(vec2 encoded)
+{
+    vec2 folded = encoded * 2.0 - 1.0;
+    vec3 normal = vec3(folded, 1.0 - abs(folded.x) - abs(folded.y));
+    if (normal.z < 0.0)
+        normal.xy = (1.0 - abs(folded.yx)) * vec2(folded.x >= 0.0 ? 1.0 : -1.0, folded.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(normal);
+}
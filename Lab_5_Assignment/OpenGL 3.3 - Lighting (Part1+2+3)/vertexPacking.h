@@ -0,0 +1,296 @@
+//
+//  vertexPacking.h
+//  test
+//
+//  How the geometry arena stores a vertex. The generators all produce
+//  32-bit floats (position, normal and, for the textured layout, texture
+//  coordinates); the compact formats pack those into 16 bits a component
+//  on the way into the arena:
+//
+//    position   half floats around the centre of the mesh's bounding box,
+//               or 16-bit normalized integers across the box
+//    normal     octahedral encoding, two 16-bit normalized integers
+//    texcoord   two half floats (the walls repeat their textures, so the
+//               coordinates don't stay within [0, 1])
+//
+//  which halves a textured vertex from 32 to 16 bytes and a sphere vertex
+//  from 24 to 12. The Phong vertex shader undoes it in its
+//  COMPACT_VERTICES variant (see vertexPacking.glsl); the bounding box
+//  reaches it as two constant vertex attributes the arena sets per draw.
+//
+
+#ifndef vertexPacking_h
+#define vertexPacking_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+// which attributes a vertex has; each layout has its own buffer and VAO in the arena
+enum VertexLayout {
+    // position, normal, texture coordinates: cubes, hexagons, cylinders, cones
+    LAYOUT_POSITION_NORMAL_TEXCOORD = 0,
+    // position, normal: spheres
+    LAYOUT_POSITION_NORMAL = 1,
+    VERTEX_LAYOUT_COUNT = 2
+};
+
+// how those attributes are stored
+enum VertexFormat {
+    // 32-bit floats, as generated
+    VERTEX_FORMAT_FLOAT = 0,
+    // half-float positions relative to the centre of the mesh
+    VERTEX_FORMAT_HALF = 1,
+    // 16-bit normalized positions across the bounding box of the mesh
+    VERTEX_FORMAT_UNORM16 = 2
+};
+
+// constant attribute locations the compact formats read the position
+// decode from; the arena sets them with glVertexAttrib3f before each draw
+const GLuint POSITION_SCALE_ATTRIBUTE = 11;
+const GLuint POSITION_BIAS_ATTRIBUTE = 12;
+
+// object space position = stored position * scale + bias
+struct PositionDecode {
+    glm::vec3 scale = glm::vec3(1.0f);
+    glm::vec3 bias = glm::vec3(0.0f);
+
+    bool operator==(const PositionDecode& other) const { return scale == other.scale && bias == other.bias; }
+    bool operator!=(const PositionDecode& other) const { return !(*this == other); }
+};
+
+inline GLsizei floatsPerVertex(VertexLayout layout)
+{
+    return layout == LAYOUT_POSITION_NORMAL_TEXCOORD ? 8 : 6;
+}
+
+inline GLsizei vertexStride(VertexLayout layout, VertexFormat format)
+{
+    if (format == VERTEX_FORMAT_FLOAT)
+        return floatsPerVertex(layout) * (GLsizei)sizeof(float);
+    // 4 x 16-bit position (the last one pads), 2 x 16-bit normal, 2 x 16-bit texcoord
+    return layout == LAYOUT_POSITION_NORMAL_TEXCOORD ? 16 : 12;
+}
+
+// IEEE 754 binary16, rounding to nearest; out of range values become infinity
+inline unsigned short floatToHalf(float value)
+{
+    unsigned int bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    unsigned int sign = (bits >> 16) & 0x8000u;
+    int exponent = (int)((bits >> 23) & 0xffu) - 127 + 15;
+    unsigned int mantissa = bits & 0x7fffffu;
+
+    if (exponent <= 0)
+    {
+        // subnormal half, or zero when too small even for that
+        if (exponent < -10)
+            return (unsigned short)sign;
+        mantissa |= 0x800000u;
+        unsigned int shift = (unsigned int)(14 - exponent);
+        unsigned int half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1u)
+            ++half;
+        return (unsigned short)(sign | half);
+    }
+    if (exponent >= 31)
+        return (unsigned short)(sign | 0x7c00u);
+    unsigned int half = sign | ((unsigned int)exponent << 10) | (mantissa >> 13);
+    // a carry out of the mantissa correctly bumps the exponent
+    if (mantissa & 0x1000u)
+        ++half;
+    return (unsigned short)half;
+}
+
+inline float halfToFloat(unsigned short half)
+{
+    unsigned int sign = (unsigned int)(half & 0x8000u) << 16;
+    unsigned int exponent = (half >> 10) & 0x1fu;
+    unsigned int mantissa = half & 0x3ffu;
+    if (exponent == 0)
+    {
+        float value = std::ldexp((float)mantissa, -24);
+        return sign ? -value : value;
+    }
+    unsigned int bits = exponent == 31 ? sign | 0x7f800000u | (mantissa << 13)
+        : sign | ((exponent + 112) << 23) | (mantissa << 13);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline unsigned short floatToUnorm16(float value)
+{
+    return (unsigned short)(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f + 0.5f);
+}
+
+inline float unorm16ToFloat(unsigned short value)
+{
+    return value / 65535.0f;
+}
+
+// unit normal to a point of the [0, 1] square: folded onto the octahedron
+// |x| + |y| + |z| = 1, the lower half flipped over the upper one
+inline glm::vec2 octahedralEncode(const glm::vec3& normal)
+{
+    float length = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+    if (length == 0.0f)
+        return glm::vec2(0.5f, 0.5f);
+    glm::vec2 folded(normal.x / length, normal.y / length);
+    if (normal.z < 0.0f)
+    {
+        glm::vec2 flipped(1.0f - std::fabs(folded.y), 1.0f - std::fabs(folded.x));
+        folded.x = folded.x >= 0.0f ? flipped.x : -flipped.x;
+        folded.y = folded.y >= 0.0f ? flipped.y : -flipped.y;
+    }
+    return folded * 0.5f + glm::vec2(0.5f);
+}
+
+// inverse of octahedralEncode(), the same as octahedralDecode() in vertexPacking.glsl
+inline glm::vec3 octahedralDecode(const glm::vec2& encoded)
+{
+    glm::vec2 folded = encoded * 2.0f - glm::vec2(1.0f);
+    glm::vec3 normal(folded.x, folded.y, 1.0f - std::fabs(folded.x) - std::fabs(folded.y));
+    if (normal.z < 0.0f)
+    {
+        float x = 1.0f - std::fabs(folded.y), y = 1.0f - std::fabs(folded.x);
+        normal.x = folded.x >= 0.0f ? x : -x;
+        normal.y = folded.y >= 0.0f ? y : -y;
+    }
+    return glm::normalize(normal);
+}
+
+// the decode that fits the positions of these vertices into the format
+inline PositionDecode positionDecodeFor(VertexLayout layout, VertexFormat format, const float* vertices, GLsizei count)
+{
+    PositionDecode decode;
+    if (format == VERTEX_FORMAT_FLOAT || count == 0)
+        return decode;
+
+    GLsizei floats = floatsPerVertex(layout);
+    glm::vec3 low(vertices[0], vertices[1], vertices[2]), high = low;
+    for (GLsizei i = 1; i < count; ++i)
+    {
+        glm::vec3 position(vertices[i * floats], vertices[i * floats + 1], vertices[i * floats + 2]);
+        low = glm::min(low, position);
+        high = glm::max(high, position);
+    }
+    if (format == VERTEX_FORMAT_HALF)
+    {
+        decode.bias = (low + high) * 0.5f;
+        return decode;
+    }
+    // flat meshes (a hexagon) have no extent along one axis
+    glm::vec3 extent = high - low;
+    for (int axis = 0; axis < 3; ++axis)
+        decode.scale[axis] = extent[axis] > 0.0f ? extent[axis] : 1.0f;
+    decode.bias = low;
+    return decode;
+}
+
+// pack count float vertices of the layout into packed, which ends up
+// count * vertexStride(layout, format) bytes long
+inline void packVertices(VertexLayout layout, VertexFormat format, const PositionDecode& decode,
+    const float* vertices, GLsizei count, std::vector<unsigned char>& packed)
+{
+    GLsizei floats = floatsPerVertex(layout);
+    GLsizei stride = vertexStride(layout, format);
+    packed.resize((size_t)count * stride);
+    if (format == VERTEX_FORMAT_FLOAT)
+    {
+        std::memcpy(packed.data(), vertices, packed.size());
+        return;
+    }
+
+    for (GLsizei i = 0; i < count; ++i)
+    {
+        const float* vertex = vertices + (size_t)i * floats;
+        unsigned short out[8] = { 0 };
+        glm::vec3 position = (glm::vec3(vertex[0], vertex[1], vertex[2]) - decode.bias) / decode.scale;
+        for (int axis = 0; axis < 3; ++axis)
+            out[axis] = format == VERTEX_FORMAT_HALF ? floatToHalf(position[axis]) : floatToUnorm16(position[axis]);
+        glm::vec2 normal = octahedralEncode(glm::vec3(vertex[3], vertex[4], vertex[5]));
+        out[4] = floatToUnorm16(normal.x);
+        out[5] = floatToUnorm16(normal.y);
+        if (layout == LAYOUT_POSITION_NORMAL_TEXCOORD)
+        {
+            out[6] = floatToHalf(vertex[6]);
+            out[7] = floatToHalf(vertex[7]);
+        }
+        std::memcpy(packed.data() + (size_t)i * stride, out, stride);
+    }
+}
+
+// the other way, for reading meshes back from the arena
+inline void unpackVertices(VertexLayout layout, VertexFormat format, const PositionDecode& decode,
+    const unsigned char* packed, GLsizei count, std::vector<float>& vertices)
+{
+    GLsizei floats = floatsPerVertex(layout);
+    GLsizei stride = vertexStride(layout, format);
+    vertices.resize((size_t)count * floats);
+    if (format == VERTEX_FORMAT_FLOAT)
+    {
+        std::memcpy(vertices.data(), packed, vertices.size() * sizeof(float));
+        return;
+    }
+
+    for (GLsizei i = 0; i < count; ++i)
+    {
+        unsigned short in[8] = { 0 };
+        std::memcpy(in, packed + (size_t)i * stride, stride);
+        float* vertex = vertices.data() + (size_t)i * floats;
+        glm::vec3 position;
+        for (int axis = 0; axis < 3; ++axis)
+            position[axis] = format == VERTEX_FORMAT_HALF ? halfToFloat(in[axis]) : unorm16ToFloat(in[axis]);
+        position = position * decode.scale + decode.bias;
+        glm::vec3 normal = octahedralDecode(glm::vec2(unorm16ToFloat(in[4]), unorm16ToFloat(in[5])));
+        vertex[0] = position.x;
+        vertex[1] = position.y;
+        vertex[2] = position.z;
+        vertex[3] = normal.x;
+        vertex[4] = normal.y;
+        vertex[5] = normal.z;
+        if (layout == LAYOUT_POSITION_NORMAL_TEXCOORD)
+        {
+            vertex[6] = halfToFloat(in[6]);
+            vertex[7] = halfToFloat(in[7]);
+        }
+    }
+}
+
+// describe the vertex attributes of the bound VAO for vertices in the
+// buffer bound to GL_ARRAY_BUFFER
+inline void pointVertexAttributes(VertexLayout layout, VertexFormat format)
+{
+    GLsizei stride = vertexStride(layout, format);
+    if (format == VERTEX_FORMAT_FLOAT)
+    {
+        // position attribute
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        // vertex normal attribute
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+        // texture coordinate attribute
+        if (layout == LAYOUT_POSITION_NORMAL_TEXCOORD)
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+    }
+    else
+    {
+        if (format == VERTEX_FORMAT_HALF)
+            glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, stride, (void*)0);
+        else
+            glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)0);
+        glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)8);
+        if (layout == LAYOUT_POSITION_NORMAL_TEXCOORD)
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)12);
+    }
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    if (layout == LAYOUT_POSITION_NORMAL_TEXCOORD)
+        glEnableVertexAttribArray(2);
+}
+
+#endif /* vertexPacking_h */
@@ -5,8 +5,10 @@ layout (location = 1) in vec3 aNormal;
 out vec4 LightingColor;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// transpose(inverse(mat3(model))), worked out once per draw by Shader::setModel()
+uniform mat3 normalMatrix;
+
+#include "perFrame.glsl"
 
 struct Material {
     vec3 ambient;
@@ -15,23 +17,8 @@ struct Material {
     float shininess;
 };
 
-struct PointLight {
-    vec3 position;
-    
-    float k_c;  // attenuation factors
-    float k_l;  // attenuation factors
-    float k_q;  // attenuation factors
-    
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-
-#define NR_POINT_LIGHTS 4
+#include "lightsBlock.glsl"
 
-uniform vec3 viewPos;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
 uniform Material material;
 
 // function prototypes
@@ -42,16 +29,16 @@ void main()
     gl_Position = projection * view * model * vec4(aPos, 1.0);
     
     vec3 Pos = vec3(model * vec4(aPos, 1.0));
-    vec3 Normal = mat3(transpose(inverse(model))) * aNormal;
+    vec3 Normal = normalMatrix * aNormal;
     
     // properties
     vec3 N = normalize(Normal);
     vec3 V = normalize(viewPos - Pos);
 
-    vec3 result;
+    vec3 result = vec3(0.0);
     
     // point lights
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
+    for(int i = 0; i < pointLightCount; i++)
         result += CalcPointLight(material, pointLights[i], N, Pos, V);
     
     LightingColor = vec4(result, 1.0);
@@ -1,19 +1,69 @@
 #version 330 core
+#if defined(PROCEDURAL)
+// one per instance, streamed by ProceduralQueue; the vertices themselves
+// are made from gl_VertexID, see proceduralShapes.glsl
+layout (location = 0) in uvec3 aShape;
+layout (location = 1) in vec4 aDimensions;
+layout (location = 2) in vec4 aTextureRect;
+#elif defined(COMPACT_VERTICES)
+// packed by the geometry arena, see vertexPacking.h
+layout (location = 0) in vec3 aPackedPos;
+layout (location = 1) in vec2 aPackedNormal;
+// constant per mesh: position = aPackedPos * aPositionScale + aPositionBias
+layout (location = 11) in vec3 aPositionScale;
+layout (location = 12) in vec3 aPositionBias;
+#else
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
+#endif
+#if defined(TEXTURED) && !defined(PROCEDURAL)
+layout (location = 2) in vec2 aTexCoords;
+#endif
 
 out vec3 FragPos;
 out vec3 Normal;
+#ifdef TEXTURED
+out vec2 TexCoords;
+#endif
 
+#ifdef INSTANCED
+// one per instance, streamed by InstanceQueue or ProceduralQueue
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in mat3 aNormalMatrix;
+layout (location = 10) in uint aMaterialIndex;
+flat out uint MaterialIndex;
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// transpose(inverse(mat3(model))), worked out once per draw by Shader::setModel()
+uniform mat3 normalMatrix;
+#endif
+
+#include "perFrame.glsl"
+#include "vertexPacking.glsl"
+#include "proceduralShapes.glsl"
 
 void main()
 {
+#if defined(PROCEDURAL)
+    vec3 aPos, aNormal;
+    vec2 aTexCoords;
+    proceduralVertex(gl_VertexID, aShape, aDimensions, aPos, aNormal, aTexCoords);
+    aTexCoords = mix(aTextureRect.xy, aTextureRect.zw, aTexCoords);
+#elif defined(COMPACT_VERTICES)
+    vec3 aPos = aPackedPos * aPositionScale + aPositionBias;
+    vec3 aNormal = octahedralDecode(aPackedNormal);
+#endif
+#ifdef INSTANCED
+    mat4 model = aModel;
+    mat3 normalMatrix = aNormalMatrix;
+    MaterialIndex = aMaterialIndex;
+#endif
     gl_Position = projection * view * model * vec4(aPos, 1.0);
     
     FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    Normal = normalMatrix * aNormal;
+#ifdef TEXTURED
+    TexCoords = aTexCoords;
+#endif
     
 }